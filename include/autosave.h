@@ -0,0 +1,42 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include "common.h"
+
+// Autosaves write only the pages of the save layout that changed since the
+// slot was last written. Anything that writes to floors[] after generation
+// marks the bytes it wrote; once a snapshot is due the game thread copies
+// just the dirty pages and hands them to a writer thread, which updates the
+// older of two slot files, syncs, and only then writes its header. A crash
+// part way through leaves the other slot as it was.
+#define AUTOSAVE_SLOTS 2
+#define AUTOSAVE_PATH "autosave-%d.bin"  // Formatted with the slot number
+#define AUTOSAVE_TURNS 100               // Turns between autosaves in a normal game
+
+// Autosave counters, for the headless report and the bench
+typedef struct {
+    int autosaves;          // Snapshots handed to the writer
+    int skipped;            // Turns an autosave waited on a busy writer
+    int failed;             // Writes that did not complete
+    long long pages;        // Pages copied into snapshots
+    long long pause_ns;     // Game thread time spent taking snapshots
+    long long max_pause_ns;
+} AutosaveStats;
+
+// Dirty tracking
+void save_mark_dirty(const void* data, size_t size);  // Bytes of floors[] that changed
+void save_mark_floor(const Floor* floor);             // The whole floor and its enemies
+void save_mark_enemies(const EnemyPool* pool);        // A pool's block and bookkeeping
+
+// Autosave functions
+void autosave_init(int interval);  // Turns between autosaves, 0 to disable
+void autosave_use_path(const char* format);  // Slot file names, formatted with the slot number
+void autosave_tick(void);          // Called once a turn; snapshots when one is due
+int autosave_now(void);            // Snapshot now unless the writer is busy; returns 1 if taken
+void autosave_flush(void);         // Wait for the writer to finish
+void autosave_stop(void);          // Flush and stop the writer thread
+void autosave_reset(int from);     // Forget what the slots hold; from is the loaded save's fd, or -1
+int load_autosave(void);           // Load the newest valid slot; returns 1 on success
+const AutosaveStats* autosave_stats(void);
+
+#endif // AUTOSAVE_H
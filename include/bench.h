@@ -0,0 +1,9 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "common.h"
+
+// Run a benchmark selected by name; returns a process exit code
+int run_bench(int argc, char* argv[]);
+
+#endif // BENCH_H
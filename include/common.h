@@ -6,6 +6,7 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <stdint.h>
 #include <ncurses.h>  // Add ncurses header
 
 // Utility macros
@@ -20,11 +21,29 @@
 #define MAX_ROOMS 120
 #define MIN_ROOM_SIZE 5
 #define MAX_ROOM_SIZE 10
-#define MAX_ENEMIES 5
+#define ENEMY_POOL_MIN_CAPACITY 16  // Initial slots in a floor's enemy pool
+#define TICKS_PER_TURN 100          // Scheduler time resolution
+#define ENERGY_PER_ACTION 100       // Energy an actor spends on one action
+#define SPEED_NORMAL 100            // Energy gained per turn by a normal actor
+#define SCHEDULE_WHEEL_SIZE 256     // Ticks covered by one turn of the schedule wheel
+#define WAKE_RADIUS 6               // Dormant enemies this close to the player wake up
+#define SLEEP_DISTANCE 24           // Awake enemies this far from the player go dormant
+#define NOISE_RADIUS 10             // How far the sound of combat carries
+#define FROST_RADIUS 5              // Awake enemies this close to a read scroll are frozen
+#define FROST_TURNS 8               // Turns a scroll's frost lasts, plus the scroll's power
+#define WAKE_CELL_SIZE 8            // Tiles per side of a dormant-enemy grid cell
+#define ENEMY_REGEN_TURNS 10        // Turns for an enemy to regenerate one health
+#define ENEMY_RESPAWN_TURNS 200     // Turns between respawns on a depleted floor
+#define WANDER_RADIUS 4             // Furthest an enemy strays while the player is away
+#define ENEMY_PLAN_GRAIN 256        // Enemies planned per parallel work item
+#define WAKE_CELLS_X ((MAP_WIDTH + WAKE_CELL_SIZE - 1) / WAKE_CELL_SIZE)
+#define WAKE_CELLS_Y ((MAP_HEIGHT + WAKE_CELL_SIZE - 1) / WAKE_CELL_SIZE)
 #define MAX_ITEMS 10
 #define MAX_FLOORS 26
 #define INVENTORY_SIZE 20
 #define MAX_ENEMY_TYPES 4
+#define DEPTH_BANDS 4         // Floor ranges with their own spawn and loot weights
+#define DEPTH_BAND_FLOORS 3   // Floors per depth band
 #define VIEW_RADIUS 8
 #define MAX_NAME_LEN 32
 #define MAX_DESC_LEN 128
@@ -63,7 +82,7 @@ typedef enum {
 
 // Forward declarations of structures
 typedef struct Item Item;
-typedef struct Enemy Enemy;
+typedef struct EnemyPool EnemyPool;
 typedef struct StatusEffect StatusEffect;
 typedef struct Ability Ability;
 typedef struct Player Player;
@@ -88,6 +107,8 @@ typedef enum {
     ITEM_GOLD
 } ItemType;
 
+#define ITEM_TYPE_COUNT (ITEM_GOLD + 1)
+
 // Equipment slots
 typedef enum {
     SLOT_WEAPON,
@@ -105,6 +126,27 @@ typedef enum {
     ENEMY_BOSS      // Stronger with special abilities
 } EnemyType;
 
+// Static data shared by every enemy of one type
+typedef struct {
+    const char* name;
+    char symbol;
+    int max_health;
+    int power;      // Base damage
+    int defense;    // Damage reduction
+    int speed;      // Energy gained per turn
+    int range;      // Attack range
+    int exp_value;  // Experience points when defeated
+    unsigned char spawn_weight[DEPTH_BANDS];  // Percent chance per depth band
+} EnemyArchetype;
+
+// What an enemy decided to do with its action
+typedef enum {
+    INTENT_NONE,
+    INTENT_SLEEP,   // Lost interest in the player
+    INTENT_ATTACK,  // Attack the player
+    INTENT_MOVE     // Step towards the player
+} EnemyIntent;
+
 // Terrain types
 typedef enum {
     TERRAIN_WALL = '#',
@@ -149,48 +191,201 @@ struct Door {
     int is_locked;  // Whether the door is currently locked
 };
 
+// Item prototypes, indices into item_prototypes
+typedef enum {
+    ITEM_PROTO_NONE,
+    ITEM_PROTO_WEAPON,         // Affixes: prefix, weapon kind
+    ITEM_PROTO_ARMOR,          // Affixes: material, armor kind
+    ITEM_PROTO_HEALTH_POTION,
+    ITEM_PROTO_SCROLL,
+    ITEM_PROTO_RATION,
+    ITEM_PROTO_GOLD,
+    ITEM_PROTO_FLOOR_KEY,
+    ITEM_PROTO_IRON_SWORD,
+    ITEM_PROTO_LEATHER_ARMOR,
+    ITEM_PROTO_MINOR_POTION,
+    ITEM_PROTO_LOOSE_GOLD,
+    MAX_ITEM_PROTOS
+} ItemProtoId;
+
+#define ITEM_AFFIXES 2
+
+// Static data shared by every item built from the same prototype. Name and
+// description are printf formats, filled with the item's affix strings when
+// the prototype has affix tables and with its power otherwise.
+typedef struct {
+    ItemType type;
+    char symbol;
+    const char* name;
+    const char* description;
+    const char* const* affixes[ITEM_AFFIXES];  // NULL when unused
+    unsigned char num_affixes[ITEM_AFFIXES];
+} ItemPrototype;
+
 // Structure definitions
 struct Item {
-    char name[MAX_NAME_LEN];
-    char description[MAX_DESC_LEN];
-    int x;
-    int y;
-    char symbol;
-    int active;
-    ItemType type;
-    int value;      // Gold value or effect value
-    int power;      // Damage for weapons, defense for armor
-    int durability; // Number of uses remaining
-    int key_id;     // Unique ID for keys to match with doors
-    int target_floor;  // Floor where this key should be used
+    int16_t x;
+    int16_t y;
+    int16_t power;         // Damage for weapons, defense for armor, amount otherwise
+    int16_t value;         // Gold value
+    uint8_t proto;         // ItemProtoId, index into item_prototypes
+    uint8_t affix[ITEM_AFFIXES];  // Indices into the prototype's affix tables
+    uint8_t durability;    // Number of uses remaining
+    uint8_t active;
+    uint8_t key_id;        // Unique ID for keys to match with doors
+    uint8_t target_floor;  // Floor where this key should be used
 };
 
-struct Enemy {
-    char name[MAX_NAME_LEN];
-    int x;
-    int y;
-    char symbol;
-    int health;
-    int max_health;
-    int active;
-    EnemyType type;
-    int power;      // Base damage
-    int defense;    // Damage reduction
-    int speed;      // Movement per turn
-    int range;      // Attack range
-    int exp_value;  // Experience points when defeated
+// What a timer does when it fires
+typedef enum {
+    TIMER_ABILITY_COOLDOWN,  // arg: ability index
+    TIMER_STATUS_EXPIRY,     // arg: status effect slot
+    TIMER_STORE_RESTOCK,     // arg: index into the floor's stores
+    TIMER_ENEMY_RESPAWN      // arg: unused
+} TimerKind;
+
+// Stable reference to a pending timer, built like an ItemHandle
+typedef uint32_t TimerHandle;
+#define TIMER_HANDLE_NONE 0
+#define TIMER_SLOT_BITS 8
+#define TIMER_SLOT_MASK ((1u << TIMER_SLOT_BITS) - 1)
+
+#define TIMER_CAPACITY 64     // Pending timers one wheel can hold
+#define TIMER_LEVELS 3        // Wheel levels below the overflow list
+#define TIMER_LEVEL_BITS 6    // Each level has 64 buckets
+#define TIMER_BUCKETS (1 << TIMER_LEVEL_BITS)
+
+typedef struct {
+    int deadline;        // Turn the timer fires on
+    int arg;
+    uint16_t generation; // Bumped whenever the timer is freed
+    uint8_t kind;        // TimerKind
+    uint8_t level;       // Level it is filed under, TIMER_LEVELS for overflow
+    uint8_t bucket;
+    uint8_t pending;
+    uint8_t next;        // Timer + 1 of the next timer in the same bucket
+    uint8_t prev;        // Timer + 1 of the previous timer in the same bucket
+} Timer;
+
+// Hierarchical timing wheel keyed on game turns. Level L buckets span
+// 64^L turns each; a timer is filed at the lowest level whose current span
+// holds its deadline and moves down a level each time its span starts.
+// A zero-filled wheel is a valid empty one starting at turn 0.
+typedef struct {
+    Timer timers[TIMER_CAPACITY];
+    uint8_t head[TIMER_LEVELS + 1][TIMER_BUCKETS];  // Timer + 1, level TIMER_LEVELS bucket 0 is overflow
+    uint8_t tail[TIMER_LEVELS + 1][TIMER_BUCKETS];
+    uint64_t occupied[TIMER_LEVELS + 1];             // Bit per non-empty bucket
+    int turn;       // Next turn to process
+    int free_head;  // Timer + 1 of the first freed timer
+    int used;       // Timers handed out at least once
+    int count;      // Pending timers
+} TimerWheel;
+
+// Stable reference to an inventory slot: low bits hold the slot index, high
+// bits hold the slot's generation so that handles to emptied slots go stale.
+typedef uint32_t ItemHandle;
+#define ITEM_HANDLE_NONE 0
+#define ITEM_SLOT_BITS 8
+#define ITEM_SLOT_MASK ((1u << ITEM_SLOT_BITS) - 1)
+#define MAX_ITEM_STACK 99
+
+// Slot map of the items the player carries. Items never move once stored;
+// a linked list threads the occupied slots in the order they are shown.
+// A zero-filled inventory is a valid empty one.
+typedef struct {
+    Item items[MAX_INVENTORY];
+    uint8_t count[MAX_INVENTORY];        // Stack size, 0 for a free slot
+    uint16_t generation[MAX_INVENTORY];  // Bumped whenever a slot is freed
+    uint8_t next_free[MAX_INVENTORY];    // Slot + 1 of the next free slot
+    uint8_t order_next[MAX_INVENTORY];   // Slot + 1 of the next slot shown
+    uint8_t order_prev[MAX_INVENTORY];   // Slot + 1 of the previous slot shown
+    int order_head;                      // Slot + 1 of the first slot shown
+    int order_tail;                      // Slot + 1 of the last slot shown
+    int free_head;                       // Slot + 1 of the first freed slot
+    int used;                            // Slots handed out at least once
+    int num_items;                       // Occupied slots
+} Inventory;
+
+// Stable reference to an enemy slot: low bits hold the slot index, high bits
+// hold the slot's generation so that handles to released slots go stale.
+typedef uint32_t EnemyHandle;
+#define ENEMY_HANDLE_NONE 0
+#define ENEMY_SLOT_BITS 20
+#define ENEMY_SLOT_MASK ((1u << ENEMY_SLOT_BITS) - 1)
+
+// Struct-of-arrays enemy storage. Every per-slot array lives in one block so
+// the pool can grow by reallocating a single allocation.
+struct EnemyPool {
+    // Hot fields, read every turn
+    int* x;
+    int* y;
+    int* health;
+    unsigned char* type;    // EnemyType, also the index into enemy_archetypes
+    unsigned char* active;
+
+    // Cold per-instance state; static stats live in enemy_archetypes
+    unsigned char* status;  // StatusType currently affecting the enemy
+    int* status_until;      // Turn the status wears off
+
+    // Scheduling: a timing wheel of slots bucketed by the tick they act on
+    int* energy;            // Energy carried over past the action threshold
+    long long* next_act;    // Tick of the next action
+    int* wheel_next;        // Slot + 1 of the next enemy in the same bucket
+    int* wheel_prev;        // Slot + 1 of the previous enemy in the same bucket
+    int* ready;             // Enemies due on the tick being processed
+    unsigned char* intent;  // EnemyIntent planned by each ready[] entry
+    signed char* intent_dx; // Step planned by each ready[] entry
+    signed char* intent_dy;
+    int* wave_x;            // Positions and ranges of the ready[] entries,
+    int* wave_y;            // gathered for the sensing pass
+    int* wave_range;
+    int* wave_dist;         // Distance to the player of each ready[] entry
+    unsigned char* wave_sense;  // SENSE_* flags of each ready[] entry
+
+    // Awake enemies are listed in awake_list and scheduled; dormant ones sit
+    // in the cell grid below and cost nothing until something wakes them
+    int* awake_list;        // Dense list of awake slots
+    int* awake_index;       // Position + 1 of each slot in awake_list, 0 if dormant
+    int* cell_next;         // Slot + 1 of the next dormant enemy in the same cell
+    int* cell_prev;         // Slot + 1 of the previous dormant enemy in the same cell
+    int num_awake;
+
+    // Slot bookkeeping
+    uint32_t* generation;
+    int* next_free;   // Free list links
+    int* live;        // Dense list of live slots
+    int* live_index;  // Position of each live slot in live[]
+    int num_live;
+    int capacity;
+    int free_head;
+    void* block;
+    int borrowed;     // The block belongs to a mapped save file, not the heap
+
+    // Slot + 1 of the enemy standing on each tile, 0 when empty
+    int occupant[MAP_HEIGHT][MAP_WIDTH];
+
+    // Slot + 1 of the first and last enemy in each wheel bucket
+    int wheel_head[SCHEDULE_WHEEL_SIZE];
+    int wheel_tail[SCHEDULE_WHEEL_SIZE];
+    long long wheel_tick;   // Next tick the wheel has not processed yet
+
+    // Slot + 1 of the first dormant enemy in each grid cell
+    int cell_head[WAKE_CELLS_Y][WAKE_CELLS_X];
 };
 
 struct StatusEffect {
     StatusType type;
-    int duration;
+    int duration;       // Turns the effect was applied for
     int power;
+    int until;          // Turn the effect wears off
+    TimerHandle timer;  // Expiry timer on the player's wheel
 };
 
 struct Ability {
     AbilityType type;
     int cooldown;
-    int current_cooldown;
+    int ready_turn;     // Turn the ability can be used again
     int power;
     char key;           // Hotkey to use ability
     char name[32];
@@ -198,13 +393,17 @@ struct Ability {
 };
 
 // Store structure
+// A store lives in its floor's store pool. Its stock for each restock
+// period is generated from seed and epoch the first time it is opened.
 struct Store {
     StoreType type;
-    char name[MAX_NAME_LEN];
-    char description[MAX_DESC_LEN];
+    uint64_t seed;      // Seed the store's stock is generated from
+    int epoch;          // Restock periods so far
+    int stocked;        // Whether inventory holds this period's stock
     Item inventory[MAX_ITEMS];
     int num_items;
-    int restock_timer;  // Turns until inventory restocks
+    int restock_period;  // Turns between restocks
+    int restock_turn;    // Turn of the next restock
 };
 
 struct NPC {
@@ -221,7 +420,7 @@ struct NPC {
     int shop_inventory[INVENTORY_SIZE];
     int num_shop_items;
     char dialogue[MAX_DIALOGUE_LEN];
-    Store* store;  // Add store pointer
+    int store;  // Index + 1 into the floor's stores, 0 if none
 };
 
 struct Room {
@@ -230,6 +429,9 @@ struct Room {
     int width;
     int height;
     RoomType type;  // Add room type
+    int populated;  // Whether items, stores and enemies have been placed
+    int item_slot;  // Floor item slot + 1 held for the room's item, 0 for none
+    int npc_slot;   // NPC slot + 1 held for the room's store, 0 for none
 };
 
 struct Floor {
@@ -242,18 +444,37 @@ struct Floor {
     int up_stairs_y;
     int down_stairs_x;
     int down_stairs_y;
-    Enemy enemies[MAX_ENEMIES];
+    EnemyPool enemies;
     Item items[MAX_ITEMS];
     Door doors[MAX_DOORS];  // Array of doors on this floor
     int num_doors;         // Number of doors currently on floor
     TerrainType terrain[MAP_HEIGHT][MAP_WIDTH];
+    unsigned char room_id[MAP_HEIGHT][MAP_WIDTH];  // Room index + 1 of each tile, 0 outside rooms
     int has_floor_key;  // Whether the floor key has been collected
     int has_visited;    // Whether the player has visited this floor before
     int has_stairs;     // Whether stairs have been placed
     NPC npcs[MAX_NPCS];  // Array of NPCs on this floor
+    Store stores[MAX_NPCS];  // Pool of the floor's stores, released with it
+    int num_stores;
     int floor_num;
+    uint64_t seed;          // Seed that room contents are generated from
+    int last_turn;          // Turn the floor was last simulated up to
+    int target_population;  // Enemies generated in the rooms seen so far
+    TimerWheel timers;      // Restock and respawn deadlines
 };
 
+// Combat stats derived from base stats, equipment and status effects. They
+// are rebuilt only when one of those changes; combat reads nothing else.
+typedef struct {
+    int attack;
+    int defense;
+    int crit_chance;
+    int dodge_chance;
+    int fire_resist;
+    int ice_resist;
+    int poison_resist;
+} PlayerStats;
+
 struct Player {
     char name[MAX_NAME_LEN];
     int x;
@@ -267,9 +488,8 @@ struct Player {
     int power;
     int defense;
     int gold;
-    Item inventory[MAX_INVENTORY];
-    Item* equipment[MAX_EQUIPMENT_SLOTS];
-    int num_items;
+    Inventory inventory;
+    Item equipment[MAX_EQUIPMENT_SLOTS];  // Inactive when the slot is empty
     int mana;
     int max_mana;
     int mana_regen;
@@ -281,6 +501,8 @@ struct Player {
     int fire_resist;        // Percentage resistance to fire damage
     int ice_resist;         // Percentage resistance to ice damage
     int poison_resist;      // Percentage resistance to poison damage
+    PlayerStats stats;      // Cached derived stats, see refresh_player_stats
+    TimerWheel timers;      // Cooldown and status deadlines
 };
 
 struct MessageLog {
@@ -300,17 +522,61 @@ struct DialogueNode {
     DialogueOption options[4];  // Max 4 options per dialogue node
 };
 
-// Global variables (moved after struct definitions)
-extern int camera_x;
-extern int camera_y;
-extern char messages[MAX_MESSAGES][MESSAGE_LENGTH];
-extern int current_floor;
-extern Floor floors[MAX_FLOORS];
-extern Player player;
-extern int game_turn;
-extern MessageLog message_log;
+// Random number stream
+typedef struct {
+    uint64_t state;
+} Rng;
+
+// Where the game loop gets its commands from
+typedef enum {
+    INPUT_TERMINAL,  // Keys read with getch
+    INPUT_SCRIPT,    // A fixed command string, repeated
+    INPUT_RANDOM,    // Random moves and waits from a seeded stream
+    INPUT_REPLAY     // Commands from an input log opened with open_replay
+} InputSourceType;
+
+typedef struct {
+    InputSourceType type;
+    const char* script;
+    size_t script_pos;
+    Rng rng;        // The random source's own stream
+    int exhausted;  // The replay log has run out
+    int turn_keys;  // Keys read since the last turn was played
+} InputState;
+
+// Everything one running game owns. Each thread selects a context with
+// use_game_context, which returns the one it replaces, and the simulation
+// reaches the selected context's fields through CTX(). One process can
+// therefore run any number of independent sessions side by side, each on
+// one thread at a time.
+typedef struct {
+    Floor* floors;  // MAX_FLOORS floors, in static storage, on the heap or in a mapped save
+    int current_floor;
+    int game_turn;
+    uint64_t game_seed;
+    Rng game_rng;
+    Rng* current_rng;  // Stream random_range draws from, see use_rng
+    Player player;
+    MessageLog message_log;
+    int kill_count;
+    int gold_collected;
+    int camera_x;
+    int camera_y;
+    int headless;  // Running without a terminal
+    InputState input;  // Each game reads from its own source
+} GameContext;
+
+extern _Thread_local GameContext* game_ctx;
+
+// A field of the selected context, as in CTX(player).hp
+#define CTX(field) (game_ctx->field)
 
 // Utility functions
+uint64_t mix_seed(uint64_t a, uint64_t b);
+void rng_seed(Rng* rng, uint64_t seed);
+uint64_t rng_next(Rng* rng);
+Rng* use_rng(Rng* rng);
+uint64_t random_bits(void);
 int random_range(int min, int max);
 void add_message(const char* fmt, ...);
 Floor* current_floor_ptr(void);
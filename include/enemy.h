@@ -3,13 +3,42 @@
 
 #include "common.h"
 
+// Stats and spawn weights of every enemy type, indexed by EnemyType
+extern const EnemyArchetype enemy_archetypes[MAX_ENEMY_TYPES];
+
+// Enemy pool functions
+void enemy_pool_init(EnemyPool* pool);
+void enemy_pool_free(EnemyPool* pool);
+size_t enemy_pool_block_size(int capacity);
+void enemy_pool_attach(EnemyPool* pool, void* block);  // Rebind a pool to its saved block
+int enemy_pool_reserve(EnemyPool* pool, int capacity);  // Returns 1 on success, 0 on failure
+int enemy_pool_alloc(EnemyPool* pool);                  // Returns a slot, or -1 on failure
+void enemy_pool_release(EnemyPool* pool, int slot);
+EnemyHandle enemy_handle(const EnemyPool* pool, int slot);
+int enemy_handle_slot(const EnemyPool* pool, EnemyHandle handle);  // Returns -1 if stale
+int enemy_at(const EnemyPool* pool, int x, int y);                 // Returns -1 if empty
+void set_enemy_position(EnemyPool* pool, int slot, int x, int y);
+
 // Enemy functions
-void init_enemies(void);
-void update_enemy(Enemy* enemy);
-void spawn_enemy(int x, int y, EnemyType type);
-void spawn_floor_enemies(void);
-void kill_enemy(Enemy* enemy);
-void move_enemy(Enemy* enemy, int dx, int dy);
-void enemy_attack(Enemy* enemy, int target_x, int target_y);
-
-#endif // ENEMY_H 
\ No newline at end of file
+const EnemyArchetype* enemy_archetype(const EnemyPool* pool, int slot);
+EnemyType choose_enemy_type(int floor_num);
+void update_enemies(void);
+void update_enemy(int slot);
+void plan_enemies(EnemyPool* pool, int count, int player_x, int player_y);  // Plans pool->ready[0..count)
+int enemy_speed(int slot);
+void apply_enemy_status(int slot, StatusType type, int duration);
+int freeze_enemies_near(int x, int y, int radius, int duration);  // Returns the number frozen
+void wake_enemy(int slot);
+void sleep_enemy(int slot);
+void make_noise(int x, int y, int radius);
+void wake_enemies_near_player(void);
+void sleep_all_enemies(void);
+void catch_up_enemies(int elapsed);
+void respawn_enemies(int count);
+EnemyHandle spawn_enemy(int x, int y, EnemyType type);
+int spawn_room_enemies(const Room* room);  // Returns enemies placed
+void kill_enemy(int slot);
+void move_enemy(int slot, int dx, int dy);
+void enemy_attack(int slot, int target_x, int target_y);
+
+#endif // ENEMY_H
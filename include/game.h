@@ -8,11 +8,18 @@
 #include "item.h"
 #include "ui.h"
 
+// Real-time mode: redraws per second unless --fps says otherwise, and the
+// highest tick or frame rate accepted
+#define DEFAULT_FRAME_HZ 30
+#define MAX_REALTIME_HZ 1000
+
 // Game state functions
 void init_game(long seed);
 void cleanup_game(void);
 void game_loop(void);
-void handle_input(int input);
+void realtime_game_loop(int tick_hz, int frame_hz);  // The world moves on without keys, see game.c
+int handle_input(int input);  // Returns 0 for a command that takes no turn
+int step_game(int input);     // handle_input then update_game; returns whether a turn was played
 void update_game(void);
 void render_game(void);
 
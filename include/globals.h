@@ -3,18 +3,15 @@
 
 #include "common.h"
 
-// Global variables
-extern int camera_x;
-extern int camera_y;
-extern char messages[MAX_MESSAGES][MESSAGE_LENGTH];
-extern int current_floor;
-extern Floor floors[MAX_FLOORS];
-extern Player player;
-extern int game_turn;
-extern MessageLog message_log;
+// The game state lives in a GameContext (see common.h). The process starts
+// with one for the interactive or headless game; more can be created to run
+// independent sessions side by side.
 
-// Player stats
-extern int kill_count;
-extern int gold_collected;
+// Game context functions
+GameContext* main_game_context(void);
+GameContext* use_game_context(GameContext* ctx);  // Select ctx on this thread; returns the previous one
+GameContext* create_game_context(uint64_t seed, const char* script);  // Headless, floor 1 generated; NULL on failure
+void destroy_game_context(GameContext* ctx);
+int step_game_context(GameContext* ctx);  // Play one command from ctx's input source; 0 once the player is dead
 
-#endif // GLOBALS_H 
\ No newline at end of file
+#endif // GLOBALS_H
@@ -0,0 +1,10 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "common.h"
+
+// Simulate a game without a terminal and report its speed; returns a
+// process exit code
+int run_headless(int argc, char* argv[]);
+
+#endif // HEADLESS_H
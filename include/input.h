@@ -0,0 +1,28 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "common.h"
+
+// Key returned once the replay log runs out; it backs out of every menu
+#define INPUT_END_KEY 27
+
+// Keys a script or the random source may spend on one turn. Menus read
+// until they are closed, which those sources need never do; past this
+// many keys they are handed INPUT_END_KEY instead.
+#define MAX_TURN_KEYS 64
+
+// Input source functions; each game context has its own source (InputSourceType is in common.h)
+void use_terminal_input(void);
+void use_script_input(const char* script);  // The string must outlive the run
+void use_random_input(uint64_t seed);
+void use_replay_input(void);
+InputSourceType input_source_type(void);
+int input_exhausted(void);                  // Whether the replay log has run out
+int read_input(void);                       // Next command from the active source, recorded if recording
+void end_input_turn(void);                  // Start the next turn's key budget
+
+// Real-time play on the terminal
+int poll_terminal_input(void);              // Queue typed keys without waiting; returns how many
+int read_tick_input(void);                  // Oldest queued key, or '.' when none
+
+#endif // INPUT_H
@@ -2,9 +2,22 @@
 #define ITEM_H
 
 #include "common.h"
+#include "loot.h"
+
+// Static data of every item prototype, indexed by ItemProtoId
+extern const ItemPrototype item_prototypes[MAX_ITEM_PROTOS];
+
+// Item prototype access and display text, generated on demand
+const ItemPrototype* item_prototype(const Item* item);
+ItemType item_type(const Item* item);
+Item make_item(ItemProtoId proto, int power, int value);
+const char* item_name(const Item* item);
+const char* item_description(const Item* item);
 
 // Item creation and initialization
 ItemType get_random_item_type(void);
+Item create_item_of_type(ItemType type, int floor_level);
+Item create_item_from_table(LootTableId table, int floor_level);  // Type drawn from an item table
 Item create_random_item(int floor_level);
 void init_items(Floor* floor);
 
@@ -0,0 +1,35 @@
+#ifndef LOOT_H
+#define LOOT_H
+
+#include "common.h"
+
+// Weighted tables that generators draw outcomes from
+typedef enum {
+    LOOT_ITEMS,          // Item types of ordinary random loot
+    LOOT_ROOM_ITEMS,     // Item types left lying in rooms
+    LOOT_WEAPON_STORE,   // Item types a weapon shop stocks
+    LOOT_ARMOR_STORE,    // Item types an armor shop stocks
+    LOOT_POTION_STORE,   // Item types a potion shop stocks
+    LOOT_ENEMIES,        // Enemy types, from the archetype spawn weights
+    MAX_LOOT_TABLES
+} LootTableId;
+
+#define MAX_LOOT_OUTCOMES 16
+
+// Depth band a floor falls in
+int depth_band(int floor_num);
+
+// Draw one outcome of a table at a floor's depth. Each draw costs one
+// random_bits call and no search: the tables are Walker alias tables,
+// built once per table and depth band on first use.
+int loot_draw(LootTableId table, int floor_num);
+
+// Fill out[0..count) with independent draws
+void loot_draw_many(LootTableId table, int floor_num, int* out, int count);
+
+// Weight of an outcome and the sum of all weights, for reporting
+int loot_weight(LootTableId table, int floor_num, int outcome);
+int loot_total_weight(LootTableId table, int floor_num);
+int loot_num_outcomes(LootTableId table);
+
+#endif // LOOT_H
@@ -6,6 +6,10 @@
 
 // Map generation and management functions
 void init_floor(int floor_num);
+void leave_floor(void);
+void catch_up_floor(Floor* floor, int elapsed);
+void start_floor_timers(Floor* floor);
+void update_floor_timers(Floor* floor, int turn);  // Fires restocks and respawns due by turn
 void create_tunnel(Floor* floor, int x1, int y1, int x2, int y2);
 void create_straight_tunnel(Floor* floor, int x1, int y1, int x2, int y2);
 Room generate_room(void);
@@ -18,8 +22,11 @@ int is_visible(int x, int y);
 void update_discovered_map(void);
 void generate_floor(Floor* floor);
 int is_away_from_walls(Floor* floor, int x, int y);
-void place_store(Floor* floor, Room* room);
 void check_items(void);
-void place_random_item(Floor* floor, Room* room);
+void reserve_room_slots(Floor* floor);  // Hold item and store slots for the rooms, in room order
+void populate_room(Floor* floor, int room_index);
+void populate_all_rooms(Floor* floor);
+int free_item_slot(const Floor* floor);  // Empty and not held for a room; -1 if none
+int find_map_tile(const Floor* floor, char c, int* x, int* y);  // Returns 0 if no tile shows c
 
 #endif // MAP_H 
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include "common.h"
+#include <stdio.h>
+
+// Memory is accounted to the subsystem that holds it. Heap blocks go
+// through the tagged allocator below, which keeps live and peak bytes per
+// tag, so a block that is never freed stays on its tag's count and a block
+// freed under another tag's name is counted as mismatched. Memory held in
+// place (the floors, the player's inventory, the message log) is measured
+// from the main game whenever a report is made or a floor is generated.
+typedef enum {
+    MEM_MAP,        // Map planes, rooms and doors
+    MEM_ENTITIES,   // Enemy pools, floor items, NPCs and floor timers
+    MEM_STORES,     // Store stock
+    MEM_INVENTORY,  // The player's inventory and equipment
+    MEM_MESSAGES,   // The message log
+    MEM_CACHES,     // Autosave snapshots and page checksums
+    MEM_IO,         // Save buffers, input logs and trace buffers
+    MEM_OTHER,      // Game contexts, benchmarks and sweeps
+    MAX_MEM_TAGS
+} MemTag;
+
+typedef struct {
+    long long heap_live;      // Bytes in blocks not yet freed
+    long long heap_peak;
+    long long heap_blocks;    // Blocks not yet freed
+    long long allocations;    // Blocks ever allocated
+    long long in_place_live;  // Bytes the main game holds outside the heap
+    long long in_place_peak;
+} MemStats;
+
+// Key that shows and hides the memory overlay. Like the profiler key it is
+// taken out of terminal input, so it never costs a turn or reaches a log.
+#define MEMORY_HUD_KEY 'M'
+
+// Tagged allocator. Blocks come back zeroed from mem_alloc; mem_realloc
+// leaves the grown part as realloc does. Both return NULL on failure.
+void* mem_alloc(MemTag tag, size_t size);
+void* mem_realloc(MemTag tag, void* block, size_t size);
+void mem_free(MemTag tag, void* block);
+
+// Accounting
+void mem_sample(void);  // Measure the main game's floors and note the peaks
+void mem_stats(MemTag tag, MemStats* stats);
+long long mem_mismatched_frees(void);
+int mem_floors_generated(void);
+const char* mem_tag_name(MemTag tag);
+void mem_report(FILE* out);
+
+#endif // MEMORY_H
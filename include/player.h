@@ -8,24 +8,26 @@
 // Functions
 void init_player(void);
 void move_player(int dx, int dy);
-int add_to_inventory(Item item);  // Returns 1 on success, 0 on failure
-void remove_from_inventory(int index);
-void use_item(Item* item);
+ItemHandle add_to_inventory(Item item);  // Returns ITEM_HANDLE_NONE when full
+void remove_from_inventory(ItemHandle handle);  // Removes one item from the stack
+Item* inventory_item(ItemHandle handle);        // Returns NULL if stale
+int inventory_count(ItemHandle handle);
+ItemHandle inventory_handle_at(int index);      // Handle shown at a display position
+ItemHandle find_floor_key(void);
+void use_item(ItemHandle handle);
 void equip_weapon(Item weapon);
 void equip_armor(Item armor);
 void view_inventory(void);
 void level_up(void);
+void refresh_player_stats(void);
 void apply_status_effect(StatusType type, int duration, int power);
 void handle_inventory(void);
-void drop_item(int index);
-void equip_item(int index);
+void drop_item(ItemHandle handle);
+void equip_item(ItemHandle handle);
 void add_ability(AbilityType type);
 void use_ability(int index);
-void update_abilities(void);
-void update_status_effects(void);
+void start_ability_cooldown(int index);
+void update_player_timers(void);  // Fires status expiries and cooldowns due this turn
 void check_player_items(void);
 
-// Global player state
-extern Player player;
-
 #endif 
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "common.h"
+
+// Parts of a turn and of a frame whose time is tracked
+typedef enum {
+    PROFILE_FOV,              // Field of view and room reveal
+    PROFILE_PLAYER,           // Handling the player's command
+    PROFILE_AI,               // Waking, planning and moving enemies
+    PROFILE_STATUSES,         // Status expiries, cooldowns, restocks and respawns
+    PROFILE_REGEN,            // Mana regeneration
+    PROFILE_BOOKKEEPING,      // The turn counter and the autosave hand-off
+    PROFILE_RENDER_MAP,
+    PROFILE_RENDER_MESSAGES,
+    PROFILE_RENDER_STATUS,
+    PROFILE_REFRESH,          // Pushing the frame to the terminal
+    MAX_PROFILE_PHASES
+} ProfilePhase;
+
+// Per-frame time of one phase, over the frames that ran it
+typedef struct {
+    long long last_ns;  // The most recent such frame
+    long long p50_ns;   // Percentiles are bucket upper bounds, within 1/8
+    long long p99_ns;
+    long long max_ns;
+    int frames;
+} ProfileStats;
+
+// Key that shows and hides the profiler HUD. It is taken out of terminal
+// input before the game sees it, so it never costs a turn or reaches a log.
+#define PROFILE_HUD_KEY '`'
+
+// Spans around the phases. Built without PROFILE (make PROFILE=0) they
+// expand to nothing, leaving no clock reads or calls in the paths timed.
+#ifdef PROFILE
+#define PROFILE_START(start) long long start = profile_now_ns()
+#define PROFILE_STOP(phase, start) profile_end((phase), (start))
+#define PROFILE_FRAME_END() profile_frame_end()
+#else
+#define PROFILE_START(start) ((void)0)
+#define PROFILE_STOP(phase, start) ((void)0)
+#define PROFILE_FRAME_END() ((void)0)
+#endif
+
+// Profile functions. Records are kept per thread.
+long long profile_now_ns(void);                          // Monotonic clock
+void profile_end(ProfilePhase phase, long long start);   // Charge the time since start to a phase
+void profile_frame_end(void);                            // File this frame's phase times in the histograms
+void profile_reset(void);
+long long profile_phase_ns(ProfilePhase phase);          // Total over every span since the reset
+void profile_phase_stats(ProfilePhase phase, ProfileStats* stats);
+const char* profile_phase_name(ProfilePhase phase);
+
+#endif // PROFILE_H
@@ -0,0 +1,33 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "common.h"
+
+// Input logs start with a 16-byte header: the magic, a version, the
+// checksum interval and the seed, all little-endian. Each command after it
+// is one byte, or REPLAY_WIDE_KEY and four bytes for keys outside ASCII.
+// REPLAY_CHECKSUM and eight bytes record the turn and the state checksum
+// after that turn.
+#define REPLAY_MAGIC "RLOG"
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 16
+#define REPLAY_WIDE_KEY 0xFE
+#define REPLAY_CHECKSUM 0xFF
+
+// Recording
+int start_recording(const char* path, uint64_t seed, int checksum_interval);  // Returns 1 on success
+void record_input(int input);  // Does nothing unless recording
+void record_turn(void);        // Call after each turn
+void stop_recording(void);
+int recording(void);          // Whether an input log is being written
+
+// Playback
+int open_replay(const char* path, uint64_t* seed);  // Returns 1 on success
+int replay_next_input(int* input);                  // Returns 0 at the end of the log
+int check_replay_turn(void);                        // Call after each turn; returns 0 on a mismatch
+int replay_has_diverged(void);                      // Whether playback stopped on a mismatch or a record out of place
+void close_replay(void);
+
+uint32_t game_state_checksum(void);
+
+#endif // REPLAY_H
@@ -0,0 +1,79 @@
+#ifndef SAVE_H
+#define SAVE_H
+
+#include "common.h"
+
+// Save files are a header page followed by page-aligned sections holding
+// the game's memory as it is laid out at run time, and a table with the
+// checksum of every one of those pages. Loading maps the file and points
+// the game at it, fixing up only the enemy pool pointers. The header
+// records struct sizes so a build with a different layout refuses the file
+// instead of misreading it.
+//
+// Because every page is checksummed on its own, an autosave can rewrite
+// just the pages that changed (see autosave.h).
+//
+// Saving and loading act on the main game context: the process keeps a
+// single mapping of the loaded save.
+#define SAVE_MAGIC "RLSV"
+#define SAVE_VERSION 2
+#define SAVE_PAGE 4096
+#define DEFAULT_SAVE_PATH "savegame.bin"
+
+typedef enum {
+    SAVE_SECTION_GAME,       // Turn, seed, random stream, player and messages
+    SAVE_SECTION_FLOORS,     // floors[0..MAX_FLOORS) including their stores
+    SAVE_SECTION_ENEMIES,    // Every floor's enemy pool block, each on its own pages
+    SAVE_SECTION_PAGE_SUMS,  // save_checksum of every page of the sections above
+    MAX_SAVE_SECTIONS
+} SaveSectionId;
+
+typedef struct {
+    uint64_t offset;    // From the start of the file, a multiple of SAVE_PAGE
+    uint64_t size;
+    uint64_t checksum;  // Of the section's page checksums, or of the table itself
+} SaveSection;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t page_size;
+    uint32_t num_floors;
+    uint32_t floor_size;
+    uint32_t game_size;
+    uint32_t enemy_pool_size;
+    uint64_t generation;  // Autosaves count up; the newest valid slot wins
+    uint64_t num_pages;   // Pages in the file, the header page included
+    SaveSection sections[MAX_SAVE_SECTIONS];
+    uint64_t enemy_offsets[MAX_FLOORS];  // Each pool's block within the enemies section
+    uint64_t checksum;                   // save_checksum of the header up to here
+} SaveHeader;
+
+// Everything outside floors[] that a save restores
+typedef struct {
+    int game_turn;
+    int current_floor;
+    int kill_count;
+    int gold_collected;
+    uint64_t game_seed;
+    Rng game_rng;
+    Player player;
+    MessageLog message_log;
+} SaveGameState;
+
+// Save functions
+int save_game(const char* path);  // Returns 1 on success
+int load_game(const char* path);  // Returns 1 on success and leaves the game untouched on failure
+void release_save(void);          // Drop the mapping of the last loaded save
+uint64_t save_checksum(const void* data, size_t size);
+
+// Page layout shared by full saves and autosaves
+void save_layout(SaveHeader* header);  // Header for the game as it is now, checksums unset
+void save_capture_state(SaveGameState* state);
+void save_fill_page(const SaveHeader* header, const SaveGameState* state, uint64_t page, char* out);
+uint64_t save_data_pages(const SaveHeader* header);  // Pages covered by the checksum table
+int save_write(int fd, const void* data, size_t size, uint64_t offset);  // Returns 1 once all is written
+int save_commit(int fd, SaveHeader* header, const uint64_t* page_sums);  // Table, sync, header, sync
+
+#endif // SAVE_H
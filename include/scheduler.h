@@ -0,0 +1,14 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "common.h"
+
+// Energy scheduler: a timing wheel of enemy slots bucketed by the tick of
+// their next action. Enemies due on the same tick act in the order they
+// were scheduled, so the order is deterministic.
+void schedule_enemy(EnemyPool* pool, int slot, long long tick);
+void unschedule_enemy(EnemyPool* pool, int slot);
+int collect_due_enemies(EnemyPool* pool, long long tick);           // Fills pool->ready, returns the count
+long long enemy_action_delay(EnemyPool* pool, int slot, int speed);  // Spend one action, return ticks until the next
+
+#endif // SCHEDULER_H
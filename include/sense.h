@@ -0,0 +1,32 @@
+#ifndef SENSE_H
+#define SENSE_H
+
+#include "common.h"
+
+// Flags the sensing pass computes for each enemy
+#define SENSE_ADJACENT 0x01  // Manhattan distance to the player is 1
+#define SENSE_IN_RANGE 0x02  // Player is within the enemy's attack range
+#define SENSE_TOO_FAR  0x04  // Player is beyond the enemy's interest distance
+
+// Implementations of the sensing kernel
+typedef enum {
+    SENSE_SCALAR,
+    SENSE_SSE2,
+    SENSE_AVX2,
+    SENSE_KERNEL_COUNT
+} SenseKernel;
+
+// Compute the Manhattan distance from each of count enemies to the player
+// along with its SENSE_* flags. An enemy with range 0 is never in range.
+void sense_batch(const int* xs, const int* ys, const int* ranges, int count,
+                 int player_x, int player_y, int far_distance,
+                 int* dist, unsigned char* flags);
+
+// Run a specific kernel; used to compare them
+int sense_kernel_available(SenseKernel kernel);
+const char* sense_kernel_name(SenseKernel kernel);
+void sense_batch_kernel(SenseKernel kernel, const int* xs, const int* ys, const int* ranges,
+                        int count, int player_x, int player_y, int far_distance,
+                        int* dist, unsigned char* flags);
+
+#endif // SENSE_H
@@ -4,9 +4,13 @@
 #include "common.h"
 
 // Store functions
-void init_store(Store* store, StoreType type);
-void restock_store(Store* store);
-void update_store(Store* store);
+Store* alloc_store(Floor* floor);               // Returns NULL when the pool is full
+Store* floor_store(Floor* floor, int store);    // Resolves an NPC's store index
+void init_store(Store* store, StoreType type, uint64_t seed);
+void restock_store(Store* store, int turn);  // Restock period starting at turn
+void stock_store(Store* store);
+const char* store_name(const Store* store);
+const char* store_description(const Store* store);
 int buy_item(Store* store, int index);
 int sell_item(int inventory_index);
 void display_store(Store* store);
@@ -0,0 +1,10 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "common.h"
+
+// Generate every floor of a range of seeds on the thread pool and check
+// the generation invariants; returns a process exit code
+int run_seed_sweep(int argc, char* argv[]);
+
+#endif // SWEEP_H
@@ -0,0 +1,15 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "common.h"
+
+// Body of a parallel loop: process items [begin, end) of the job
+typedef void (*ParallelForFn)(void* context, int begin, int end);
+
+// Thread pool functions
+int thread_pool_init(int threads);  // 0 picks one thread per core; returns the thread count
+void thread_pool_shutdown(void);
+int thread_pool_size(void);
+void parallel_for(int count, int grain, ParallelForFn fn, void* context);
+
+#endif // THREADPOOL_H
@@ -0,0 +1,20 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "common.h"
+
+// Called for each timer as it fires, in deadline order
+typedef void (*TimerFn)(void* ctx, TimerKind kind, int arg, int deadline);
+
+// Timer wheel functions
+void timer_wheel_init(TimerWheel* wheel, int turn);  // First turn the wheel will process
+TimerHandle timer_add(TimerWheel* wheel, int deadline, TimerKind kind, int arg);  // Returns TIMER_HANDLE_NONE when full
+void timer_cancel(TimerWheel* wheel, TimerHandle handle);
+int timer_pending(const TimerWheel* wheel, TimerHandle handle);
+
+// Fire every timer due up to and including turn. Stretches with nothing
+// due are skipped in one step, so the cost follows the number of
+// deadlines, not the number of turns. Returns the number fired.
+int timer_advance(TimerWheel* wheel, int turn, TimerFn fn, void* ctx);
+
+#endif // TIMER_H
@@ -0,0 +1,41 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include "common.h"
+#include "profile.h"
+
+// Spans written as Chrome trace event JSON, which Perfetto and
+// chrome://tracing open. Every profiler phase is traced, along with the
+// spans below. Each thread appends to its own chain of chunks without
+// locks and a writer thread drains the chains to the file. A thread only
+// allocates once a chunk fills, so a writer that falls behind (a headless
+// run on a single core) costs memory rather than events, up to
+// TRACE_MAX_CHUNKS per thread; past that, events are dropped and counted.
+#define TRACE_CHUNK_EVENTS 4096
+#define TRACE_MAX_CHUNKS 1024  // About 160 MB per thread
+#define MAX_TRACE_THREADS 64
+
+extern atomic_int trace_enabled;
+
+static inline int trace_active(void) {
+    return atomic_load_explicit(&trace_enabled, memory_order_relaxed);
+}
+
+// Spans that only the trace records. Like the profiler's, they are
+// compiled out without PROFILE; with it, an idle trace costs one load.
+#ifdef PROFILE
+#define TRACE_START(start) long long start = trace_active() ? profile_now_ns() : 0
+#define TRACE_STOP(name, start, arg_name, arg) \
+    do { if (start) trace_span((name), (start), (arg_name), (arg)); } while (0)
+#else
+#define TRACE_START(start) ((void)0)
+#define TRACE_STOP(name, start, arg_name, arg) ((void)0)
+#endif
+
+// Trace functions. Names must be string literals: only the pointer is kept.
+int trace_start(const char* path);  // Returns 1 on success
+void trace_stop(void);              // Drain every buffer and close the file
+void trace_span(const char* name, long long start_ns, const char* arg_name, int arg);  // Ends now; arg_name may be NULL
+
+#endif // TRACE_H
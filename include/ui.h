@@ -14,6 +14,13 @@ void render_messages(void);
 void render_status(void);
 void refresh_screen(void);
 
+// Profiler overlay, in builds with PROFILE, and memory overlay
+void render_profile_hud(void);
+void toggle_profile_hud(void);
+void render_memory_hud(void);
+void toggle_memory_hud(void);
+int handle_overlay_key(int key);  // Toggle the overlay key picks; 0 for other keys
+
 // Menu functions
 void show_inventory(void);
 void show_equipment(void);
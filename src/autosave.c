@@ -0,0 +1,516 @@
+#define _GNU_SOURCE  // gettid
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "../include/autosave.h"
+#include "../include/save.h"
+#include "../include/globals.h"
+#include "../include/enemy.h"
+#include "../include/profile.h"
+#include "../include/memory.h"
+
+#define FLOOR_PAGES ((sizeof(Floor) * MAX_FLOORS + SAVE_PAGE - 1) / SAVE_PAGE)
+#define DIRTY_WORDS ((FLOOR_PAGES + 63) / 64)
+
+// What changed since a slot was last written, kept by the game thread
+typedef struct {
+    uint64_t pages[DIRTY_WORDS];        // Pages of the floors section
+    unsigned char enemies[MAX_FLOORS];  // Enemy pool blocks
+    SaveHeader layout;                  // Layout the pages were last written with
+} DirtySet;
+
+// Pages copied for one autosave, handed from the game thread to the writer
+typedef struct {
+    int slot;
+    int fresh;          // Build the slot file from scratch
+    int base_fd;        // Save a fresh slot starts as a copy of, or -1 to start from zeros
+    SaveHeader header;
+    uint64_t* pages;    // Page numbers in the file, ascending
+    char* data;         // SAVE_PAGE bytes for each entry of pages
+    int count;
+    int capacity;
+} Snapshot;
+
+static DirtySet dirty[AUTOSAVE_SLOTS];
+static DirtySet touched;  // Everything written since the game started or was loaded
+static int base_fd = -1;  // The save the game was loaded from, kept open
+static const char* slot_path = AUTOSAVE_PATH;
+static int interval = 0;
+static int next_turn = 0;
+
+static Snapshot snapshot;
+static AutosaveStats stats;
+
+// Shared with the writer thread under lock
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t idle;
+    int started;
+    int busy;            // snapshot belongs to the writer
+    int stopping;
+    int fresh[AUTOSAVE_SLOTS];  // The slot file no longer matches what we track
+    uint64_t generation;        // Of the next autosave; its slot is generation % AUTOSAVE_SLOTS
+} writer = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+    .fresh = {1, 1},
+    .generation = 1,
+};
+
+// Page checksums of what each slot file holds; only the writer touches these
+static uint64_t* slot_sums[AUTOSAVE_SLOTS];
+static uint64_t slot_sums_size[AUTOSAVE_SLOTS];
+
+// Autosaves follow the main game; other sessions change nothing on disk
+static int tracking(void) {
+    return game_ctx == main_game_context();
+}
+
+static void mark_page(uint64_t page) {
+    uint64_t bit = 1ULL << (page % 64);
+    touched.pages[page / 64] |= bit;
+    for (int slot = 0; slot < AUTOSAVE_SLOTS; slot++) {
+        dirty[slot].pages[page / 64] |= bit;
+    }
+}
+
+// Mark the floors-section pages that size bytes at data fall on.
+// Writes outside floors[] are ignored.
+void save_mark_dirty(const void* data, size_t size) {
+    if (!tracking()) {
+        return;
+    }
+    uintptr_t base = (uintptr_t)CTX(floors);
+    uintptr_t address = (uintptr_t)data;
+    if (size == 0 || address < base || address >= base + sizeof(Floor) * MAX_FLOORS) {
+        return;
+    }
+    uint64_t first = (address - base) / SAVE_PAGE;
+    uint64_t last = min((uint64_t)((address - base + size - 1) / SAVE_PAGE), (uint64_t)FLOOR_PAGES - 1);
+    for (uint64_t page = first; page <= last; page++) {
+        mark_page(page);
+    }
+}
+
+void save_mark_floor(const Floor* floor) {
+    save_mark_dirty(floor, sizeof(Floor));
+    save_mark_enemies(&floor->enemies);
+}
+
+// Mark a pool's block and the bookkeeping around its occupancy grid, which
+// set_enemy_position marks a tile at a time
+void save_mark_enemies(const EnemyPool* pool) {
+    if (!tracking()) {
+        return;
+    }
+    uintptr_t base = (uintptr_t)CTX(floors);
+    uintptr_t address = (uintptr_t)pool;
+    if (address < base || address >= base + sizeof(Floor) * MAX_FLOORS) {
+        return;
+    }
+    int floor = (int)((address - base) / sizeof(Floor));
+    touched.enemies[floor] = 1;
+    for (int slot = 0; slot < AUTOSAVE_SLOTS; slot++) {
+        dirty[slot].enemies[floor] = 1;
+    }
+    save_mark_dirty(pool, offsetof(EnemyPool, occupant));
+    save_mark_dirty(pool->wheel_head, sizeof(EnemyPool) - offsetof(EnemyPool, wheel_head));
+}
+
+static int snapshot_reserve(int count) {
+    if (count <= snapshot.capacity) {
+        return 1;
+    }
+    int capacity = max(count, snapshot.capacity * 2);
+    uint64_t* pages = mem_realloc(MEM_CACHES, snapshot.pages, capacity * sizeof(uint64_t));
+    if (pages) {
+        snapshot.pages = pages;
+    }
+    char* data = mem_realloc(MEM_CACHES, snapshot.data, (size_t)capacity * SAVE_PAGE);
+    if (data) {
+        snapshot.data = data;
+    }
+    if (!pages || !data) {
+        return 0;
+    }
+    snapshot.capacity = capacity;
+    return 1;
+}
+
+static int snapshot_page(const SaveGameState* state, uint64_t page) {
+    if (!snapshot_reserve(snapshot.count + 1)) {
+        return 0;
+    }
+    snapshot.pages[snapshot.count] = page;
+    save_fill_page(&snapshot.header, state, page, snapshot.data + (size_t)snapshot.count * SAVE_PAGE);
+    snapshot.count++;
+    return 1;
+}
+
+static int same_enemy_layout(const SaveHeader* a, const SaveHeader* b) {
+    return a->sections[SAVE_SECTION_ENEMIES].size == b->sections[SAVE_SECTION_ENEMIES].size &&
+           memcmp(a->enemy_offsets, b->enemy_offsets, sizeof(a->enemy_offsets)) == 0;
+}
+
+// Copy the pages a slot is missing. A fresh slot gets every page written
+// since the game started or was loaded; the writer fills in the rest from
+// the loaded save, or leaves it as zeros.
+static int take_snapshot(int slot, int fresh, uint64_t generation) {
+    SaveGameState state;
+    save_capture_state(&state);
+    snapshot.slot = slot;
+    snapshot.fresh = fresh;
+    snapshot.base_fd = base_fd;
+    snapshot.count = 0;
+    save_layout(&snapshot.header);
+    snapshot.header.generation = generation;
+
+    DirtySet* changes = fresh ? &touched : &dirty[slot];
+    int all_enemies = !same_enemy_layout(&snapshot.header, &changes->layout);
+    const SaveSection* sections = snapshot.header.sections;
+
+    uint64_t game_first = sections[SAVE_SECTION_GAME].offset / SAVE_PAGE;
+    uint64_t game_pages = (sections[SAVE_SECTION_GAME].size + SAVE_PAGE - 1) / SAVE_PAGE;
+    for (uint64_t page = 0; page < game_pages; page++) {
+        if (!snapshot_page(&state, game_first + page)) {
+            return 0;
+        }
+    }
+
+    uint64_t floors_first = sections[SAVE_SECTION_FLOORS].offset / SAVE_PAGE;
+    for (int word = 0; word < (int)DIRTY_WORDS; word++) {
+        for (uint64_t bits = changes->pages[word]; bits; bits &= bits - 1) {
+            if (!snapshot_page(&state, floors_first + word * 64 + __builtin_ctzll(bits))) {
+                return 0;
+            }
+        }
+    }
+
+    uint64_t enemies_offset = sections[SAVE_SECTION_ENEMIES].offset;
+    for (int i = 0; i < MAX_FLOORS; i++) {
+        if (!all_enemies && !changes->enemies[i]) {
+            continue;
+        }
+        uint64_t first = (enemies_offset + snapshot.header.enemy_offsets[i]) / SAVE_PAGE;
+        uint64_t pages = (enemy_pool_block_size(CTX(floors)[i].enemies.capacity) + SAVE_PAGE - 1) / SAVE_PAGE;
+        for (uint64_t page = 0; page < pages; page++) {
+            if (!snapshot_page(&state, first + page)) {
+                return 0;
+            }
+        }
+    }
+
+    memset(dirty[slot].pages, 0, sizeof(dirty[slot].pages));
+    memset(dirty[slot].enemies, 0, sizeof(dirty[slot].enemies));
+    dirty[slot].layout = snapshot.header;
+    return 1;
+}
+
+// Copy the loaded save into a fresh slot file and take over its page
+// checksums, so the slot needs only the pages changed since the load
+static int copy_base(int from, int to, int slot) {
+    SaveHeader header;
+    if (pread(from, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        return 0;
+    }
+    static char run[SAVE_PAGE * 64];
+    for (uint64_t page = 0; page < header.num_pages; page += 64) {
+        size_t size = (size_t)min(header.num_pages - page, (uint64_t)64) * SAVE_PAGE;
+        if (pread(from, run, size, (off_t)(page * SAVE_PAGE)) != (ssize_t)size ||
+            !save_write(to, run, size, page * SAVE_PAGE)) {
+            return 0;
+        }
+    }
+
+    uint64_t data_pages = save_data_pages(&header);
+    const SaveSection* sums = &header.sections[SAVE_SECTION_PAGE_SUMS];
+    uint64_t* table = mem_realloc(MEM_CACHES, slot_sums[slot], max(data_pages, (uint64_t)1) * sizeof(uint64_t));
+    if (!table) {
+        return 0;
+    }
+    slot_sums[slot] = table;
+    slot_sums_size[slot] = 0;
+    if (pread(from, table, sums->size, (off_t)sums->offset) != (ssize_t)sums->size) {
+        return 0;
+    }
+    slot_sums_size[slot] = data_pages;
+    return 1;
+}
+
+// Bring the slot's page checksums in line with the layout being written.
+// Game and floor pages never move; enemy pages that did are all rewritten.
+static int resize_slot_sums(int slot, uint64_t data_pages, int fresh) {
+    static uint64_t zero_sum = 0;
+    if (!zero_sum) {
+        static const char zeros[SAVE_PAGE];
+        zero_sum = save_checksum(zeros, SAVE_PAGE);
+    }
+    if (data_pages != slot_sums_size[slot]) {
+        uint64_t* sums = mem_realloc(MEM_CACHES, slot_sums[slot], max(data_pages, (uint64_t)1) * sizeof(uint64_t));
+        if (!sums) {
+            return 0;
+        }
+        slot_sums[slot] = sums;
+    }
+    uint64_t keep = fresh ? 0 : min(data_pages, slot_sums_size[slot]);
+    for (uint64_t i = keep; i < data_pages; i++) {
+        slot_sums[slot][i] = zero_sum;
+    }
+    slot_sums_size[slot] = data_pages;
+    return 1;
+}
+
+// Write a snapshot into its slot. A fresh slot is built in a temporary
+// file and renamed over the old one, which also keeps a slot the game is
+// mapped from untouched; otherwise the changed pages go into the file in
+// place and save_commit makes them count only once they are all down.
+static int write_snapshot(const Snapshot* snap) {
+    char path[64], temp_path[80];
+    snprintf(path, sizeof(path), slot_path, snap->slot);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    const char* target = snap->fresh ? temp_path : path;
+    int fd = open(target, snap->fresh ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+    SaveHeader header = snap->header;
+    uint64_t* sums = NULL;
+    int from_base = snap->fresh && snap->base_fd >= 0;
+    int ok = !from_base || copy_base(snap->base_fd, fd, snap->slot);
+    ok = ok && resize_slot_sums(snap->slot, save_data_pages(&header), snap->fresh && !from_base);
+    if (ok) {
+        sums = slot_sums[snap->slot];
+    }
+
+    // Runs of consecutive pages go out in one write
+    for (int i = 0; ok && i < snap->count;) {
+        int run = 1;
+        while (i + run < snap->count && snap->pages[i + run] == snap->pages[i] + run) {
+            run++;
+        }
+        for (int j = i; j < i + run; j++) {
+            sums[snap->pages[j] - 1] = save_checksum(snap->data + (size_t)j * SAVE_PAGE, SAVE_PAGE);
+        }
+        ok = save_write(fd, snap->data + (size_t)i * SAVE_PAGE, (size_t)run * SAVE_PAGE,
+                       snap->pages[i] * SAVE_PAGE);
+        i += run;
+    }
+    ok = ok && save_commit(fd, &header, sums);
+    ok = close(fd) == 0 && ok;
+    if (snap->fresh) {
+        ok = ok && rename(temp_path, path) == 0;
+        if (!ok) {
+            remove(temp_path);
+        }
+    }
+    return ok;
+}
+
+static void* writer_main(void* arg) {
+    (void)arg;
+    // Lowest priority, so that on a single core handing over a snapshot
+    // does not hand over the CPU with it
+    setpriority(PRIO_PROCESS, (id_t)gettid(), 19);
+    pthread_mutex_lock(&writer.lock);
+    while (1) {
+        while (!writer.busy && !writer.stopping) {
+            pthread_cond_wait(&writer.work, &writer.lock);
+        }
+        if (!writer.busy) {
+            break;
+        }
+        pthread_mutex_unlock(&writer.lock);
+
+        int ok = write_snapshot(&snapshot);
+
+        pthread_mutex_lock(&writer.lock);
+        // A failed write leaves the slot unknown: rebuild it, under the same
+        // generation, rather than move on to the slot holding the last good save
+        if (ok) {
+            writer.fresh[snapshot.slot] = 0;
+            writer.generation = snapshot.header.generation + 1;
+        } else {
+            writer.fresh[snapshot.slot] = 1;
+            stats.failed++;
+        }
+        writer.busy = 0;
+        pthread_cond_broadcast(&writer.idle);
+    }
+    pthread_mutex_unlock(&writer.lock);
+    return NULL;
+}
+
+// Generation in a slot file's header, or 0 if it has no valid header
+static uint64_t slot_generation(int slot) {
+    char path[64];
+    snprintf(path, sizeof(path), slot_path, slot);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    SaveHeader header;
+    ssize_t got = pread(fd, &header, sizeof(header), 0);
+    close(fd);
+    if (got != (ssize_t)sizeof(header) || memcmp(header.magic, SAVE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SAVE_VERSION ||
+        header.checksum != save_checksum(&header, offsetof(SaveHeader, checksum))) {
+        return 0;
+    }
+    return header.generation;
+}
+
+// Keep the slots somewhere else, for the bench; format takes the slot number
+void autosave_use_path(const char* format) {
+    autosave_flush();
+    slot_path = format;
+    autosave_reset(-1);
+}
+
+// Turn autosaves on. Numbering carries on from the slots on disk, so the
+// first autosave goes to the slot that does not hold the newest one.
+void autosave_init(int turns) {
+    interval = max(turns, 0);
+    next_turn = CTX(game_turn) + interval;
+
+    uint64_t newest = 0;
+    for (int slot = 0; slot < AUTOSAVE_SLOTS; slot++) {
+        newest = max(newest, slot_generation(slot));
+    }
+    pthread_mutex_lock(&writer.lock);
+    writer.generation = max(writer.generation, newest + 1);
+    pthread_mutex_unlock(&writer.lock);
+}
+
+// Save once a turn has come round to the next autosave. A busy writer
+// puts it off to the next turn.
+void autosave_tick(void) {
+    if (interval > 0 && tracking() && CTX(game_turn) >= next_turn && autosave_now()) {
+        next_turn = CTX(game_turn) + interval;
+    }
+}
+
+// Copy the changed pages and hand them to the writer. The copy is the only
+// part of an autosave the game waits for, and what the pause counts.
+int autosave_now(void) {
+    long long start = profile_now_ns();
+    pthread_mutex_lock(&writer.lock);
+    if (writer.busy) {
+        stats.skipped++;
+        pthread_mutex_unlock(&writer.lock);
+        return 0;
+    }
+    uint64_t generation = writer.generation;
+    int slot = (int)(generation % AUTOSAVE_SLOTS);
+    int fresh = writer.fresh[slot];
+    if (!writer.started) {
+        writer.started = pthread_create(&writer.thread, NULL, writer_main, NULL) == 0;
+    }
+    pthread_mutex_unlock(&writer.lock);
+
+    if (!writer.started || !take_snapshot(slot, fresh, generation)) {
+        pthread_mutex_lock(&writer.lock);
+        writer.fresh[slot] = 1;
+        stats.failed++;
+        pthread_mutex_unlock(&writer.lock);
+        return 0;
+    }
+
+    long long pause = profile_now_ns() - start;
+    stats.autosaves++;
+    stats.pages += snapshot.count;
+    stats.pause_ns += pause;
+    stats.max_pause_ns = max(stats.max_pause_ns, pause);
+
+    pthread_mutex_lock(&writer.lock);
+    writer.busy = 1;
+    pthread_cond_signal(&writer.work);
+    pthread_mutex_unlock(&writer.lock);
+    return 1;
+}
+
+void autosave_flush(void) {
+    pthread_mutex_lock(&writer.lock);
+    while (writer.busy) {
+        pthread_cond_wait(&writer.idle, &writer.lock);
+    }
+    pthread_mutex_unlock(&writer.lock);
+}
+
+void autosave_stop(void) {
+    pthread_mutex_lock(&writer.lock);
+    int started = writer.started;
+    writer.stopping = 1;
+    pthread_cond_signal(&writer.work);
+    pthread_mutex_unlock(&writer.lock);
+    if (started) {
+        pthread_join(writer.thread, NULL);
+    }
+
+    pthread_mutex_lock(&writer.lock);
+    writer.started = 0;
+    writer.stopping = 0;
+    pthread_mutex_unlock(&writer.lock);
+}
+
+// The game now lives somewhere else: rebuild both slots from scratch.
+// Given the save the game was loaded from, the slots start as copies of it;
+// otherwise every floor that holds anything counts as written.
+void autosave_reset(int from) {
+    autosave_flush();
+    memset(dirty, 0, sizeof(dirty));
+    memset(&touched, 0, sizeof(touched));
+    if (base_fd >= 0) {
+        close(base_fd);
+    }
+    base_fd = from >= 0 ? dup(from) : -1;
+    if (base_fd >= 0 && pread(base_fd, &touched.layout, sizeof(SaveHeader), 0) != (ssize_t)sizeof(SaveHeader)) {
+        close(base_fd);
+        base_fd = -1;
+    }
+    if (base_fd < 0) {
+        memset(&touched.layout, 0, sizeof(SaveHeader));
+        for (int i = 0; i < MAX_FLOORS; i++) {
+            if (CTX(floors)[i].has_visited || CTX(floors)[i].enemies.block) {
+                save_mark_floor(&CTX(floors)[i]);
+            }
+        }
+    }
+    pthread_mutex_lock(&writer.lock);
+    for (int slot = 0; slot < AUTOSAVE_SLOTS; slot++) {
+        writer.fresh[slot] = 1;
+    }
+    pthread_mutex_unlock(&writer.lock);
+    next_turn = CTX(game_turn) + interval;
+}
+
+// Load the newest slot that validates, falling back to the older one
+int load_autosave(void) {
+    autosave_flush();
+    uint64_t generations[AUTOSAVE_SLOTS];
+    for (int slot = 0; slot < AUTOSAVE_SLOTS; slot++) {
+        generations[slot] = slot_generation(slot);
+    }
+    int newest = generations[1] > generations[0];
+    int order[AUTOSAVE_SLOTS] = {newest, !newest};
+    for (int i = 0; i < AUTOSAVE_SLOTS; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), slot_path, order[i]);
+        if (generations[order[i]] && load_game(path)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const AutosaveStats* autosave_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,516 @@
+#include "../include/bench.h"
+#include "../include/globals.h"
+#include "../include/enemy.h"
+#include "../include/player.h"
+#include "../include/map.h"
+#include "../include/threadpool.h"
+#include "../include/sense.h"
+#include "../include/loot.h"
+#include "../include/save.h"
+#include "../include/autosave.h"
+#include "../include/game.h"
+#include "../include/input.h"
+#include "../include/replay.h"
+#include "../include/memory.h"
+#include <time.h>
+#include <unistd.h>
+
+// Monotonic clock in nanoseconds
+static long long bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Replace floor 0 with one open arena so any number of enemies fits
+static Floor* setup_arena_floor(void) {
+    Floor* floor = &CTX(floors)[0];
+    enemy_pool_free(&floor->enemies);
+    memset(floor, 0, sizeof(Floor));
+
+    for (int y = 0; y < MAP_HEIGHT; y++) {
+        for (int x = 0; x < MAP_WIDTH; x++) {
+            int edge = x == 0 || y == 0 || x == MAP_WIDTH - 1 || y == MAP_HEIGHT - 1;
+            floor->map[y][x] = edge ? '#' : '.';
+            floor->terrain[y][x] = edge ? TERRAIN_WALL : TERRAIN_FLOOR;
+        }
+    }
+    floor->has_visited = 1;
+    CTX(current_floor) = 0;
+    CTX(game_turn) = 0;
+    start_floor_timers(floor);
+
+    init_player();
+    CTX(player).x = MAP_WIDTH / 2;
+    CTX(player).y = MAP_HEIGHT / 2;
+    CTX(player).health = CTX(player).max_health = 1 << 30;
+    return floor;
+}
+
+// Fill the arena with count enemies on distinct random tiles
+static void populate_arena(Floor* floor, int count) {
+    while (floor->enemies.num_live < count) {
+        int x = random_range(1, MAP_WIDTH - 2);
+        int y = random_range(1, MAP_HEIGHT - 2);
+        if (x == CTX(player).x && y == CTX(player).y) continue;
+        spawn_enemy(x, y, (EnemyType)(random_range(0, MAX_ENEMY_TYPES - 1)));
+    }
+}
+
+// Turn time of the enemy update as the population grows. Only enemies
+// near the player wake up, so the cost should track the awake column.
+static int bench_enemies(void) {
+    static const int counts[] = {10, 100, 1000, 4000, 8000};
+    const int turns = 50;
+
+    printf("%10s %10s %12s %12s\n", "enemies", "awake", "us/turn", "ns/awake");
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        rng_seed(&CTX(game_rng), 1);
+        Floor* floor = setup_arena_floor();
+        populate_arena(floor, counts[i]);
+
+        long long start = bench_now_ns();
+        for (int turn = 0; turn < turns; turn++) {
+            wake_enemies_near_player();
+            update_enemies();
+            CTX(game_turn)++;
+        }
+        double ns_per_turn = (double)(bench_now_ns() - start) / turns;
+        int awake = floor->enemies.num_awake;
+
+        printf("%10d %10d %12.1f %12.1f\n", counts[i], awake, ns_per_turn / 1000.0,
+               ns_per_turn / max(awake, 1));
+        enemy_pool_free(&floor->enemies);
+    }
+    return 0;
+}
+
+// Time to bring a populated floor up to date after the player was away
+static int bench_catchup(void) {
+    static const int elapsed[] = {10, 1000, 10000, 1000000};
+
+    printf("%10s %10s %12s\n", "elapsed", "enemies", "us");
+    for (size_t i = 0; i < sizeof(elapsed) / sizeof(elapsed[0]); i++) {
+        rng_seed(&CTX(game_rng), 1);
+        Floor* floor = setup_arena_floor();
+        populate_arena(floor, 4000);
+
+        // Treat the arena as one room so enemies wander and respawn
+        floor->rooms[0] = (Room){ .x = 0, .y = 0, .width = MAP_WIDTH, .height = MAP_HEIGHT, .populated = 1 };
+        floor->num_rooms = 1;
+        memset(floor->room_id, 1, sizeof(floor->room_id));
+        floor->target_population = 4500;
+
+        long long start = bench_now_ns();
+        catch_up_floor(floor, elapsed[i]);
+        double ns = (double)(bench_now_ns() - start);
+
+        printf("%10d %10d %12.1f\n", elapsed[i], floor->enemies.num_live, ns / 1000.0);
+        enemy_pool_free(&floor->enemies);
+    }
+    return 0;
+}
+
+// FNV-1a hash of every enemy's position, to compare runs
+static uint32_t enemy_positions_hash(const EnemyPool* pool) {
+    uint32_t hash = 2166136261u;
+    for (int slot = 0; slot < pool->capacity; slot++) {
+        int values[2] = {pool->active[slot] ? pool->x[slot] : -1, pool->y[slot]};
+        const unsigned char* bytes = (const unsigned char*)values;
+        for (size_t i = 0; i < sizeof(values); i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+// Scaling of the parallel planning phase with the thread count. Every
+// enemy is woken each turn so the whole population plans; the checksum of
+// final positions must match across thread counts.
+static int bench_threads(void) {
+    static const int thread_counts[] = {1, 2, 4, 8};
+    const int enemies = 8000;
+    const int plan_reps = 200;
+    const int turns = 20;
+    double base_plan_ns = 0;
+
+    printf("%8s %12s %12s %10s %10s\n", "threads", "plan us", "turn us", "speedup", "checksum");
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        int threads = thread_pool_init(thread_counts[i]);
+        rng_seed(&CTX(game_rng), 1);
+        Floor* floor = setup_arena_floor();
+        EnemyPool* pool = &floor->enemies;
+        populate_arena(floor, enemies);
+
+        // Planning alone, over the whole population
+        memcpy(pool->ready, pool->live, sizeof(int) * (size_t)pool->num_live);
+        long long start = bench_now_ns();
+        for (int rep = 0; rep < plan_reps; rep++) {
+            plan_enemies(pool, pool->num_live, CTX(player).x, CTX(player).y);
+        }
+        double plan_ns = (double)(bench_now_ns() - start) / plan_reps;
+        if (i == 0) base_plan_ns = plan_ns;
+
+        // Full turns with everyone awake
+        start = bench_now_ns();
+        for (int turn = 0; turn < turns; turn++) {
+            for (int j = 0; j < pool->num_live; j++) {
+                wake_enemy(pool->live[j]);
+            }
+            update_enemies();
+            CTX(game_turn)++;
+        }
+        double turn_ns = (double)(bench_now_ns() - start) / turns;
+
+        printf("%8d %12.1f %12.1f %10.2f %10x\n", threads, plan_ns / 1000.0,
+               turn_ns / 1000.0, base_plan_ns / plan_ns, enemy_positions_hash(pool));
+        enemy_pool_free(&floor->enemies);
+    }
+    thread_pool_shutdown();
+    return 0;
+}
+
+// Per-enemy cost of each sensing kernel over a dense batch
+static int bench_sense(void) {
+    enum { COUNT = 8192 };
+    static int xs[COUNT], ys[COUNT], ranges[COUNT], dist[COUNT];
+    static unsigned char flags[COUNT], expected[COUNT];
+    const int reps = 2000;
+    double scalar_ns = 0;
+
+    rng_seed(&CTX(game_rng), 1);
+    for (int i = 0; i < COUNT; i++) {
+        xs[i] = random_range(0, MAP_WIDTH - 1);
+        ys[i] = random_range(0, MAP_HEIGHT - 1);
+        ranges[i] = random_range(0, 3) == 0 ? 5 : 0;
+    }
+    sense_batch_kernel(SENSE_SCALAR, xs, ys, ranges, COUNT, 50, 50, SLEEP_DISTANCE, dist, expected);
+
+    printf("%8s %12s %10s %8s\n", "kernel", "ns/enemy", "speedup", "match");
+    for (int k = 0; k < SENSE_KERNEL_COUNT; k++) {
+        if (!sense_kernel_available((SenseKernel)k)) {
+            printf("%8s %12s\n", sense_kernel_name((SenseKernel)k), "n/a");
+            continue;
+        }
+
+        long long start = bench_now_ns();
+        for (int rep = 0; rep < reps; rep++) {
+            sense_batch_kernel((SenseKernel)k, xs, ys, ranges, COUNT, 50 + rep % 3, 50,
+                               SLEEP_DISTANCE, dist, flags);
+        }
+        double ns = (double)(bench_now_ns() - start) / reps / COUNT;
+        if (k == SENSE_SCALAR) scalar_ns = ns;
+
+        sense_batch_kernel((SenseKernel)k, xs, ys, ranges, COUNT, 50, 50, SLEEP_DISTANCE, dist, flags);
+        int match = memcmp(flags, expected, sizeof(flags)) == 0;
+
+        printf("%8s %12.2f %10.2f %8s\n", sense_kernel_name((SenseKernel)k), ns,
+               scalar_ns / ns, match ? "yes" : "NO");
+    }
+    return 0;
+}
+
+// Cost of a draw from each loot table, one at a time and in bulk, and how
+// closely the drawn frequencies follow the table weights
+static int bench_loot(void) {
+    enum { COUNT = 1 << 20 };
+    static int out[COUNT];
+    static const char* table_names[MAX_LOOT_TABLES] = {
+        "items", "room", "weapons", "armor", "potions", "enemies"
+    };
+
+    rng_seed(&CTX(game_rng), 1);
+    printf("%8s %6s %12s %12s %12s\n", "table", "floor", "ns/draw", "ns/bulk", "max err %");
+    for (int t = 0; t < MAX_LOOT_TABLES; t++) {
+        for (int floor_num = 0; floor_num < DEPTH_BANDS * DEPTH_BAND_FLOORS; floor_num += DEPTH_BAND_FLOORS) {
+            long long start = bench_now_ns();
+            for (int i = 0; i < COUNT; i++) {
+                out[i] = loot_draw((LootTableId)t, floor_num);
+            }
+            double single_ns = (double)(bench_now_ns() - start) / COUNT;
+
+            start = bench_now_ns();
+            loot_draw_many((LootTableId)t, floor_num, out, COUNT);
+            double bulk_ns = (double)(bench_now_ns() - start) / COUNT;
+
+            int counts[MAX_LOOT_OUTCOMES] = {0};
+            for (int i = 0; i < COUNT; i++) {
+                counts[out[i]]++;
+            }
+            double total = loot_total_weight((LootTableId)t, floor_num);
+            double max_err = 0;
+            for (int o = 0; o < loot_num_outcomes((LootTableId)t); o++) {
+                double expected = loot_weight((LootTableId)t, floor_num, o) / total;
+                max_err = fmax(max_err, fabs((double)counts[o] / COUNT - expected) * 100.0);
+            }
+
+            printf("%8s %6d %12.2f %12.2f %12.3f\n", table_names[t], floor_num,
+                   single_ns, bulk_ns, max_err);
+        }
+    }
+    return 0;
+}
+
+// Live enemies across every floor, to check a loaded game against the saved one
+static int total_live_enemies(void) {
+    int total = 0;
+    for (int i = 0; i < MAX_FLOORS; i++) {
+        total += CTX(floors)[i].enemies.num_live;
+    }
+    return total;
+}
+
+// Time to save and load a game with every floor generated and populated
+static int bench_save(void) {
+    static const char* path = "bench_save.bin";
+    enum { RUNS = 5 };
+
+    CTX(game_seed) = 1;
+    rng_seed(&CTX(game_rng), CTX(game_seed));
+    CTX(game_turn) = 0;
+    init_player();
+    for (int i = MAX_FLOORS - 1; i >= 0; i--) {
+        init_floor(i);
+        populate_all_rooms(current_floor_ptr());
+    }
+    int enemies = total_live_enemies();
+
+    printf("%10s %10s %10s %10s\n", "floors", "enemies", "save ms", "load ms");
+    for (int run = 0; run < RUNS; run++) {
+        long long start = bench_now_ns();
+        int saved = save_game(path);
+        double save_ms = (double)(bench_now_ns() - start) / 1e6;
+
+        start = bench_now_ns();
+        int loaded = saved && load_game(path);
+        double load_ms = (double)(bench_now_ns() - start) / 1e6;
+
+        if (!loaded || total_live_enemies() != enemies) {
+            fprintf(stderr, "Save round trip failed\n");
+            remove(path);
+            return 1;
+        }
+        printf("%10d %10d %10.2f %10.2f\n", MAX_FLOORS, enemies, save_ms, load_ms);
+    }
+    remove(path);
+    return 0;
+}
+
+// Game thread pause of an autosave against a full save, with 1 to all
+// floors generated. Each run saves, loads the save back as a resumed game
+// would, then plays random turns on the deepest floor and autosaves every
+// few turns, letting the writer finish in between so only the snapshot is
+// timed. The first autosave into each slot is reported apart.
+static int bench_autosave(void) {
+    static const char* format = "bench_autosave-%d.bin";
+    static const int world_floors[] = {1, 8, MAX_FLOORS};
+    enum { TURNS = 1000, EVERY = 10 };
+
+    CTX(headless) = 1;
+    printf("%8s %10s %10s %10s %10s %10s %10s\n",
+           "floors", "full ms", "first us", "pages", "pause us", "max us", "verified");
+    for (int w = 0; w < (int)(sizeof(world_floors) / sizeof(world_floors[0])); w++) {
+        CTX(game_seed) = 1;
+        rng_seed(&CTX(game_rng), CTX(game_seed));
+        CTX(game_turn) = 0;
+        init_player();
+        for (int i = 0; i < MAX_FLOORS; i++) {
+            generate_floor(&CTX(floors)[i]);
+            CTX(floors)[i].has_visited = 0;
+        }
+        for (int i = world_floors[w] - 1; i >= 0; i--) {
+            init_floor(i);
+            populate_all_rooms(current_floor_ptr());
+        }
+        use_random_input(mix_seed(CTX(game_seed), (uint64_t)w));
+        for (int slot = 0; slot < AUTOSAVE_SLOTS; slot++) {
+            char path[64];
+            snprintf(path, sizeof(path), format, slot);
+            remove(path);
+        }
+        autosave_use_path(format);
+        autosave_init(0);
+
+        long long start = bench_now_ns();
+        int saved = save_game("bench_autosave.bin");
+        double full_ms = (double)(bench_now_ns() - start) / 1e6;
+        saved = saved && load_game("bench_autosave.bin");
+        remove("bench_autosave.bin");
+
+        // Both slots start fresh
+        long long first_ns = 0;
+        for (int slot = 0; slot < AUTOSAVE_SLOTS; slot++) {
+            autosave_flush();
+            long long before = autosave_stats()->pause_ns;
+            saved = autosave_now() && saved;
+            first_ns = max(first_ns, autosave_stats()->pause_ns - before);
+        }
+        AutosaveStats warm = *autosave_stats();
+
+        long long max_ns = 0;
+        for (int turn = 1; turn <= TURNS && CTX(player).health > 0; turn++) {
+            update_fov();
+            step_game(read_input());
+            if (turn % EVERY == 0) {
+                autosave_flush();
+                long long before = autosave_stats()->pause_ns;
+                saved = autosave_now() && saved;
+                max_ns = max(max_ns, autosave_stats()->pause_ns - before);
+            }
+        }
+        autosave_flush();
+        const AutosaveStats* stats = autosave_stats();
+        int autosaves = stats->autosaves - warm.autosaves;
+        double pages = autosaves ? (double)(stats->pages - warm.pages) / autosaves : 0;
+        double pause_us = autosaves ? (stats->pause_ns - warm.pause_ns) / 1e3 / autosaves : 0;
+        double max_us = max_ns / 1e3;
+
+        // The newest slot has to come back as the game is now
+        autosave_flush();
+        saved = autosave_now() && saved;
+        autosave_flush();
+        uint32_t checksum = game_state_checksum();
+        int enemies = total_live_enemies();
+        int verified = saved && load_autosave() && game_state_checksum() == checksum &&
+                       total_live_enemies() == enemies;
+
+        printf("%8d %10.2f %10.1f %10.1f %10.2f %10.2f %10s\n", world_floors[w], full_ms,
+               first_ns / 1e3, pages, pause_us, max_us, verified ? "yes" : "NO");
+        if (!verified) {
+            fprintf(stderr, "Autosave round trip failed\n");
+            return 1;
+        }
+    }
+    autosave_stop();
+    for (int slot = 0; slot < AUTOSAVE_SLOTS; slot++) {
+        char path[64];
+        snprintf(path, sizeof(path), format, slot);
+        remove(path);
+    }
+    return 0;
+}
+
+// Sessions stepped by the sessions bench. A session whose player dies is
+// replaced by a fresh one with the next seed for its index, so the load
+// stays the same and the outcome does not depend on the thread count.
+typedef struct {
+    GameContext** sessions;
+    int* restarts;
+    int count;
+} SessionSet;
+
+static uint64_t session_seed(const SessionSet* set, int index) {
+    return (uint64_t)index + (uint64_t)set->restarts[index] * (uint64_t)set->count + 1;
+}
+
+// Parallel body: one turn of sessions[begin..end)
+static void step_sessions(void* context, int begin, int end) {
+    SessionSet* set = context;
+    for (int i = begin; i < end; i++) {
+        if (!step_game_context(set->sessions[i])) {
+            destroy_game_context(set->sessions[i]);
+            set->restarts[i]++;
+            set->sessions[i] = create_game_context(session_seed(set, i), NULL);
+        }
+    }
+}
+
+// Parallel body: start sessions[begin..end)
+static void create_sessions(void* context, int begin, int end) {
+    SessionSet* set = context;
+    for (int i = begin; i < end; i++) {
+        set->sessions[i] = create_game_context(session_seed(set, i), NULL);
+    }
+}
+
+// Independent headless games sharing the thread pool, stepped in rounds of
+// one turn each with random commands. Reports turns per second and how
+// many sessions one core keeps at the target turn rate; the checksum of
+// every session's state must match across thread counts.
+static int bench_sessions(void) {
+    static const int thread_counts[] = {1, 2, 4, 8};
+    enum { SESSIONS = 2000, ROUNDS = 50, TARGET_TURN_RATE = 10 };
+
+    GameContext** sessions = mem_alloc(MEM_OTHER, SESSIONS * sizeof(GameContext*));
+    int* restarts = mem_alloc(MEM_OTHER, SESSIONS * sizeof(int));
+    if (!sessions || !restarts) {
+        mem_free(MEM_OTHER, sessions);
+        mem_free(MEM_OTHER, restarts);
+        return 1;
+    }
+    SessionSet set = {sessions, restarts, SESSIONS};
+
+    printf("%8s %10s %10s %12s %12s %10s %10s\n",
+           "threads", "sessions", "start ms", "turns/sec", "core us", "per core", "checksum");
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        int threads = thread_pool_init(thread_counts[t]);
+        memset(restarts, 0, SESSIONS * sizeof(int));
+
+        long long start = bench_now_ns();
+        parallel_for(SESSIONS, 8, create_sessions, &set);
+        double start_ms = (double)(bench_now_ns() - start) / 1e6;
+        for (int i = 0; i < SESSIONS; i++) {
+            if (!sessions[i]) {
+                fprintf(stderr, "Out of memory starting session %d\n", i);
+                return 1;
+            }
+        }
+
+        start = bench_now_ns();
+        for (int round = 0; round < ROUNDS; round++) {
+            parallel_for(SESSIONS, 8, step_sessions, &set);
+        }
+        double seconds = (double)(bench_now_ns() - start) / 1e9;
+        double turn_rate = SESSIONS * ROUNDS / seconds;
+        int cores = max(1, min(threads, (int)sysconf(_SC_NPROCESSORS_ONLN)));
+
+        uint32_t checksum = 2166136261u;
+        for (int i = 0; i < SESSIONS; i++) {
+            GameContext* previous = use_game_context(sessions[i]);
+            checksum = (checksum ^ game_state_checksum()) * 16777619u;
+            use_game_context(previous);
+            destroy_game_context(sessions[i]);
+            sessions[i] = NULL;
+        }
+
+        printf("%8d %10d %10.1f %12.0f %12.2f %10.0f %10x\n", threads, SESSIONS, start_ms, turn_rate,
+               1e6 / turn_rate * cores, turn_rate / cores / TARGET_TURN_RATE, checksum);
+    }
+    thread_pool_shutdown();
+    mem_free(MEM_OTHER, sessions);
+    mem_free(MEM_OTHER, restarts);
+    return 0;
+}
+
+int run_bench(int argc, char* argv[]) {
+    const char* name = argc > 0 ? argv[0] : "enemies";
+
+    if (strcmp(name, "enemies") == 0) {
+        return bench_enemies();
+    }
+    if (strcmp(name, "catchup") == 0) {
+        return bench_catchup();
+    }
+    if (strcmp(name, "threads") == 0) {
+        return bench_threads();
+    }
+    if (strcmp(name, "sense") == 0) {
+        return bench_sense();
+    }
+    if (strcmp(name, "loot") == 0) {
+        return bench_loot();
+    }
+    if (strcmp(name, "save") == 0) {
+        return bench_save();
+    }
+    if (strcmp(name, "autosave") == 0) {
+        return bench_autosave();
+    }
+    if (strcmp(name, "sessions") == 0) {
+        return bench_sessions();
+    }
+
+    fprintf(stderr, "Unknown benchmark: %s\n", name);
+    fprintf(stderr, "Available: enemies, catchup, threads, sense, loot, save, autosave, sessions\n");
+    return 1;
+}
@@ -1,88 +1,603 @@
 #include "../include/enemy.h"
 #include "../include/player.h"
 #include "../include/map.h"
+#include "../include/scheduler.h"
+#include "../include/threadpool.h"
+#include "../include/sense.h"
+#include "../include/loot.h"
+#include "../include/autosave.h"
+#include "../include/trace.h"
+#include "../include/memory.h"
+
+// Frozen view of the world that enemies plan their actions against
+typedef struct
+{
+    const EnemyPool *pool;
+    int player_x;
+    int player_y;
+} EnemyPlanView;
+
+// Stats and spawn weights of every enemy type. Each weight column is the
+// percent chance of that type in one band of DEPTH_BAND_FLOORS floors.
+const EnemyArchetype enemy_archetypes[MAX_ENEMY_TYPES] = {
+    [ENEMY_BASIC] = {"Goblin", 'g', 10, 10, 1, SPEED_NORMAL, 1, 10, {100, 70, 50, 40}},
+    [ENEMY_FAST] = {"Wolf", 'w', 8, 20, 0, SPEED_NORMAL * 2, 1, 15, {0, 30, 30, 30}},
+    [ENEMY_RANGED] = {"Archer", 'a', 6, 25, 5, SPEED_NORMAL, 5, 20, {0, 0, 20, 20}},
+    [ENEMY_BOSS] = {"Dragon", 'D', 75, 25, 50, SPEED_NORMAL, 3, 100, {0, 0, 0, 10}},
+};
+
+// Every per-slot array of an EnemyPool, in block layout order
+#define ENEMY_POOL_ARRAYS(X) \
+    X(x) X(y) X(health) X(type) X(active) \
+    X(status) X(status_until) \
+    X(energy) X(next_act) X(wheel_next) X(wheel_prev) X(ready) \
+    X(intent) X(intent_dx) X(intent_dy) \
+    X(wave_x) X(wave_y) X(wave_range) X(wave_dist) X(wave_sense) \
+    X(awake_list) X(awake_index) X(cell_next) X(cell_prev) \
+    X(generation) X(next_free) X(live) X(live_index)
+
+// Point every array of the pool into block for the given capacity, first
+// copying the leading keep slots of each array from its current location.
+// Returns the number of bytes the layout needs; pass NULL to only measure.
+static size_t layout_enemy_pool(EnemyPool *pool, char *block, int capacity, int keep)
+{
+    size_t offset = 0;
+
+#define PLACE_ARRAY(field)                                                    \
+    offset = (offset + 7) & ~(size_t)7;                                       \
+    if (block)                                                                \
+    {                                                                         \
+        if (keep > 0)                                                         \
+            memcpy(block + offset, pool->field, sizeof(*pool->field) * (size_t)keep); \
+        pool->field = (void *)(block + offset);                               \
+    }                                                                         \
+    offset += sizeof(*pool->field) * (size_t)capacity;
+
+    ENEMY_POOL_ARRAYS(PLACE_ARRAY)
+#undef PLACE_ARRAY
+
+    return offset;
+}
 
-// Helper function declarations
-static int is_enemy_at(int x, int y);
+// Head of the dormant grid cell that holds tile x, y
+static int *dormant_cell(EnemyPool *pool, int x, int y)
+{
+    return &pool->cell_head[y / WAKE_CELL_SIZE][x / WAKE_CELL_SIZE];
+}
 
+// Add a dormant enemy to the grid cell under it
+static void link_dormant(EnemyPool *pool, int slot)
+{
+    int *head = dormant_cell(pool, pool->x[slot], pool->y[slot]);
 
+    pool->cell_prev[slot] = 0;
+    pool->cell_next[slot] = *head;
+    if (*head)
+    {
+        pool->cell_prev[*head - 1] = slot + 1;
+    }
+    *head = slot + 1;
+}
 
-// Update a single enemy
-void update_enemy(Enemy *enemy)
+// Take a dormant enemy out of its grid cell
+static void unlink_dormant(EnemyPool *pool, int slot)
 {
-    if (!enemy->active)
+    if (pool->x[slot] < 0)
         return;
 
-    // Calculate distance to player
-    int dx = player.x - enemy->x;
-    int dy = player.y - enemy->y;
-    int dist = abs(dx) + abs(dy); // Manhattan distance
+    int prev = pool->cell_prev[slot];
+    int next = pool->cell_next[slot];
 
-    // If player is adjacent, attack
-    if (dist == 1)
+    if (prev)
     {
-        enemy_attack(enemy, player.x, player.y);
+        pool->cell_next[prev - 1] = next;
+    }
+    else
+    {
+        int *head = dormant_cell(pool, pool->x[slot], pool->y[slot]);
+        if (*head != slot + 1)
+            return;
+        *head = next;
+    }
+    if (next)
+    {
+        pool->cell_prev[next - 1] = prev;
+    }
+    pool->cell_prev[slot] = 0;
+    pool->cell_next[slot] = 0;
+}
+
+// Swap-remove a slot from the awake list
+static void remove_awake(EnemyPool *pool, int slot)
+{
+    int index = pool->awake_index[slot] - 1;
+    int last = pool->awake_list[--pool->num_awake];
+
+    pool->awake_list[index] = last;
+    pool->awake_index[last] = index + 1;
+    pool->awake_index[slot] = 0;
+}
+
+// Initialize an empty pool. A zero-filled pool is also a valid empty pool.
+void enemy_pool_init(EnemyPool *pool)
+{
+    memset(pool, 0, sizeof(EnemyPool));
+}
+
+// Release the pool's storage
+void enemy_pool_free(EnemyPool *pool)
+{
+    if (!pool->borrowed)
+        mem_free(MEM_ENTITIES, pool->block);
+    enemy_pool_init(pool);
+}
+
+// Size of the block a pool of the given capacity lives in
+size_t enemy_pool_block_size(int capacity)
+{
+    EnemyPool scratch;
+    return layout_enemy_pool(&scratch, NULL, capacity, 0);
+}
+
+// Point a pool whose arrays were saved as one block at that block's new
+// address. The pool does not own the block; growing it moves to the heap.
+void enemy_pool_attach(EnemyPool *pool, void *block)
+{
+    pool->block = pool->capacity > 0 ? block : NULL;
+    pool->borrowed = pool->block != NULL;
+    if (pool->block)
+        layout_enemy_pool(pool, pool->block, pool->capacity, 0);
+}
+
+// Grow the pool so that it holds at least capacity slots
+int enemy_pool_reserve(EnemyPool *pool, int capacity)
+{
+    if (capacity <= pool->capacity)
+        return 1;
+    if (capacity > (int)ENEMY_SLOT_MASK)
+        return 0;
+
+    char *block = mem_alloc(MEM_ENTITIES, layout_enemy_pool(pool, NULL, capacity, 0));
+    if (!block)
+        return 0;
+
+    void *old_block = pool->block;
+    layout_enemy_pool(pool, block, capacity, pool->capacity);
+    if (!pool->borrowed)
+        mem_free(MEM_ENTITIES, old_block);
+    pool->borrowed = 0;
+
+    // Chain the new slots onto the free list, lowest slot first
+    for (int i = capacity - 1; i >= pool->capacity; i--)
+    {
+        pool->next_free[i] = pool->free_head;
+        pool->free_head = i + 1;
+    }
+
+    pool->block = block;
+    pool->capacity = capacity;
+    return 1;
+}
+
+// Take a slot from the free list, growing the pool when it runs dry
+int enemy_pool_alloc(EnemyPool *pool)
+{
+    if (pool->free_head == 0)
+    {
+        int capacity = max(ENEMY_POOL_MIN_CAPACITY, pool->capacity * 2);
+        if (!enemy_pool_reserve(pool, min(capacity, (int)ENEMY_SLOT_MASK)) ||
+            pool->free_head == 0)
+            return -1;
+    }
+
+    int slot = pool->free_head - 1;
+    pool->free_head = pool->next_free[slot];
+    pool->next_free[slot] = 0;
+
+    pool->active[slot] = 1;
+    pool->x[slot] = -1;
+    pool->y[slot] = -1;
+    pool->status[slot] = STATUS_NONE;
+    pool->energy[slot] = 0;
+    pool->live_index[slot] = pool->num_live;
+    pool->live[pool->num_live++] = slot;
+    return slot;
+}
+
+// Return a slot to the free list; outstanding handles to it go stale
+void enemy_pool_release(EnemyPool *pool, int slot)
+{
+    if (slot < 0 || slot >= pool->capacity || !pool->active[slot])
         return;
+
+    save_mark_enemies(pool);
+    if (pool->awake_index[slot])
+    {
+        remove_awake(pool, slot);
+        unschedule_enemy(pool, slot);
+    }
+    else
+    {
+        unlink_dormant(pool, slot);
+    }
+    set_enemy_position(pool, slot, -1, -1);
+    pool->active[slot] = 0;
+    pool->generation[slot]++;
+
+    // Swap the last live slot into the hole
+    int index = pool->live_index[slot];
+    int last = pool->live[--pool->num_live];
+    pool->live[index] = last;
+    pool->live_index[last] = index;
+
+    pool->next_free[slot] = pool->free_head;
+    pool->free_head = slot + 1;
+}
+
+// Build the handle for a live slot
+EnemyHandle enemy_handle(const EnemyPool *pool, int slot)
+{
+    uint32_t generation = pool->generation[slot] % (UINT32_MAX >> ENEMY_SLOT_BITS);
+    return ((generation + 1) << ENEMY_SLOT_BITS) | (uint32_t)slot;
+}
+
+// Resolve a handle to its slot, or -1 if the enemy is gone
+int enemy_handle_slot(const EnemyPool *pool, EnemyHandle handle)
+{
+    int slot = (int)(handle & ENEMY_SLOT_MASK);
+    if (handle == ENEMY_HANDLE_NONE || slot >= pool->capacity || !pool->active[slot])
+        return -1;
+    return enemy_handle(pool, slot) == handle ? slot : -1;
+}
+
+// Get the slot of the enemy standing at x, y
+int enemy_at(const EnemyPool *pool, int x, int y)
+{
+    if (x < 0 || x >= MAP_WIDTH || y < 0 || y >= MAP_HEIGHT)
+        return -1;
+    return pool->occupant[y][x] - 1;
+}
+
+// Move an enemy and keep the occupancy grid in sync
+void set_enemy_position(EnemyPool *pool, int slot, int x, int y)
+{
+    int old_x = pool->x[slot];
+    int old_y = pool->y[slot];
+    if (old_x >= 0 && old_x < MAP_WIDTH && old_y >= 0 && old_y < MAP_HEIGHT &&
+        pool->occupant[old_y][old_x] == slot + 1)
+    {
+        pool->occupant[old_y][old_x] = 0;
+        save_mark_dirty(&pool->occupant[old_y][old_x], sizeof(int));
     }
 
-    // If player is in range and enemy is ranged, attack
-    if (enemy->type == ENEMY_RANGED && dist <= enemy->range)
+    pool->x[slot] = x;
+    pool->y[slot] = y;
+    if (x >= 0 && x < MAP_WIDTH && y >= 0 && y < MAP_HEIGHT)
     {
-        enemy_attack(enemy, player.x, player.y);
+        pool->occupant[y][x] = slot + 1;
+        save_mark_dirty(&pool->occupant[y][x], sizeof(int));
+    }
+}
+
+// Get the static stats of an enemy
+const EnemyArchetype *enemy_archetype(const EnemyPool *pool, int slot)
+{
+    return &enemy_archetypes[pool->type[slot]];
+}
+
+// Get an enemy's speed after status effects
+int enemy_speed(int slot)
+{
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+
+    if (pool->status[slot] != STATUS_NONE && CTX(game_turn) >= pool->status_until[slot])
+    {
+        pool->status[slot] = STATUS_NONE;
+    }
+
+    if (pool->status[slot] == STATUS_FREEZE)
+    {
+        return enemy_archetype(pool, slot)->speed / 2;
+    }
+    return enemy_archetype(pool, slot)->speed;
+}
+
+// Apply a status effect to an enemy
+void apply_enemy_status(int slot, StatusType type, int duration)
+{
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+    save_mark_enemies(pool);
+    pool->status[slot] = type;
+    pool->status_until[slot] = CTX(game_turn) + duration;
+}
+
+// Freeze the awake enemies within radius of x, y, halving their speed;
+// returns how many were caught
+int freeze_enemies_near(int x, int y, int radius, int duration)
+{
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+    int frozen = 0;
+
+    for (int i = 0; i < pool->num_awake; i++)
+    {
+        int slot = pool->awake_list[i];
+        int dx = pool->x[slot] - x;
+        int dy = pool->y[slot] - y;
+        if (dx * dx + dy * dy > radius * radius)
+            continue;
+
+        apply_enemy_status(slot, STATUS_FREEZE, duration);
+        frozen++;
+    }
+    return frozen;
+}
+
+// Wake a dormant enemy: it joins the awake list and acts once it has
+// built up a full action's energy
+void wake_enemy(int slot)
+{
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+    if (!pool->active[slot] || pool->awake_index[slot])
         return;
+
+    save_mark_enemies(pool);
+    unlink_dormant(pool, slot);
+    pool->awake_list[pool->num_awake++] = slot;
+    pool->awake_index[slot] = pool->num_awake;
+
+    long long now = (long long)CTX(game_turn) * TICKS_PER_TURN;
+    pool->energy[slot] = 0;
+    schedule_enemy(pool, slot, now + enemy_action_delay(pool, slot, enemy_speed(slot)));
+}
+
+// Put an awake enemy back to sleep where it stands
+void sleep_enemy(int slot)
+{
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+    if (!pool->active[slot] || !pool->awake_index[slot])
+        return;
+
+    save_mark_enemies(pool);
+    remove_awake(pool, slot);
+    unschedule_enemy(pool, slot);
+    link_dormant(pool, slot);
+}
+
+// Wake the dormant enemies inside a rectangle of tiles, optionally only
+// those within radius of cx, cy. Only the grid cells the rectangle
+// overlaps are visited.
+static void wake_enemies_in_area(int x0, int y0, int x1, int y1, int cx, int cy, int radius)
+{
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+
+    x0 = max(x0, 0);
+    y0 = max(y0, 0);
+    x1 = min(x1, MAP_WIDTH - 1);
+    y1 = min(y1, MAP_HEIGHT - 1);
+
+    for (int cell_y = y0 / WAKE_CELL_SIZE; cell_y <= y1 / WAKE_CELL_SIZE; cell_y++)
+    {
+        for (int cell_x = x0 / WAKE_CELL_SIZE; cell_x <= x1 / WAKE_CELL_SIZE; cell_x++)
+        {
+            int entry = pool->cell_head[cell_y][cell_x];
+            while (entry)
+            {
+                int slot = entry - 1;
+                int x = pool->x[slot];
+                int y = pool->y[slot];
+                entry = pool->cell_next[slot];
+
+                if (x < x0 || x > x1 || y < y0 || y > y1)
+                    continue;
+                if (radius >= 0 && (x - cx) * (x - cx) + (y - cy) * (y - cy) > radius * radius)
+                    continue;
+
+                wake_enemy(slot);
+            }
+        }
     }
+}
 
-    // Move towards player
-    int move_dx = 0;
-    int move_dy = 0;
+// Wake every dormant enemy that can hear a noise at x, y
+void make_noise(int x, int y, int radius)
+{
+    wake_enemies_in_area(x - radius, y - radius, x + radius, y + radius, x, y, radius);
+}
 
-    if (dx > 0)
+// Wake the enemies in the player's room and those within WAKE_RADIUS
+void wake_enemies_near_player(void)
+{
+    Floor *floor = current_floor_ptr();
+    int room = floor->room_id[CTX(player).y][CTX(player).x];
+
+    if (room)
     {
-        move_dx = 1;
+        Room *r = &floor->rooms[room - 1];
+        wake_enemies_in_area(r->x, r->y, r->x + r->width - 1, r->y + r->height - 1, 0, 0, -1);
     }
-    else if (dx < 0)
+    wake_enemies_in_area(CTX(player).x - WAKE_RADIUS, CTX(player).y - WAKE_RADIUS,
+                         CTX(player).x + WAKE_RADIUS, CTX(player).y + WAKE_RADIUS,
+                         CTX(player).x, CTX(player).y, WAKE_RADIUS);
+}
+
+// Decide what an enemy does with its action from the SENSE_* flags the
+// sensing pass worked out for it. Reads only the view and the enemy's own
+// fields, so any number of enemies can plan at once.
+static EnemyIntent plan_enemy(const EnemyPlanView *view, int slot, int sense, int *move_dx, int *move_dy)
+{
+    const EnemyPool *pool = view->pool;
+
+    *move_dx = 0;
+    *move_dy = 0;
+
+    // Lose interest once the player is far away
+    if (sense & SENSE_TOO_FAR)
+        return INTENT_SLEEP;
+
+    // Attack when adjacent, or from a distance if the enemy has range
+    if (sense & (SENSE_ADJACENT | SENSE_IN_RANGE))
+        return INTENT_ATTACK;
+
+    // Move towards player
+    int dx = view->player_x - pool->x[slot];
+    int dy = view->player_y - pool->y[slot];
+    *move_dx = (dx > 0) - (dx < 0);
+    *move_dy = (dy > 0) - (dy < 0);
+    return INTENT_MOVE;
+}
+
+// Ranged attack reach of an enemy for the sensing pass; 0 for melee only
+static int sense_range(const EnemyPool *pool, int slot)
+{
+    return pool->type[slot] == ENEMY_RANGED ? enemy_archetype(pool, slot)->range : 0;
+}
+
+// Parallel body: sense and plan the actions of pool->ready[begin..end)
+static void plan_ready_enemies(void *context, int begin, int end)
+{
+    const EnemyPlanView *view = context;
+    EnemyPool *pool = (EnemyPool *)view->pool;
+
+    TRACE_START(plan_start);
+
+    // Gather the positions into dense arrays and sense them in one pass
+    for (int i = begin; i < end; i++)
     {
-        move_dx = -1;
+        int slot = pool->ready[i];
+        pool->wave_x[i] = pool->x[slot];
+        pool->wave_y[i] = pool->y[slot];
+        pool->wave_range[i] = sense_range(pool, slot);
     }
+    sense_batch(pool->wave_x + begin, pool->wave_y + begin, pool->wave_range + begin,
+                end - begin, view->player_x, view->player_y, SLEEP_DISTANCE,
+                pool->wave_dist + begin, pool->wave_sense + begin);
 
-    if (dy > 0)
+    for (int i = begin; i < end; i++)
     {
-        move_dy = 1;
+        int dx;
+        int dy;
+        pool->intent[i] = (unsigned char)plan_enemy(view, pool->ready[i], pool->wave_sense[i], &dx, &dy);
+        pool->intent_dx[i] = (signed char)dx;
+        pool->intent_dy[i] = (signed char)dy;
     }
-    else if (dy < 0)
+    TRACE_STOP("plan enemies", plan_start, "enemies", end - begin);
+}
+
+// Plan the actions of pool->ready[0..count) in parallel
+void plan_enemies(EnemyPool *pool, int count, int player_x, int player_y)
+{
+    EnemyPlanView view = {pool, player_x, player_y};
+    parallel_for(count, ENEMY_PLAN_GRAIN, plan_ready_enemies, &view);
+}
+
+// Carry out a planned action against the live state of the floor
+static void apply_enemy_intent(int slot, EnemyIntent intent, int dx, int dy)
+{
+    switch (intent)
     {
-        move_dy = -1;
+    case INTENT_SLEEP:
+        sleep_enemy(slot);
+        break;
+    case INTENT_ATTACK:
+        enemy_attack(slot, CTX(player).x, CTX(player).y);
+        break;
+    case INTENT_MOVE:
+        move_enemy(slot, dx, dy);
+        break;
+    case INTENT_NONE:
+        break;
     }
+}
+
+// Let every awake enemy on the current floor that has built up enough
+// energy act, tick by tick, until the end of this turn. Dormant enemies
+// are not scheduled at all.
+//
+// Each tick runs in two phases. First every due enemy plans its action
+// against a frozen view of the floor, spread over the thread pool. Then a
+// serial pass in schedule order carries the plans out, so an enemy whose
+// target tile was taken earlier in the pass simply stays put. Results do
+// not depend on the number of threads.
+void update_enemies(void)
+{
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+    long long turn_end = (long long)(CTX(game_turn) + 1) * TICKS_PER_TURN;
+    save_mark_enemies(pool);
 
-    // Try to move
-    move_enemy(enemy, move_dx, move_dy);
+    // After time away from the floor one sweep of the wheel finds every
+    // overdue enemy; they resume now rather than replaying the missed turns
+    long long tick = max(pool->wheel_tick, turn_end - SCHEDULE_WHEEL_SIZE + 1);
 
-    // Fast enemies get a second move
-    if (enemy->type == ENEMY_FAST)
+    for (; tick <= turn_end; tick++)
     {
-        move_enemy(enemy, move_dx, move_dy);
+        int count = collect_due_enemies(pool, tick);
+        if (count == 0)
+            continue;
+
+        plan_enemies(pool, count, CTX(player).x, CTX(player).y);
+
+        for (int i = 0; i < count; i++)
+        {
+            int slot = pool->ready[i];
+            if (!pool->active[slot])
+                continue;
+
+            TRACE_START(enemy_start);
+            apply_enemy_intent(slot, (EnemyIntent)pool->intent[i],
+                               pool->intent_dx[i], pool->intent_dy[i]);
+
+            if (pool->active[slot] && pool->awake_index[slot])
+            {
+                schedule_enemy(pool, slot, tick + enemy_action_delay(pool, slot, enemy_speed(slot)));
+            }
+            TRACE_STOP("enemy", enemy_start, "slot", slot);
+        }
     }
+    pool->wheel_tick = turn_end + 1;
+}
+
+// Update a single enemy
+void update_enemy(int slot)
+{
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+    if (!pool->active[slot])
+        return;
+
+    EnemyPlanView view = {pool, CTX(player).x, CTX(player).y};
+    int range = sense_range(pool, slot);
+    int dist;
+    unsigned char sense;
+    sense_batch(&pool->x[slot], &pool->y[slot], &range, 1, CTX(player).x, CTX(player).y,
+                SLEEP_DISTANCE, &dist, &sense);
+
+    int dx;
+    int dy;
+    EnemyIntent intent = plan_enemy(&view, slot, sense, &dx, &dy);
+    apply_enemy_intent(slot, intent, dx, dy);
 }
 
 // Move enemy by dx, dy
-void move_enemy(Enemy *enemy, int dx, int dy)
+void move_enemy(int slot, int dx, int dy)
 {
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+    int x = pool->x[slot];
+    int y = pool->y[slot];
     int new_x;
     int new_y;
 
-    if(enemy->x + dx == player.x){
-        new_x = enemy->x;
+    if(x + dx == CTX(player).x){
+        new_x = x;
     }else{
-        new_x = enemy->x + dx;
+        new_x = x + dx;
     }
     
-    if(enemy->y + dy == player.y)
+    if(y + dy == CTX(player).y)
     {
-        new_y = enemy->y;
+        new_y = y;
     }
     else
     {
-        new_y = enemy->y + dy;
+        new_y = y + dy;
     }
 
     Floor *floor = current_floor_ptr();
@@ -91,203 +606,224 @@ void move_enemy(Enemy *enemy, int dx, int dy)
     if (new_x >= 0 && new_x < MAP_WIDTH &&
         new_y >= 0 && new_y < MAP_HEIGHT &&
         floor->map[new_y][new_x] == '.' &&
-        !is_enemy_at(new_x, new_y))
+        enemy_at(pool, new_x, new_y) < 0)
     {
-        enemy->x = new_x;
-        enemy->y = new_y;
+        set_enemy_position(pool, slot, new_x, new_y);
     }
 }
 
 // Enemy attacks target location
-void enemy_attack(Enemy *enemy, int target_x, int target_y)
+void enemy_attack(int slot, int target_x, int target_y)
 {
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+
     // Only attack if target is player
-    if (target_x == player.x && target_y == player.y)
+    if (target_x == CTX(player).x && target_y == CTX(player).y)
     {
         // Calculate damage with defense reduction
-        int damage = max(0, enemy->power - player.defense);
+        int damage = max(0, enemy_archetype(pool, slot)->power - CTX(player).stats.defense);
 
         // Apply damage to player
-        player.health -= damage;
+        CTX(player).health -= damage;
+        make_noise(CTX(player).x, CTX(player).y, NOISE_RADIUS);
 
         if (damage > 0)
         {
-            add_message("%s hits you for %d damage!", enemy->name, damage);
+            add_message("%s hits you for %d damage!", enemy_archetype(pool, slot)->name, damage);
 
             // Check if player died
-            if (player.health <= 0)
+            if (CTX(player).health <= 0)
             {
                 add_message("You have died!");
             }
         }
         else
         {
-            add_message("%s attacks but does no damage!", enemy->name);
+            add_message("%s attacks but does no damage!", enemy_archetype(pool, slot)->name);
         }
     }
 }
 
 // Spawn a new enemy
-void spawn_enemy(int x, int y, EnemyType type)
+EnemyHandle spawn_enemy(int x, int y, EnemyType type)
 {
-    Floor *floor = current_floor_ptr();
+    EnemyPool *pool = &current_floor_ptr()->enemies;
 
-    // Find empty enemy slot
-    for (int i = 0; i < MAX_ENEMIES; i++)
+    // Only one enemy per tile
+    if (x < 0 || x >= MAP_WIDTH || y < 0 || y >= MAP_HEIGHT ||
+        enemy_at(pool, x, y) >= 0)
     {
-        if (!floor->enemies[i].active)
-        {
-            Enemy *enemy = &floor->enemies[i];
-            enemy->active = 1;
-            enemy->x = x;
-            enemy->y = y;
-            enemy->type = type;
-
-            // Set enemy stats based on type
-            switch (type)
-            {
-            case ENEMY_BASIC:
-                strcpy(enemy->name, "Goblin");
-                enemy->symbol = 'g';
-                enemy->health = enemy->max_health = 10;
-                enemy->power = 10;
-                enemy->defense = 1;
-                enemy->speed = 1;
-                enemy->range = 1;
-                enemy->exp_value = 10;
-                break;
-
-            case ENEMY_FAST:
-                strcpy(enemy->name, "Wolf");
-                enemy->symbol = 'w';
-                enemy->health = enemy->max_health = 8;
-                enemy->power = 20;
-                enemy->defense = 0;
-                enemy->speed = 2;
-                enemy->range = 1;
-                enemy->exp_value = 15;
-                break;
-
-            case ENEMY_RANGED:
-                strcpy(enemy->name, "Archer");
-                enemy->symbol = 'a';
-                enemy->health = enemy->max_health = 6;
-                enemy->power = 25;
-                enemy->defense = 5;
-                enemy->speed = 1;
-                enemy->range = 5;
-                enemy->exp_value = 20;
-                break;
-
-            case ENEMY_BOSS:
-                strcpy(enemy->name, "Dragon");
-                enemy->symbol = 'D';
-                enemy->health = enemy->max_health = 75;
-                enemy->power = 25;
-                enemy->defense = 50;
-                enemy->speed = 1;
-                enemy->range = 3;
-                enemy->exp_value = 100;
-                break;
-            }
-            break;
-        }
+        return ENEMY_HANDLE_NONE;
+    }
+
+    int slot = enemy_pool_alloc(pool);
+    if (slot < 0)
+    {
+        return ENEMY_HANDLE_NONE;
     }
+    save_mark_enemies(pool);
+
+    // Only per-instance state is stored; stats come from the archetype
+    set_enemy_position(pool, slot, x, y);
+    pool->type[slot] = type;
+    pool->health[slot] = enemy_archetypes[type].max_health;
+    pool->status[slot] = STATUS_NONE;
+
+    // Enemies start dormant until the player comes near
+    link_dormant(pool, slot);
+
+    return enemy_handle(pool, slot);
 }
 
 // Kill an enemy
-void kill_enemy(Enemy *enemy)
+void kill_enemy(int slot)
 {
-    if (!enemy->active)
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+    if (!pool->active[slot])
         return;
 
-    add_message("The %s dies!", enemy->name);
-    player.exp += enemy->exp_value;
-    enemy->active = 0;
+    add_message("The %s dies!", enemy_archetype(pool, slot)->name);
+    CTX(player).exp += enemy_archetype(pool, slot)->exp_value;
+    CTX(kill_count)++;
+    enemy_pool_release(pool, slot);
 
     // Check for level up
-    if (player.exp >= player.exp_next)
+    if (CTX(player).exp >= CTX(player).exp_next)
     {
         level_up();
     }
 }
 
-// Helper function to check if an enemy is at a location
-static int is_enemy_at(int x, int y)
+// Randomly choose an enemy type for a floor level
+EnemyType choose_enemy_type(int floor_num)
 {
-    Floor *floor = current_floor_ptr();
-    for (int i = 0; i < MAX_ENEMIES; i++)
+    return (EnemyType)loot_draw(LOOT_ENEMIES, floor_num);
+}
+
+// First tile of a room's floor from (x, y) on, in reading order and
+// wrapping around, that no enemy stands on; 0 when every tile is taken
+static int free_room_tile(const EnemyPool *pool, const Room *room, int *x, int *y)
+{
+    int width = room->width - 2;
+    int height = room->height - 2;
+    int start = (*y - room->y - 1) * width + (*x - room->x - 1);
+    for (int i = 0; i < width * height; i++)
     {
-        Enemy *enemy = &floor->enemies[i];
-        if (enemy->active && enemy->x == x && enemy->y == y)
+        int tile = (start + i) % (width * height);
+        int tx = room->x + 1 + tile % width;
+        int ty = room->y + 1 + tile / width;
+        if (enemy_at(pool, tx, ty) < 0)
         {
+            *x = tx;
+            *y = ty;
             return 1;
         }
     }
     return 0;
 }
 
-// Spawn enemies for the current floor
-void spawn_floor_enemies()
+// Spawn a room's enemies on the current floor; returns how many were placed.
+// An enemy whose tile is taken, by another of the room's or by one that
+// wandered in before the room was seen, moves on to the next free tile, so
+// how many a room gets never depends on when it is revealed.
+int spawn_room_enemies(const Room *room)
+{
+    int spawned = 0;
+
+    // 70% chance to spawn enemies in each room
+    if (random_range(0, 99) < 70)
+    {
+        // Spawn 1-3 enemies per room
+        int num_enemies = random_range(1, 3);
+        for (int j = 0; j < num_enemies; j++)
+        {
+            // Find a random position in the room
+            int x = room->x + 1 + random_range(0, room->width - 2 - 1);
+            int y = room->y + 1 + random_range(0, room->height - 2 - 1);
+
+            // Randomly choose enemy type based on floor level
+            EnemyType type = choose_enemy_type(CTX(current_floor));
+
+            if (free_room_tile(&current_floor_ptr()->enemies, room, &x, &y) &&
+                spawn_enemy(x, y, type) != ENEMY_HANDLE_NONE)
+                spawned++;
+        }
+    }
+    return spawned;
+}
+
+// Put every awake enemy on the current floor to sleep
+void sleep_all_enemies(void)
+{
+    EnemyPool *pool = &current_floor_ptr()->enemies;
+    while (pool->num_awake > 0)
+    {
+        sleep_enemy(pool->awake_list[0]);
+    }
+}
+
+// Advance the enemies of the current floor by elapsed turns in one step.
+// Health regenerates in closed form and each enemy in a room is moved to a
+// random spot within the distance a random walk would have covered.
+void catch_up_enemies(int elapsed)
 {
     Floor *floor = current_floor_ptr();
+    EnemyPool *pool = &floor->enemies;
+    if (elapsed <= 0)
+        return;
+
+    save_mark_enemies(pool);
+    int radius = min((int)sqrt((double)elapsed), WANDER_RADIUS);
 
-    // Spawn enemies in random rooms
-    for (int i = 0; i < floor->num_rooms; i++)
+    for (int i = 0; i < pool->num_live; i++)
     {
-        Room *room = &floor->rooms[i];
-        // Skip the first room on floor 0 (player's starting room)
-        if (current_floor == 0 && i == 0)
+        int slot = pool->live[i];
+        int x = pool->x[slot];
+        int y = pool->y[slot];
+
+        int regen = elapsed / ENEMY_REGEN_TURNS;
+        pool->health[slot] = min(enemy_archetype(pool, slot)->max_health, pool->health[slot] + regen);
+
+        int room = floor->room_id[y][x];
+        if (!room || radius == 0 || pool->awake_index[slot])
             continue;
 
-        // 70% chance to spawn enemies in each room
-        if (rand() % 100 < 70)
-        {
-            // Spawn 1-3 enemies per room
-            int num_enemies = random_range(1, 3);
-            for (int j = 0; j < num_enemies; j++)
-            {
-                // Find a random position in the room
-                int x = room->x + 1 + rand() % (room->width - 2);
-                int y = room->y + 1 + rand() % (room->height - 2);
-
-                // Randomly choose enemy type based on floor level
-                EnemyType type;
-                int r = rand() % 100;
-                if (current_floor < 3)
-                {
-                    type = ENEMY_BASIC;
-                }
-                else if (current_floor < 6)
-                {
-                    if (r < 70)
-                        type = ENEMY_BASIC;
-                    else
-                        type = ENEMY_FAST;
-                }
-                else if (current_floor < 9)
-                {
-                    if (r < 50)
-                        type = ENEMY_BASIC;
-                    else if (r < 80)
-                        type = ENEMY_FAST;
-                    else
-                        type = ENEMY_RANGED;
-                }
-                else
-                {
-                    if (r < 40)
-                        type = ENEMY_BASIC;
-                    else if (r < 70)
-                        type = ENEMY_FAST;
-                    else if (r < 90)
-                        type = ENEMY_RANGED;
-                    else
-                        type = ENEMY_BOSS;
-                }
-
-                spawn_enemy(x, y, type);
-            }
-        }
+        int new_x = x + random_range(-radius, radius);
+        int new_y = y + random_range(-radius, radius);
+        if (new_x < 0 || new_x >= MAP_WIDTH || new_y < 0 || new_y >= MAP_HEIGHT ||
+            floor->map[new_y][new_x] != '.' ||
+            floor->room_id[new_y][new_x] != room ||
+            enemy_at(pool, new_x, new_y) >= 0)
+            continue;
+
+        unlink_dormant(pool, slot);
+        set_enemy_position(pool, slot, new_x, new_y);
+        link_dormant(pool, slot);
     }
-}
\ No newline at end of file
+}
+
+// Bring back up to count enemies on the current floor while it is below
+// the population its seen rooms were generated with
+void respawn_enemies(int count)
+{
+    Floor *floor = current_floor_ptr();
+    EnemyPool *pool = &floor->enemies;
+
+    int respawns = min(count, floor->target_population - pool->num_live);
+    if (floor->num_rooms == 0)
+        return;
+    int player_room = floor->room_id[CTX(player).y][CTX(player).x];
+
+    for (int i = 0; i < respawns; i++)
+    {
+        int room = random_range(0, floor->num_rooms - 1);
+        if ((CTX(current_floor) == 0 && room == 0) || room + 1 == player_room ||
+            !floor->rooms[room].populated)
+            continue;
+
+        Room *r = &floor->rooms[room];
+        int x = r->x + 1 + random_range(0, r->width - 2 - 1);
+        int y = r->y + 1 + random_range(0, r->height - 2 - 1);
+        spawn_enemy(x, y, choose_enemy_type(CTX(current_floor)));
+    }
+}
@@ -3,30 +3,42 @@
 #include "../include/player.h"
 #include "../include/enemy.h"
 #include "../include/ui.h"
+#include "../include/input.h"
+#include "../include/profile.h"
+#include "../include/replay.h"
+#include "../include/save.h"
+#include "../include/autosave.h"
+#include "../include/trace.h"
 #include <stdlib.h>
 #include <ncurses.h>
+#include <poll.h>
+#include <unistd.h>
 
 // Initialize game state
 void init_game(long seed)
 {
     // Initialize random number generator
-    srand(seed);
+    CTX(game_seed) = (uint64_t)seed;
+    rng_seed(&CTX(game_rng), CTX(game_seed));
 
     // Initialize UI
-    init_ui();
+    if (!CTX(headless))
+    {
+        init_ui();
+    }
 
     // Initialize game state
-    current_floor = 0;
-    game_turn = 0;
+    CTX(current_floor) = 0;
+    CTX(game_turn) = 0;
 
     // Initialize message log
-    message_log.num_messages = 0;
+    CTX(message_log).num_messages = 0;
 
     // Initialize player
     init_player();
 
     // Initialize first floor
-    init_floor(current_floor);
+    init_floor(CTX(current_floor));
 
     // Add welcome message
     add_message("Welcome to the dungeon!");
@@ -35,7 +47,13 @@ void init_game(long seed)
 // Clean up game resources
 void cleanup_game()
 {
-    cleanup_ui();
+    stop_recording();
+    autosave_stop();
+    trace_stop();
+    if (!CTX(headless))
+    {
+        cleanup_ui();
+    }
 }
 
 // Main game loop
@@ -46,22 +64,25 @@ void game_loop()
     while (1)
     {
         // Update field of view
+        PROFILE_START(start);
         update_fov();
+        PROFILE_STOP(PROFILE_FOV, start);
 
         // Render game state
         render_game();
 
         // Get player input
-        input = getch();
+        input = read_input();
 
-        // Handle input
-        handle_input(input);
-
-        // Update game state
-        update_game();
+        // Handle input and update game state
+        if (step_game(input))
+        {
+            record_turn();
+        }
+        PROFILE_FRAME_END();
 
         // Check if player is dead
-        if (player.health <= 0)
+        if (CTX(player).health <= 0)
         {
             show_death_screen();
             break;
@@ -69,8 +90,84 @@ void game_loop()
     }
 }
 
-// Handle player input
-void handle_input(int input)
+// Real-time loop: the world advances tick_hz times a second whether or not
+// a key is pressed, and each part keeps its own cadence. Input is queued
+// as soon as poll sees it, every tick plays the oldest queued key or a
+// wait, and the screen is redrawn after ticks at most frame_hz times a
+// second. A frame that is slow to reach the terminal delays only the
+// frames; the ticks it held up run straight after it.
+void realtime_game_loop(int tick_hz, int frame_hz)
+{
+    long long tick_ns = 1000000000LL / tick_hz;
+    long long frame_ns = 1000000000LL / frame_hz;
+    long long next_tick = profile_now_ns() + tick_ns;
+    long long next_frame = 0;
+    int dirty = 1;
+
+    PROFILE_START(fov_start);
+    update_fov();
+    PROFILE_STOP(PROFILE_FOV, fov_start);
+
+    while (1)
+    {
+        long long now = profile_now_ns();
+        if (dirty && now >= next_frame)
+        {
+            render_game();
+            dirty = 0;
+            next_frame = now + frame_ns;
+        }
+
+        // Sleep until the next tick, or the next frame if one is owed,
+        // waking for input
+        long long wake = dirty ? min(next_tick, next_frame) : next_tick;
+        now = profile_now_ns();
+        if (wake > now)
+        {
+            struct pollfd terminal = {.fd = STDIN_FILENO, .events = POLLIN};
+            poll(&terminal, 1, (int)((wake - now + 999999) / 1000000));
+        }
+        poll_terminal_input();
+
+        // Play the ticks that are due, catching up at most a second at once
+        // so that a long stall is let go rather than fast-forwarded
+        int ticks = 0;
+        while (ticks < tick_hz && profile_now_ns() >= next_tick)
+        {
+            long long step_start = profile_now_ns();
+            if (step_game(read_tick_input()))
+            {
+                record_turn();
+            }
+            PROFILE_FRAME_END();
+            ticks++;
+            dirty = 1;
+
+            if (CTX(player).health <= 0)
+            {
+                show_death_screen();
+                return;
+            }
+
+            PROFILE_START(start);
+            update_fov();
+            PROFILE_STOP(PROFILE_FOV, start);
+
+            // A step that outlasts a tick waited on a menu, which stops
+            // the clock; a turn alone takes microseconds
+            now = profile_now_ns();
+            next_tick = now - step_start > tick_ns ? now + tick_ns : next_tick + tick_ns;
+        }
+        if (ticks == tick_hz)
+        {
+            next_tick = profile_now_ns() + tick_ns;
+        }
+    }
+}
+
+// Handle player input. Saving and loading take no turn, so that a loaded
+// game is the saved one; without a terminal they leave the save file alone.
+int handle_input(int input)
 {
     int dx = 0, dy = 0;
 
@@ -109,6 +206,31 @@ void handle_input(int input)
         break; // Open inventory
     case '.':
         break; // Wait one turn
+    case 'S':
+        if (CTX(headless))
+            return 0;
+        if (save_game(DEFAULT_SAVE_PATH))
+            add_message("Game saved to %s.", DEFAULT_SAVE_PATH);
+        else
+            add_message("Could not save to %s!", DEFAULT_SAVE_PATH);
+        return 0; // Save the game
+    case 'L':
+        if (CTX(headless))
+            return 0;
+        if (load_game(DEFAULT_SAVE_PATH))
+        {
+            add_message("Game loaded from %s.", DEFAULT_SAVE_PATH);
+            // The log cannot replay what the save brought in, so it ends
+            // with the load
+            if (recording())
+            {
+                stop_recording();
+                add_message("Recording stopped at the load.");
+            }
+        }
+        else
+            add_message("Could not load %s!", DEFAULT_SAVE_PATH);
+        return 0; // Load the last save
     case 'Q':
         cleanup_game();
         exit(0);
@@ -119,69 +241,95 @@ void handle_input(int input)
     {
         move_player(dx, dy);
     }
+    return 1;
 }
 
-// Update game state
-void update_game()
+// Play one turn: the player's command, then everything else
+int step_game(int input)
 {
-    // Update enemies
-    for (int i = 0; i < MAX_ENEMIES; i++)
+    PROFILE_START(start);
+    int turn = handle_input(input);
+    PROFILE_STOP(PROFILE_PLAYER, start);
+    if (!turn)
     {
-        Enemy *enemy = &current_floor_ptr()->enemies[i];
-        if (enemy->active)
-        {
-            update_enemy(enemy);
-        }
+        return 0;
     }
 
-    // Update status effects
-    for (int i = 0; i < MAX_STATUS_EFFECTS; i++)
-    {
-        if (player.status[i].type != STATUS_NONE)
-        {
-            if (--player.status[i].duration <= 0)
-            {
-                player.status[i].type = STATUS_NONE;
-            }
-        }
-    }
+    update_game();
+    end_input_turn();
+    return 1;
+}
 
-    // Update ability cooldowns
-    for (int i = 0; i < player.num_abilities; i++)
-    {
-        if (player.abilities[i].current_cooldown > 0)
-        {
-            player.abilities[i].current_cooldown--;
-        }
-    }
+// Update game state
+void update_game()
+{
+    // Wake enemies the player has come near, then update the awake ones
+    PROFILE_START(ai_start);
+    wake_enemies_near_player();
+    update_enemies();
+    PROFILE_STOP(PROFILE_AI, ai_start);
 
     // Regenerate mana
-    if (player.mana < player.max_mana)
+    PROFILE_START(regen_start);
+    if (CTX(player).mana < CTX(player).max_mana)
     {
-        player.mana += player.mana_regen;
-        if (player.mana > player.max_mana)
+        CTX(player).mana += CTX(player).mana_regen;
+        if (CTX(player).mana > CTX(player).max_mana)
         {
-            player.mana = player.max_mana;
+            CTX(player).mana = CTX(player).max_mana;
         }
     }
+    PROFILE_STOP(PROFILE_REGEN, regen_start);
+
+    CTX(game_turn)++;
 
-    game_turn++;
+    // Fire the timers due on the new turn
+    PROFILE_START(statuses_start);
+    update_player_timers();
+    update_floor_timers(current_floor_ptr(), CTX(game_turn));
+    PROFILE_STOP(PROFILE_STATUSES, statuses_start);
+
+    // Hand the pages changed since the last autosave to the writer
+    PROFILE_START(bookkeeping_start);
+    autosave_tick();
+    PROFILE_STOP(PROFILE_BOOKKEEPING, bookkeeping_start);
 }
 
 // Render game state
 void render_game()
 {
+    if (CTX(headless))
+    {
+        return;
+    }
     // First render the map
+    PROFILE_START(map_start);
     render_map();
+    PROFILE_STOP(PROFILE_RENDER_MAP, map_start);
     // Render UI elements
+    PROFILE_START(messages_start);
     render_messages();
+    PROFILE_STOP(PROFILE_RENDER_MESSAGES, messages_start);
+    PROFILE_START(status_start);
     render_status();
+    PROFILE_STOP(PROFILE_RENDER_STATUS, status_start);
+    PROFILE_START(refresh_start);
     refresh_screen();
+    PROFILE_STOP(PROFILE_REFRESH, refresh_start);
+    // Overlays go on top, outside the phases they report
+#ifdef PROFILE
+    render_profile_hud();
+#endif
+    render_memory_hud();
 }
 
 // Show death screen and handle retry option
 void show_death_screen()
 {
+    if (CTX(headless))
+    {
+        return;
+    }
     clear();
     int width;
     int height;
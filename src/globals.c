@@ -1,20 +1,92 @@
 #include "../include/globals.h"
 #include "../include/common.h"
+#include "../include/game.h"
+#include "../include/map.h"
+#include "../include/enemy.h"
+#include "../include/input.h"
+#include "../include/profile.h"
+#include "../include/memory.h"
+#include <sys/mman.h>
 
-// Game state
-Floor floors[MAX_FLOORS];
-int current_floor = 0;
-int game_turn = 0;
+// The main game's floors live in static storage until a save is loaded
+static Floor floor_storage[MAX_FLOORS];
 
-// Message log
-char messages[MAX_MESSAGES][MESSAGE_LENGTH];
-MessageLog message_log = {0};
+static GameContext main_context = {
+    .floors = floor_storage,
+    .game_rng = {0x9e3779b97f4a7c15ULL},
+    .current_rng = &main_context.game_rng,
+    .input = {.type = INPUT_TERMINAL},
+};
 
-// Player stats
-int kill_count = 0;
-int gold_collected = 0;
+// Every thread starts out on the main game
+_Thread_local GameContext* game_ctx = &main_context;
 
-// Global variables
-int camera_x = 0;
-int camera_y = 0;
-Player player; 
\ No newline at end of file
+GameContext* main_game_context() {
+    return &main_context;
+}
+
+GameContext* use_game_context(GameContext* ctx) {
+    GameContext* previous = game_ctx;
+    game_ctx = ctx;
+    return previous;
+}
+
+// A headless game on its own floors, fed from a script or, without one,
+// from random commands seeded from the game seed
+GameContext* create_game_context(uint64_t seed, const char* script) {
+    GameContext* ctx = mem_alloc(MEM_OTHER, sizeof(GameContext));
+    if (!ctx) {
+        return NULL;
+    }
+    // Mapped rather than allocated, so floors never visited stay as zero
+    // pages the system never backs however the heap has been used
+    void* storage = mmap(NULL, sizeof(Floor) * MAX_FLOORS, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (storage == MAP_FAILED) {
+        mem_free(MEM_OTHER, ctx);
+        return NULL;
+    }
+    ctx->floors = storage;
+    ctx->current_rng = &ctx->game_rng;
+    ctx->headless = 1;
+
+    GameContext* previous = use_game_context(ctx);
+    if (script) {
+        use_script_input(script);
+    } else {
+        use_random_input(mix_seed(seed, UINT64_C(0x696e707574)));
+    }
+    init_game((long)seed);
+    use_game_context(previous);
+    return ctx;
+}
+
+void destroy_game_context(GameContext* ctx) {
+    if (!ctx || ctx == &main_context) {
+        return;
+    }
+    for (int i = 0; i < MAX_FLOORS; i++) {
+        enemy_pool_free(&ctx->floors[i].enemies);
+    }
+    munmap(ctx->floors, sizeof(Floor) * MAX_FLOORS);
+    mem_free(MEM_OTHER, ctx);
+}
+
+// One turn of a session, on whichever thread calls it. Saving, loading
+// and quitting belong to the main game, so a session waits instead.
+int step_game_context(GameContext* ctx) {
+    GameContext* previous = use_game_context(ctx);
+
+    PROFILE_START(start);
+    update_fov();
+    PROFILE_STOP(PROFILE_FOV, start);
+
+    int input = read_input();
+    if (input == 'S' || input == 'L' || input == 'Q') {
+        input = '.';
+    }
+    step_game(input);
+
+    use_game_context(previous);
+    return ctx->player.health > 0;
+}
@@ -0,0 +1,202 @@
+#include "../include/headless.h"
+#include "../include/game.h"
+#include "../include/globals.h"
+#include "../include/input.h"
+#include "../include/profile.h"
+#include "../include/replay.h"
+#include "../include/autosave.h"
+#include "../include/trace.h"
+#include "../include/memory.h"
+
+// Settings for one headless run
+typedef struct {
+    int turns;           // -1 to play a replay to its end
+    long seed;
+    const char* script;  // NULL for random commands
+    const char* replay;  // Input log to play back instead
+    const char* record;  // Input log to write
+    int checksum_interval;
+    int autosave;        // Turns between autosaves, 0 for none
+    const char* trace;   // Chrome trace to write
+    int mem_report;      // Report memory by subsystem after the run
+} HeadlessOptions;
+
+// Parse --turns N, --seed S, --script COMMANDS, --replay FILE,
+// --record FILE, --checksum-every N, --autosave N, --trace FILE and
+// --mem-report
+static int parse_headless_options(int argc, char* argv[], HeadlessOptions* options) {
+    options->turns = -1;
+    options->seed = 1;
+    options->script = NULL;
+    options->replay = NULL;
+    options->record = NULL;
+    options->checksum_interval = 0;
+    options->autosave = 0;
+    options->trace = NULL;
+    options->mem_report = 0;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--mem-report") == 0) {
+            options->mem_report = 1;
+            continue;  // The one option without a value
+        }
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--turns") == 0 && value) {
+            options->turns = atoi(value);
+        } else if (strcmp(argv[i], "--seed") == 0 && value) {
+            options->seed = atol(value);
+        } else if (strcmp(argv[i], "--script") == 0 && value) {
+            options->script = value;
+        } else if (strcmp(argv[i], "--replay") == 0 && value) {
+            options->replay = value;
+        } else if (strcmp(argv[i], "--record") == 0 && value) {
+            options->record = value;
+        } else if (strcmp(argv[i], "--checksum-every") == 0 && value) {
+            options->checksum_interval = atoi(value);
+        } else if (strcmp(argv[i], "--autosave") == 0 && value) {
+            options->autosave = atoi(value);
+        } else if (strcmp(argv[i], "--trace") == 0 && value) {
+            options->trace = value;
+        } else {
+            fprintf(stderr, "Unknown or incomplete option: %s\n", argv[i]);
+            fprintf(stderr, "Usage: game --headless [--turns N] [--seed S] [--script COMMANDS | --replay FILE]\n"
+                            "                       [--record FILE [--checksum-every N]] [--autosave N] [--trace FILE]\n"
+                            "                       [--mem-report]\n");
+            return 0;
+        }
+        i++;
+    }
+    if (options->turns < 0 && !options->replay) {
+        options->turns = 10000;
+    }
+    return 1;
+}
+
+static void report_headless_run(const HeadlessOptions* options, int turns, const char* outcome, long long ns) {
+    double seconds = (double)ns / 1e9;
+
+    printf("seed %ld, %d turns, %s\n", options->seed, turns, outcome);
+    printf("floor %d, level %d, health %d/%d, kills %d\n",
+           CTX(current_floor) + 1, CTX(player).level, CTX(player).health, CTX(player).max_health, CTX(kill_count));
+    printf("%.1f turns/sec\n", seconds > 0 ? turns / seconds : 0.0);
+
+#ifdef PROFILE
+    // Phases a run never reaches, such as rendering, are left out
+    printf("%-12s %10s %10s %7s %9s %9s %9s\n", "phase", "ms", "us/turn", "share", "p50 us", "p99 us", "max us");
+    long long accounted = 0;
+    for (int phase = 0; phase < MAX_PROFILE_PHASES; phase++) {
+        ProfileStats stats;
+        profile_phase_stats((ProfilePhase)phase, &stats);
+        long long phase_ns = profile_phase_ns((ProfilePhase)phase);
+        if (!stats.frames && !phase_ns) {
+            continue;
+        }
+        accounted += phase_ns;
+        printf("%-12s %10.1f %10.2f %6.1f%% %9.1f %9.1f %9.1f\n", profile_phase_name((ProfilePhase)phase),
+               phase_ns / 1e6, turns ? phase_ns / 1e3 / turns : 0.0, ns ? 100.0 * phase_ns / ns : 0.0,
+               stats.p50_ns / 1e3, stats.p99_ns / 1e3, stats.max_ns / 1e3);
+    }
+    long long other = max(0LL, ns - accounted);
+    printf("%-12s %10.1f %10.2f %6.1f%%\n", "other",
+           other / 1e6, turns ? other / 1e3 / turns : 0.0, ns ? 100.0 * other / ns : 0.0);
+#else
+    printf("phase timing compiled out (built with PROFILE=0)\n");
+#endif
+
+    if (options->autosave > 0) {
+        const AutosaveStats* stats = autosave_stats();
+        printf("%d autosaves, %lld pages, pause %.1f us avg %.1f us max, %d deferred, %d failed\n",
+               stats->autosaves, stats->pages,
+               stats->autosaves ? stats->pause_ns / 1e3 / stats->autosaves : 0.0,
+               stats->max_pause_ns / 1e3, stats->skipped, stats->failed);
+    }
+    if (options->mem_report) {
+        mem_report(stdout);
+    }
+}
+
+// Play a seeded game from scripted, random or recorded commands with no
+// rendering. The run stops after the requested turns, when the player
+// dies, when the commands send Q or when a replay ends or diverges.
+int run_headless(int argc, char* argv[]) {
+    HeadlessOptions options;
+    if (!parse_headless_options(argc, argv, &options)) {
+        return 1;
+    }
+    if (options.replay) {
+        uint64_t seed;
+        if (!open_replay(options.replay, &seed)) {
+            return 1;
+        }
+        options.seed = (long)seed;
+    }
+    if (options.trace && !trace_start(options.trace)) {
+        fprintf(stderr, "Cannot trace to %s\n", options.trace);
+        close_replay();
+        return 1;
+    }
+
+    CTX(headless) = 1;
+    init_game(options.seed);
+    if (options.replay) {
+        use_replay_input();
+    } else if (options.script) {
+        use_script_input(options.script);
+    } else {
+        use_random_input(mix_seed((uint64_t)options.seed, UINT64_C(0x696e707574)));
+    }
+    if (options.record && !start_recording(options.record, (uint64_t)options.seed, options.checksum_interval)) {
+        fprintf(stderr, "Cannot write %s\n", options.record);
+        close_replay();
+        return 1;
+    }
+    autosave_init(options.autosave);
+    profile_reset();
+
+    const char* outcome = "completed";
+    int status = 0;
+    int turns = 0;
+    long long run_start = profile_now_ns();
+    while (options.turns < 0 || turns < options.turns) {
+        PROFILE_START(start);
+        update_fov();
+        PROFILE_STOP(PROFILE_FOV, start);
+
+        int input = read_input();
+        if (input_exhausted()) {
+            outcome = replay_has_diverged() ? "replay diverged" : "end of replay";
+            status = replay_has_diverged();
+            break;
+        }
+        if (input == 'Q') {
+            outcome = "quit";
+            break;
+        }
+        // S and L take no turn and, without a terminal, do nothing. A
+        // script of nothing else is held to its key budget like a menu.
+        if (!step_game(input)) {
+            continue;
+        }
+        turns++;
+        record_turn();
+        PROFILE_FRAME_END();
+
+        if (!check_replay_turn()) {
+            outcome = "replay diverged";
+            status = 1;
+            break;
+        }
+        if (CTX(player).health <= 0) {
+            outcome = "player died";
+            break;
+        }
+    }
+    long long ns = profile_now_ns() - run_start;
+    autosave_flush();
+
+    report_headless_run(&options, turns, outcome, ns);
+    printf("state checksum %08x\n", game_state_checksum());
+    cleanup_game();
+    close_replay();
+    return status;
+}
@@ -0,0 +1,145 @@
+#include "../include/input.h"
+#include "../include/replay.h"
+#include "../include/globals.h"
+#include "../include/ui.h"
+#include "../include/trace.h"
+
+// Commands the random source picks from: the eight moves, waiting, and
+// Enter so that prompts it wanders into always end
+static const char random_commands[] = "wasdqezc.\n";
+
+// Keys typed during real-time play that wait for their tick. There is one
+// terminal, so there is one queue.
+#define INPUT_QUEUE_SIZE 64
+static int queued_keys[INPUT_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+
+static void queue_key(int key) {
+    queued_keys[(queue_head + queue_count) % INPUT_QUEUE_SIZE] = key;
+    queue_count++;
+}
+
+static int dequeue_key() {
+    int key = queued_keys[queue_head];
+    queue_head = (queue_head + 1) % INPUT_QUEUE_SIZE;
+    queue_count--;
+    return key;
+}
+
+void use_terminal_input() {
+    CTX(input).type = INPUT_TERMINAL;
+}
+
+void use_script_input(const char* commands) {
+    CTX(input).type = INPUT_SCRIPT;
+    CTX(input).script = commands;
+    CTX(input).script_pos = 0;
+}
+
+// The random source keeps its own stream so it never disturbs game_rng
+void use_random_input(uint64_t seed) {
+    CTX(input).type = INPUT_RANDOM;
+    rng_seed(&CTX(input).rng, seed);
+}
+
+void use_replay_input() {
+    CTX(input).type = INPUT_REPLAY;
+    CTX(input).exhausted = 0;
+}
+
+InputSourceType input_source_type() {
+    return CTX(input).type;
+}
+
+int input_exhausted() {
+    return CTX(input).exhausted;
+}
+
+static int next_input() {
+    switch (CTX(input).type) {
+        case INPUT_SCRIPT:
+            if (!CTX(input).script || !CTX(input).script[0]) {
+                return '.';
+            }
+            if (!CTX(input).script[CTX(input).script_pos]) {
+                CTX(input).script_pos = 0;
+            }
+            return CTX(input).script[CTX(input).script_pos++];
+        case INPUT_RANDOM: {
+            Rng* previous = use_rng(&CTX(input).rng);
+            int command = random_commands[random_range(0, (int)sizeof(random_commands) - 2)];
+            use_rng(previous);
+            return command;
+        }
+        case INPUT_REPLAY: {
+            int command;
+            if (!replay_next_input(&command)) {
+                CTX(input).exhausted = 1;
+                return INPUT_END_KEY;
+            }
+            return command;
+        }
+        case INPUT_TERMINAL:
+        default: {
+            // Keys typed ahead in real-time play come first, menus included
+            if (queue_count > 0) {
+                return dequeue_key();
+            }
+            int key = getch();
+            // Overlay keys belong to the display, not the game
+            while (handle_overlay_key(key)) {
+                key = getch();
+            }
+            return key;
+        }
+    }
+}
+
+static int key_budget_spent() {
+    return (CTX(input).type == INPUT_SCRIPT || CTX(input).type == INPUT_RANDOM) &&
+           CTX(input).turn_keys >= MAX_TURN_KEYS;
+}
+
+// Only the main game's keys go to the input log. A key handed out for a
+// spent budget is logged like any other, so replays close the same menus.
+int read_input() {
+    TRACE_START(wait_start);
+    int input = key_budget_spent() ? INPUT_END_KEY : next_input();
+    CTX(input).turn_keys++;
+    TRACE_STOP("input wait", wait_start, NULL, 0);
+    if (!CTX(input).exhausted && game_ctx == main_game_context()) {
+        record_input(input);
+    }
+    return input;
+}
+
+void end_input_turn() {
+    CTX(input).turn_keys = 0;
+}
+
+// Queue the keys typed so far without waiting for more. Overlay keys act
+// at once; keys past a full queue of typing ahead are dropped.
+int poll_terminal_input() {
+    int queued = 0;
+    timeout(0);
+    for (int key = getch(); key != ERR; key = getch()) {
+        if (handle_overlay_key(key) || queue_count == INPUT_QUEUE_SIZE) {
+            continue;
+        }
+        queue_key(key);
+        queued++;
+    }
+    timeout(-1);
+    return queued;
+}
+
+// The command of one real-time tick: the oldest key queued, or a wait when
+// there is none. The wait is read and recorded like a typed key, so a
+// replay needs no clock.
+int read_tick_input() {
+    if (queue_count == 0) {
+        queue_key('.');
+    }
+    return read_input();
+}
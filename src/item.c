@@ -4,131 +4,158 @@
 
 // Get random item type
 ItemType get_random_item_type() {
-    int r = rand() % 100;
-    
-    if (r < 30) return ITEM_GOLD;      // 30%
-    if (r < 50) return ITEM_POTION;    // 20%
-    if (r < 65) return ITEM_FOOD;      // 15%
-    if (r < 75) return ITEM_SCROLL;    // 10%
-    if (r < 90) return ITEM_WEAPON;    // 15%
-    return ITEM_ARMOR;                 // 10%
+    return (ItemType)loot_draw(LOOT_ITEMS, CTX(current_floor));
 }
 
-// Create a random item
-Item create_random_item(int floor_level) {
-    Item item;
-    ItemType type = get_random_item_type();
-    
-    // Set common properties
-    item.active = 1;
+// Affix tables shared by the weapon and armor prototypes
+static const char* const weapon_prefixes[] = {
+    "Rusty", "Sharp", "Mighty", "Ancient",
+    "Glowing", "Cursed", "Blessed", "Dragon"
+};
+static const char* const weapon_kinds[] = {
+    "Dagger", "Sword", "Axe", "Mace",
+    "Spear", "Hammer", "Blade", "Scythe"
+};
+static const char* const armor_materials[] = {
+    "Leather", "Chain", "Scale", "Plate",
+    "Crystal", "Dragon", "Shadow", "Holy"
+};
+static const char* const armor_kinds[] = {
+    "Armor", "Mail", "Guard", "Shield",
+    "Aegis", "Plate", "Cover", "Ward"
+};
+
+#define AFFIX_COUNT(table) ((unsigned char)(sizeof(table) / sizeof(table[0])))
+
+const ItemPrototype item_prototypes[MAX_ITEM_PROTOS] = {
+    [ITEM_PROTO_NONE] = {ITEM_NONE, ' ', "Nothing", "Nothing at all"},
+    [ITEM_PROTO_WEAPON] = {ITEM_WEAPON, '|', "%s %s", "A %s weapon that deals %d damage",
+                           {weapon_prefixes, weapon_kinds},
+                           {AFFIX_COUNT(weapon_prefixes), AFFIX_COUNT(weapon_kinds)}},
+    [ITEM_PROTO_ARMOR] = {ITEM_ARMOR, ']', "%s %s", "Protective %s armor that blocks %d damage",
+                          {armor_materials, armor_kinds},
+                          {AFFIX_COUNT(armor_materials), AFFIX_COUNT(armor_kinds)}},
+    [ITEM_PROTO_HEALTH_POTION] = {ITEM_POTION, '!', "Health Potion", "Restores %d health when consumed"},
+    [ITEM_PROTO_SCROLL] = {ITEM_SCROLL, '?', "Magic Scroll", "Slows the enemies around you with frost"},
+    [ITEM_PROTO_RATION] = {ITEM_FOOD, '%', "Ration", "Restores %d health when eaten"},
+    [ITEM_PROTO_GOLD] = {ITEM_GOLD, '$', "%d Gold", "A pile of %d gold coins"},
+    [ITEM_PROTO_FLOOR_KEY] = {ITEM_KEY, 'K', "Floor Key", "A key that unlocks the way forward"},
+    [ITEM_PROTO_IRON_SWORD] = {ITEM_WEAPON, '/', "Iron Sword", "A basic but reliable weapon"},
+    [ITEM_PROTO_LEATHER_ARMOR] = {ITEM_ARMOR, '[', "Leather Armor", "Basic protective gear"},
+    [ITEM_PROTO_MINOR_POTION] = {ITEM_POTION, '!', "Health Potion", "Restores some health"},
+    [ITEM_PROTO_LOOSE_GOLD] = {ITEM_GOLD, '$', "Gold", "Shiny coins"},
+};
+
+// Get the prototype an item was built from
+const ItemPrototype* item_prototype(const Item* item) {
+    return &item_prototypes[item->proto];
+}
+
+// Get an item's type
+ItemType item_type(const Item* item) {
+    return item_prototypes[item->proto].type;
+}
+
+// Build an active item from a prototype with no affixes chosen
+Item make_item(ItemProtoId proto, int power, int value) {
+    Item item = {0};
+    item.proto = (uint8_t)proto;
+    item.power = (int16_t)power;
+    item.value = (int16_t)value;
     item.durability = 100;
+    item.active = 1;
+    return item;
+}
+
+// Fill one of a few rotating buffers from a prototype format, so that
+// several generated strings can appear in the same message. Each thread
+// has its own set, as sessions may run side by side.
+static const char* format_item_text(const Item* item, const char* format, int first_affix_only) {
+    static _Thread_local char buffers[4][MAX_DESC_LEN];
+    static _Thread_local int next_buffer;
+
+    if (!strchr(format, '%')) {
+        return format;
+    }
+
+    const ItemPrototype* proto = item_prototype(item);
+    char* text = buffers[next_buffer];
+    next_buffer = (next_buffer + 1) % 4;
+
+    if (!proto->affixes[0]) {
+        snprintf(text, MAX_DESC_LEN, format, item->power);
+    } else if (first_affix_only) {
+        snprintf(text, MAX_DESC_LEN, format, proto->affixes[0][item->affix[0]], item->power);
+    } else {
+        snprintf(text, MAX_DESC_LEN, format, proto->affixes[0][item->affix[0]],
+                 proto->affixes[1][item->affix[1]]);
+    }
+    return text;
+}
+
+// Get an item's display name
+const char* item_name(const Item* item) {
+    return format_item_text(item, item_prototype(item)->name, 0);
+}
+
+// Get an item's description
+const char* item_description(const Item* item) {
+    return format_item_text(item, item_prototype(item)->description, 1);
+}
+
+// Create an item of a given type, scaled to the floor level
+Item create_item_of_type(ItemType type, int floor_level) {
+    Item item;
     
     switch(type) {
-        case ITEM_WEAPON: {
-            static const char* prefixes[] = {
-                "Rusty", "Sharp", "Mighty", "Ancient",
-                "Glowing", "Cursed", "Blessed", "Dragon"
-            };
-            static const char* types[] = {
-                "Dagger", "Sword", "Axe", "Mace",
-                "Spear", "Hammer", "Blade", "Scythe"
-            };
-            
-            int prefix_idx = rand() % (sizeof(prefixes) / sizeof(prefixes[0]));
-            int type_idx = rand() % (sizeof(types) / sizeof(types[0]));
-            
-            snprintf(item.name, MAX_NAME_LEN, "%s %s", 
-                    prefixes[prefix_idx], types[type_idx]);
-            snprintf(item.description, MAX_DESC_LEN,
-                    "A %s weapon that deals %d damage",
-                    prefixes[prefix_idx], 5 + floor_level * 2);
-            
-            item.type = ITEM_WEAPON;
-            item.symbol = '|';
-            item.power = 5 + floor_level * 2;
-            item.value = 50 + floor_level * 25;
+        case ITEM_WEAPON:
+            item = make_item(ITEM_PROTO_WEAPON, 5 + floor_level * 2, 50 + floor_level * 25);
+            item.affix[0] = (uint8_t)random_range(0, AFFIX_COUNT(weapon_prefixes) - 1);
+            item.affix[1] = (uint8_t)random_range(0, AFFIX_COUNT(weapon_kinds) - 1);
             break;
-        }
-            
-        case ITEM_ARMOR: {
-            static const char* materials[] = {
-                "Leather", "Chain", "Scale", "Plate",
-                "Crystal", "Dragon", "Shadow", "Holy"
-            };
-            static const char* types[] = {
-                "Armor", "Mail", "Guard", "Shield",
-                "Aegis", "Plate", "Cover", "Ward"
-            };
-            
-            int material_idx = rand() % (sizeof(materials) / sizeof(materials[0]));
-            int type_idx = rand() % (sizeof(types) / sizeof(types[0]));
             
-            snprintf(item.name, MAX_NAME_LEN, "%s %s",
-                    materials[material_idx], types[type_idx]);
-            snprintf(item.description, MAX_DESC_LEN,
-                    "Protective %s armor that blocks %d damage",
-                    materials[material_idx], 3 + floor_level);
-            
-            item.type = ITEM_ARMOR;
-            item.symbol = ']';
-            item.power = 3 + floor_level;
-            item.value = 40 + floor_level * 20;
+        case ITEM_ARMOR:
+            item = make_item(ITEM_PROTO_ARMOR, 3 + floor_level, 40 + floor_level * 20);
+            item.affix[0] = (uint8_t)random_range(0, AFFIX_COUNT(armor_materials) - 1);
+            item.affix[1] = (uint8_t)random_range(0, AFFIX_COUNT(armor_kinds) - 1);
             break;
-        }
             
-        case ITEM_POTION: {
-            strcpy(item.name, "Health Potion");
-            snprintf(item.description, MAX_DESC_LEN,
-                    "Restores %d health when consumed",
-                    20 + floor_level * 5);
-            item.type = ITEM_POTION;
-            item.symbol = '!';
-            item.value = 20 + floor_level * 5;
-            item.power = 20 + floor_level * 5;
+        case ITEM_POTION:
+            item = make_item(ITEM_PROTO_HEALTH_POTION, 20 + floor_level * 5, 20 + floor_level * 5);
             break;
-        }
             
-        case ITEM_SCROLL: {
-            strcpy(item.name, "Magic Scroll");
-            strcpy(item.description, "A mysterious scroll");
-            item.type = ITEM_SCROLL;
-            item.symbol = '?';
-            item.value = 30 + floor_level * 10;
-            item.power = floor_level;
+        case ITEM_SCROLL:
+            item = make_item(ITEM_PROTO_SCROLL, floor_level, 30 + floor_level * 10);
             break;
-        }
             
-        case ITEM_FOOD: {
-            strcpy(item.name, "Ration");
-            snprintf(item.description, MAX_DESC_LEN,
-                    "Restores %d health when eaten",
-                    10 + floor_level * 2);
-            item.type = ITEM_FOOD;
-            item.symbol = '%';
-            item.value = 10 + floor_level * 2;
-            item.power = 10 + floor_level * 2;
+        case ITEM_FOOD:
+            item = make_item(ITEM_PROTO_RATION, 10 + floor_level * 2, 10 + floor_level * 2);
             break;
-        }
             
         case ITEM_GOLD: {
-            int amount = 10 + rand() % (20 + floor_level * 10);
-            snprintf(item.name, MAX_NAME_LEN, "%d Gold", amount);
-            snprintf(item.description, MAX_DESC_LEN,
-                    "A pile of %d gold coins", amount);
-            item.type = ITEM_GOLD;
-            item.symbol = '$';
-            item.value = amount;
-            item.power = 0;
+            int amount = 10 + random_range(0, 20 + floor_level * 10 - 1);
+            item = make_item(ITEM_PROTO_GOLD, amount, amount);
             break;
         }
             
         default:
+            item = make_item(ITEM_PROTO_NONE, 0, 0);
             break;
     }
     
     return item;
 }
 
+// Create an item whose type is drawn from an item table
+Item create_item_from_table(LootTableId table, int floor_level) {
+    return create_item_of_type((ItemType)loot_draw(table, floor_level), floor_level);
+}
+
+// Create a random item
+Item create_random_item(int floor_level) {
+    return create_item_from_table(LOOT_ITEMS, floor_level);
+}
+
 // Initialize items on a floor
 void init_items(Floor* floor) {
     // Clear existing items
@@ -141,12 +168,12 @@ void init_items(Floor* floor) {
         Room* room = &floor->rooms[i];
         
         // 50% chance for each room to have an item
-        if (rand() % 2 == 0) {
+        if (random_range(0, 1) == 0) {
             for (int j = 0; j < MAX_ITEMS; j++) {
                 if (!floor->items[j].active) {
-                    floor->items[j] = create_random_item(current_floor);
-                    floor->items[j].x = room->x + 1 + rand() % (room->width - 2);
-                    floor->items[j].y = room->y + 1 + rand() % (room->height - 2);
+                    floor->items[j] = create_random_item(CTX(current_floor));
+                    floor->items[j].x = room->x + 1 + random_range(0, room->width - 2 - 1);
+                    floor->items[j].y = room->y + 1 + random_range(0, room->height - 2 - 1);
                     floor->items[j].active = 1;
                     break;
                 }
@@ -0,0 +1,157 @@
+#include <pthread.h>
+#include "../include/loot.h"
+#include "../include/enemy.h"
+
+// Weights of one table in every depth band
+typedef struct {
+    int num_outcomes;
+    unsigned char weights[DEPTH_BANDS][MAX_LOOT_OUTCOMES];
+} LootTableDef;
+
+// The same weights in every depth band
+#define ALL_BANDS(...) {{__VA_ARGS__}, {__VA_ARGS__}, {__VA_ARGS__}, {__VA_ARGS__}}
+
+// Enemy weights are filled in from enemy_archetypes when the tables are built
+static LootTableDef loot_tables[MAX_LOOT_TABLES] = {
+    [LOOT_ITEMS] = {ITEM_TYPE_COUNT, ALL_BANDS(
+        [ITEM_GOLD] = 30, [ITEM_POTION] = 20, [ITEM_FOOD] = 15,
+        [ITEM_SCROLL] = 10, [ITEM_WEAPON] = 15, [ITEM_ARMOR] = 10)},
+    [LOOT_ROOM_ITEMS] = {ITEM_TYPE_COUNT, ALL_BANDS(
+        [ITEM_WEAPON] = 1, [ITEM_ARMOR] = 1, [ITEM_POTION] = 1, [ITEM_GOLD] = 1)},
+    [LOOT_WEAPON_STORE] = {ITEM_TYPE_COUNT, ALL_BANDS([ITEM_WEAPON] = 1)},
+    [LOOT_ARMOR_STORE] = {ITEM_TYPE_COUNT, ALL_BANDS([ITEM_ARMOR] = 1)},
+    [LOOT_POTION_STORE] = {ITEM_TYPE_COUNT, ALL_BANDS([ITEM_POTION] = 20, [ITEM_SCROLL] = 10)},
+    [LOOT_ENEMIES] = {MAX_ENEMY_TYPES, {{0}}},
+};
+
+// Walker alias table: column i keeps outcome i when the low 32 bits of a
+// draw fall below threshold[i] and gives alias[i] otherwise
+typedef struct {
+    uint32_t threshold[MAX_LOOT_OUTCOMES];
+    unsigned char alias[MAX_LOOT_OUTCOMES];
+    int num_outcomes;
+} AliasTable;
+
+static AliasTable alias_tables[MAX_LOOT_TABLES][DEPTH_BANDS];
+static pthread_once_t alias_tables_once = PTHREAD_ONCE_INIT;
+
+// Copy the archetype spawn weights into the enemy table. Bands whose
+// weights fall short of 100 leave the rest to the basic enemy.
+static void fill_enemy_weights(LootTableDef* def) {
+    for (int band = 0; band < DEPTH_BANDS; band++) {
+        int total = 0;
+        for (int type = 0; type < MAX_ENEMY_TYPES; type++) {
+            def->weights[band][type] = enemy_archetypes[type].spawn_weight[band];
+            total += def->weights[band][type];
+        }
+        if (total < 100) {
+            def->weights[band][ENEMY_BASIC] += (unsigned char)(100 - total);
+        }
+    }
+}
+
+// Build one alias table with Vose's method, in integer arithmetic: every
+// weight is scaled by the outcome count so that each column holds total.
+static void build_alias_table(AliasTable* table, const unsigned char* weights, int n) {
+    long long scaled[MAX_LOOT_OUTCOMES];
+    int small[MAX_LOOT_OUTCOMES], large[MAX_LOOT_OUTCOMES];
+    int num_small = 0, num_large = 0;
+    long long total = 0;
+
+    table->num_outcomes = n;
+    for (int i = 0; i < n; i++) {
+        total += weights[i];
+    }
+    if (total == 0) {
+        // Nothing to draw from: every draw lands on outcome 0
+        for (int i = 0; i < n; i++) {
+            table->threshold[i] = 0;
+            table->alias[i] = 0;
+        }
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        scaled[i] = (long long)weights[i] * n;
+        table->threshold[i] = UINT32_MAX;
+        table->alias[i] = (unsigned char)i;
+        if (scaled[i] < total) {
+            small[num_small++] = i;
+        } else {
+            large[num_large++] = i;
+        }
+    }
+
+    while (num_small > 0 && num_large > 0) {
+        int s = small[--num_small];
+        int l = large[--num_large];
+        table->threshold[s] = (uint32_t)(((uint64_t)scaled[s] << 32) / (uint64_t)total);
+        table->alias[s] = (unsigned char)l;
+        scaled[l] -= total - scaled[s];
+        if (scaled[l] < total) {
+            small[num_small++] = l;
+        } else {
+            large[num_large++] = l;
+        }
+    }
+    // Whatever is left is full up to rounding and keeps its own outcome
+}
+
+static void build_alias_tables(void) {
+    fill_enemy_weights(&loot_tables[LOOT_ENEMIES]);
+    for (int id = 0; id < MAX_LOOT_TABLES; id++) {
+        for (int band = 0; band < DEPTH_BANDS; band++) {
+            build_alias_table(&alias_tables[id][band], loot_tables[id].weights[band],
+                              loot_tables[id].num_outcomes);
+        }
+    }
+}
+
+static const AliasTable* alias_table(LootTableId table, int floor_num) {
+    pthread_once(&alias_tables_once, build_alias_tables);
+    return &alias_tables[table][depth_band(floor_num)];
+}
+
+// Pick a column with the high 32 bits and accept or alias it with the low
+static inline int alias_draw(const AliasTable* table, uint64_t bits) {
+    int column = (int)(((bits >> 32) * (uint64_t)table->num_outcomes) >> 32);
+    return (uint32_t)bits < table->threshold[column] ? column : table->alias[column];
+}
+
+// Depth band a floor falls in
+int depth_band(int floor_num) {
+    return min(max(floor_num, 0) / DEPTH_BAND_FLOORS, DEPTH_BANDS - 1);
+}
+
+// Draw one outcome of a table at a floor's depth
+int loot_draw(LootTableId table, int floor_num) {
+    return alias_draw(alias_table(table, floor_num), random_bits());
+}
+
+// Fill out[0..count) with independent draws
+void loot_draw_many(LootTableId table, int floor_num, int* out, int count) {
+    const AliasTable* alias = alias_table(table, floor_num);
+    for (int i = 0; i < count; i++) {
+        out[i] = alias_draw(alias, random_bits());
+    }
+}
+
+// Weight of an outcome at a floor's depth
+int loot_weight(LootTableId table, int floor_num, int outcome) {
+    pthread_once(&alias_tables_once, build_alias_tables);
+    return loot_tables[table].weights[depth_band(floor_num)][outcome];
+}
+
+// Sum of a table's weights at a floor's depth
+int loot_total_weight(LootTableId table, int floor_num) {
+    int total = 0;
+    for (int i = 0; i < loot_tables[table].num_outcomes; i++) {
+        total += loot_weight(table, floor_num, i);
+    }
+    return total;
+}
+
+// Number of outcomes a table draws from
+int loot_num_outcomes(LootTableId table) {
+    return loot_tables[table].num_outcomes;
+}
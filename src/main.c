@@ -1,30 +1,107 @@
 #include "../include/game.h"
 #include "../include/ui.h"
 #include "../include/player.h"
+#include "../include/bench.h"
+#include "../include/headless.h"
+#include "../include/sweep.h"
+#include "../include/replay.h"
+#include "../include/save.h"
+#include "../include/autosave.h"
+#include "../include/trace.h"
 #include <locale.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 int main(int argc, char *argv[]) {
-    long seed;
-    if(argc < 1){
-        seed = time(NULL);
-    }else{
-        seed = atol(argv[1]);
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        return run_bench(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+        return run_headless(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--seed-sweep") == 0) {
+        return run_seed_sweep(argc - 1, argv + 1);
+    }
+    
+    // game [seed] [--record FILE [--checksum-every N]] [--load FILE | --resume] [--trace FILE]
+    //      [--realtime HZ [--fps N]]
+    long seed = time(NULL);
+    const char* record = NULL;
+    const char* trace = NULL;
+    const char* load = NULL;
+    int resume = 0;
+    int checksum_interval = 0;
+    int tick_hz = 0;  // Turn-based unless set
+    int frame_hz = DEFAULT_FRAME_HZ;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record = argv[++i];
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            load = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace = argv[++i];
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resume = 1;
+        } else if (strcmp(argv[i], "--checksum-every") == 0 && i + 1 < argc) {
+            checksum_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--realtime") == 0 && i + 1 < argc) {
+            tick_hz = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            frame_hz = atoi(argv[++i]);
+        } else {
+            seed = atol(argv[i]);
+        }
     }
     
+    if (tick_hz < 0 || tick_hz > MAX_REALTIME_HZ || frame_hz < 1 || frame_hz > MAX_REALTIME_HZ) {
+        fprintf(stderr, "Tick and frame rates must be between 1 and %d per second\n", MAX_REALTIME_HZ);
+        return 1;
+    }
+
+    // A log replays from the seed, not from whatever a save holds
+    if (record && (load || resume)) {
+        fprintf(stderr, "--record cannot be combined with --load or --resume\n");
+        return 1;
+    }
+
+    // Open the log before ncurses takes over the terminal
+    if (record && !start_recording(record, (uint64_t)seed, checksum_interval)) {
+        fprintf(stderr, "Cannot write %s\n", record);
+        return 1;
+    }
+    if (trace && !trace_start(trace)) {
+        fprintf(stderr, "Cannot trace to %s\n", trace);
+        stop_recording();
+        return 1;
+    }
 
     // Set up locale for UTF-8 support
     setlocale(LC_ALL, "");
     
     // Initialize game
     init_game(seed);
+    if (load && !load_game(load)) {
+        cleanup_game();
+        fprintf(stderr, "Cannot load %s\n", load);
+        return 1;
+    }
+    if (resume && !load_autosave()) {
+        cleanup_game();
+        fprintf(stderr, "No valid autosave to resume\n");
+        return 1;
+    }
+    autosave_init(AUTOSAVE_TURNS);
     
     // Run game loop
-    game_loop();
+    if (tick_hz > 0) {
+        realtime_game_loop(tick_hz, frame_hz);
+    } else {
+        game_loop();
+    }
     
     // Clean up
     cleanup_game();
     
     return 0;
-} 
\ No newline at end of file
+} 
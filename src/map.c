@@ -8,15 +8,19 @@
 #include "../include/item.h"
 #include "../include/player.h"
 #include "../include/store.h"
+#include "../include/timer.h"
+#include "../include/autosave.h"
+#include "../include/trace.h"
+#include "../include/memory.h"
 
 // Get current floor
 Floor* current_floor_ptr() {
-    return &floors[current_floor];
+    return &CTX(floors)[CTX(current_floor)];
 }
 
 // Generate a random room with different types
 Room generate_room() {
-    Room room;
+    Room room = {0};
     
     // Initialize common room properties
     room.type = ROOM_NORMAL;  // Only use normal square rooms
@@ -144,8 +148,10 @@ void place_stairs_in_room(Floor* floor, Room* room) {
     int down_x = down_room->x + down_room->width / 2;
     int down_y = down_room->y + down_room->height / 2;
     
-    // Ensure down stairs are away from walls
-    while (!is_away_from_walls(floor, down_x, down_y) && attempts > 0) {
+    // Ensure down stairs are away from walls, and off the up stairs when
+    // both are in the same room
+    while ((!is_away_from_walls(floor, down_x, down_y) ||
+            (down_x == floor->up_stairs_x && down_y == floor->up_stairs_y)) && attempts > 0) {
         down_x = down_room->x + random_range(2, down_room->width - 3);
         down_y = down_room->y + random_range(2, down_room->height - 3);
         attempts--;
@@ -166,24 +172,13 @@ void place_floor_key(Floor* floor, Room* room) {
     int y = random_range(room->y + 2, room->y + room->height - 4);
 
     // Create the floor key
-    for (int i = 0; i < MAX_ITEMS; i++) {
-        if (!floor->items[i].active) {
-            floor->items[i] = (Item){
-                .name = "Floor Key",
-                .description = "A key that unlocks the way forward",
-                .x = x,
-                .y = y,
-                .symbol = 'K',
-                .active = 1,
-                .type = ITEM_KEY,
-                .value = 200,
-                .key_id = current_floor + 1,  // Key ID matches next floor
-                .target_floor = current_floor  // Used on current floor
-            };
-            strcpy(floor->items[i].name, "Floor Key");
-            strcpy(floor->items[i].description, "A key that unlocks the way forward");
-            break;
-        }
+    int slot = free_item_slot(floor);
+    if (slot >= 0) {
+        floor->items[slot] = make_item(ITEM_PROTO_FLOOR_KEY, 0, 200);
+        floor->items[slot].x = x;
+        floor->items[slot].y = y;
+        floor->items[slot].key_id = CTX(current_floor) + 1;  // Key ID matches next floor
+        floor->items[slot].target_floor = CTX(current_floor);  // Used on current floor
     }
 }
 
@@ -191,15 +186,16 @@ void place_floor_key(Floor* floor, Room* room) {
 
 // Initialize a floor
 void init_floor(int floor_num) {
-    Floor* floor = &floors[floor_num];
-    current_floor = floor_num;
+    Floor* floor = &CTX(floors)[floor_num];
+    CTX(current_floor) = floor_num;
     
     // Generate new floor if not visited before
     if (!floor->has_visited) {
+        TRACE_START(generate_start);
         generate_floor(floor);
         
         // Place up stairs in a random room
-        Room* up_room = &floor->rooms[rand() % floor->num_rooms];
+        Room* up_room = &floor->rooms[random_range(0, floor->num_rooms - 1)];
         
         // Place down stairs in the last room (or second room if first is only room)
         Room* down_room = &floor->rooms[floor->num_rooms - 1];
@@ -210,21 +206,109 @@ void init_floor(int floor_num) {
         // Place stairs
         place_stairs_in_room(floor, up_room);
         
-        // Place floor key in a different room than stairs
-        Room* key_room;
-        do {
-            key_room = &floor->rooms[rand() % floor->num_rooms];
-        } while (key_room == up_room || key_room == down_room);
+        // Place floor key in a different room than stairs. A floor of one
+        // or two rooms may have none left over; the key then shares the up
+        // stairs room instead of the draw spinning forever.
+        Room* key_room = up_room;
+        int stairs_rooms = up_room == down_room ? 1 : 2;
+        if (floor->num_rooms > stairs_rooms) {
+            do {
+                key_room = &floor->rooms[random_range(0, floor->num_rooms - 1)];
+            } while (key_room == up_room || key_room == down_room);
+        }
         
         // Add floor key to items array
         place_floor_key(floor, key_room);
         
+        // Then hold slots for what the rooms will hold, once they are seen
+        reserve_room_slots(floor);
+        
         floor->has_visited = 1;
         floor->has_stairs = 1;
+        TRACE_STOP("generate floor", generate_start, "floor", floor_num + 1);
+        
+        // Rooms are filled in as the player first sees them
+    } else {
+        // Bring the floor up to date with the time the player was away
+        catch_up_floor(floor, CTX(game_turn) - floor->last_turn);
+    }
+    
+    floor->last_turn = CTX(game_turn);
+    save_mark_dirty(&floor->last_turn, sizeof(floor->last_turn));
+    mem_sample();
+}
+
+// Record when the player left the current floor and let its enemies rest
+void leave_floor() {
+    Floor* floor = current_floor_ptr();
+    sleep_all_enemies();
+    floor->last_turn = CTX(game_turn);
+    save_mark_dirty(&floor->last_turn, sizeof(floor->last_turn));
+}
+
+// Advance a floor the player has returned to by elapsed turns in bulk.
+// Everything here costs the same whether the player was away for ten
+// turns or ten thousand.
+void catch_up_floor(Floor* floor, int elapsed) {
+    if (elapsed <= 0) {
+        return;
     }
     
-    // Spawn enemies for this floor
-    spawn_floor_enemies();
+    save_mark_floor(floor);
+    catch_up_enemies(elapsed);
+    update_floor_timers(floor, floor->last_turn + elapsed);
+}
+
+// Start a new floor's timer wheel at the current turn with its first respawn
+void start_floor_timers(Floor* floor) {
+    timer_wheel_init(&floor->timers, CTX(game_turn));
+    timer_add(&floor->timers, CTX(game_turn) + ENEMY_RESPAWN_TURNS, TIMER_ENEMY_RESPAWN, 0);
+}
+
+// The floor being advanced and the last turn it is advanced to
+typedef struct {
+    Floor* floor;
+    int horizon;
+} FloorTimerContext;
+
+// Number of periods from deadline that are also due by horizon, counting
+// the one firing now
+static int periods_due(int deadline, int period, int horizon) {
+    return 1 + max(0, horizon - deadline) / period;
+}
+
+// Handle one floor timer. A periodic timer that would fire again before
+// the horizon is folded into a single firing, so a long catch-up costs no
+// more than a turn.
+static void fire_floor_timer(void* ctx, TimerKind kind, int arg, int deadline) {
+    FloorTimerContext* context = ctx;
+    Floor* floor = context->floor;
+    
+    switch (kind) {
+        case TIMER_STORE_RESTOCK: {
+            Store* store = &floor->stores[arg];
+            int periods = periods_due(deadline, store->restock_period, context->horizon);
+            store->epoch += periods - 1;
+            restock_store(store, deadline + (periods - 1) * store->restock_period);
+            timer_add(&floor->timers, store->restock_turn, TIMER_STORE_RESTOCK, arg);
+            break;
+        }
+        case TIMER_ENEMY_RESPAWN: {
+            int periods = periods_due(deadline, ENEMY_RESPAWN_TURNS, context->horizon);
+            respawn_enemies(periods);
+            timer_add(&floor->timers, deadline + periods * ENEMY_RESPAWN_TURNS, TIMER_ENEMY_RESPAWN, 0);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Fire the restocks and respawns due on a floor up to and including turn
+void update_floor_timers(Floor* floor, int turn) {
+    FloorTimerContext context = { floor, turn };
+    save_mark_dirty(&floor->timers, sizeof(TimerWheel));
+    timer_advance(&floor->timers, turn, fire_floor_timer, &context);
 }
 
 // Calculate if a point is visible from the player's position
@@ -232,8 +316,8 @@ int is_visible(int x, int y) {
     Floor* floor = current_floor_ptr();
     
     // If point is too far, it's not visible
-    int dx = x - player.x;
-    int dy = y - player.y;
+    int dx = x - CTX(player).x;
+    int dy = y - CTX(player).y;
     if (dx * dx + dy * dy > VIEW_RADIUS * VIEW_RADIUS) {
         return 0;
     }
@@ -245,8 +329,8 @@ int is_visible(int x, int y) {
     int sy = dy > 0 ? 1 : -1;
     
     int err = abs_dx - abs_dy;
-    int current_x = player.x;
-    int current_y = player.y;
+    int current_x = CTX(player).x;
+    int current_y = CTX(player).y;
     
     while (current_x != x || current_y != y) {
         if (floor->map[current_y][current_x] == '#') {
@@ -273,122 +357,232 @@ void update_fov() {
     
     // Reset visibility
     memset(floor->visible, 0, sizeof(floor->visible));
+    save_mark_dirty(floor->visible, sizeof(floor->visible));
     
     // Check visibility for each point in view radius
-    for (int y = max(0, player.y - VIEW_RADIUS); 
-         y < min(MAP_HEIGHT, player.y + VIEW_RADIUS + 1); y++) {
-        for (int x = max(0, player.x - VIEW_RADIUS);
-             x < min(MAP_WIDTH, player.x + VIEW_RADIUS + 1); x++) {
+    for (int y = max(0, CTX(player).y - VIEW_RADIUS); 
+         y < min(MAP_HEIGHT, CTX(player).y + VIEW_RADIUS + 1); y++) {
+        save_mark_dirty(floor->discovered[y], sizeof(floor->discovered[y]));
+        for (int x = max(0, CTX(player).x - VIEW_RADIUS);
+             x < min(MAP_WIDTH, CTX(player).x + VIEW_RADIUS + 1); x++) {
             if (is_visible(x, y)) {
                 floor->visible[y][x] = 1;
                 floor->discovered[y][x] = 1;
+                
+                int room = floor->room_id[y][x];
+                if (room && !floor->rooms[room - 1].populated) {
+                    populate_room(floor, room - 1);
+                }
             }
         }
     }
 }
 
-// Place a random item in a room
-void place_random_item(Floor* floor, Room* room) {
-    // Find an empty spot in the room
-    int x = random_range(room->x + 2, room->x + room->width - 4);
-    int y = random_range(room->y + 2, room->y + room->height - 4);
+// Everything a room's stream decides before its enemies
+typedef struct {
+    int has_item;
+    Item item;
+    int has_store;
+    int store_x;
+    int store_y;
+    StoreType store_type;
+    uint64_t store_seed;
+} RoomContents;
+
+// Power and value ranges of the items rooms are stocked with, by type
+typedef struct {
+    ItemProtoId proto;
+    int power_min;
+    int power_max;
+    int value_min;
+    int value_max;  // 0 when the value is the power, as for gold
+} RoomItemKind;
+
+static const RoomItemKind room_item_kinds[ITEM_TYPE_COUNT] = {
+    [ITEM_WEAPON] = {ITEM_PROTO_IRON_SWORD, 3, 7, 50, 150},
+    [ITEM_ARMOR] = {ITEM_PROTO_LEATHER_ARMOR, 2, 5, 40, 120},
+    [ITEM_POTION] = {ITEM_PROTO_MINOR_POTION, 10, 25, 30, 80},
+    [ITEM_GOLD] = {ITEM_PROTO_LOOSE_GOLD, 10, 100, 0, 0},
+};
+
+// Draw a room's item and store from the active stream. Every value is
+// drawn whether or not the room gets the thing it describes, so the number
+// of draws is always the same and the enemy draws after them never shift.
+static void roll_room_contents(const Room* room, RoomContents* contents) {
+    // 70% chance of an item, in a spot away from the walls
+    contents->has_item = random_range(0, 99) < 70;
+    int item_x = random_range(room->x + 2, room->x + room->width - 4);
+    int item_y = random_range(room->y + 2, room->y + room->height - 4);
+    ItemType type = (ItemType)loot_draw(LOOT_ROOM_ITEMS, CTX(current_floor));
+    uint64_t power_bits = random_bits();
+    uint64_t value_bits = random_bits();
+
+    const RoomItemKind* kind = &room_item_kinds[type];
+    if (kind->proto == ITEM_PROTO_NONE) {
+        contents->has_item = 0;
+        contents->item = (Item){0};
+    } else {
+        int power = kind->power_min + (int)(power_bits % (uint64_t)(kind->power_max - kind->power_min + 1));
+        int value = kind->value_max ? kind->value_min + (int)(value_bits % (uint64_t)(kind->value_max - kind->value_min + 1))
+                                    : power;
+        contents->item = make_item(kind->proto, power, value);
+        contents->item.x = item_x;
+        contents->item.y = item_y;
+    }
+
+    // 20% chance of a store
+    contents->has_store = random_range(0, 4) == 0;
+    contents->store_x = random_range(room->x + 2, room->x + room->width - 4);
+    contents->store_y = random_range(room->y + 2, room->y + room->height - 4);
+    contents->store_type = get_store_type_from_int(random_range(0, 3));
+    contents->store_seed = random_bits();
+}
 
-    // Create a random item
+// Seed rng with a room's stream and make it the active one; returns the
+// stream that was active before
+static Rng* use_room_rng(const Floor* floor, int room_index, Rng* rng) {
+    rng_seed(rng, mix_seed(floor->seed, (uint64_t)room_index));
+    return use_rng(rng);
+}
+
+// Whether a floor item slot is held for a room not yet populated
+static int item_slot_held(const Floor* floor, int slot) {
+    for (int i = 0; i < floor->num_rooms; i++) {
+        if (!floor->rooms[i].populated && floor->rooms[i].item_slot == slot + 1) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int npc_slot_held(const Floor* floor, int slot) {
+    for (int i = 0; i < floor->num_rooms; i++) {
+        if (!floor->rooms[i].populated && floor->rooms[i].npc_slot == slot + 1) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// A floor item slot that is empty and not held for a room, or -1
+int free_item_slot(const Floor* floor) {
     for (int i = 0; i < MAX_ITEMS; i++) {
-        if (!floor->items[i].active) {
-            // First clear the item struct completely
-            memset(&floor->items[i], 0, sizeof(Item));
-            
-            ItemType type = get_item_type_from_int(random_range(ITEM_WEAPON, ITEM_GOLD));
-            
-            // Set common properties
-            floor->items[i].x = x;
-            floor->items[i].y = y;
-            floor->items[i].active = 1;
-            floor->items[i].type = type;
-            
-            // Set item properties based on type
-            switch(type) {
-                case ITEM_WEAPON:
-                    strcpy(floor->items[i].name, "Iron Sword");
-                    strcpy(floor->items[i].description, "A basic but reliable weapon");
-                    floor->items[i].symbol = '/';
-                    floor->items[i].power = random_range(3, 7);
-                    floor->items[i].value = random_range(50, 150);
-                    break;
-                    
-                case ITEM_ARMOR:
-                    strcpy(floor->items[i].name, "Leather Armor");
-                    strcpy(floor->items[i].description, "Basic protective gear");
-                    floor->items[i].symbol = '[';
-                    floor->items[i].power = random_range(2, 5);
-                    floor->items[i].value = random_range(40, 120);
-                    break;
-                    
-                case ITEM_POTION:
-                    strcpy(floor->items[i].name, "Health Potion");
-                    strcpy(floor->items[i].description, "Restores some health");
-                    floor->items[i].symbol = '!';
-                    floor->items[i].power = random_range(10, 25);
-                    floor->items[i].value = random_range(30, 80);
-                    break;
-                    
-                case ITEM_GOLD:
-                    strcpy(floor->items[i].name, "Gold");
-                    strcpy(floor->items[i].description, "Shiny coins");
-                    floor->items[i].symbol = '$';
-                    floor->items[i].value = random_range(10, 100);
-                    floor->items[i].power = floor->items[i].value;  // For gold, power = value
-                    break;
-                    
-                default:
-                    // If somehow we get an invalid type, make it inactive
-                    floor->items[i].active = 0;
-                    break;
-            }
-            
-            // Only break if we successfully created an item
-            if (floor->items[i].active) {
-                break;
-            }
+        if (!floor->items[i].active && !item_slot_held(floor, i)) {
+            return i;
         }
     }
+    return -1;
 }
 
+static int free_npc_slot(const Floor* floor) {
+    for (int i = 0; i < MAX_NPCS; i++) {
+        if (!floor->npcs[i].active && !npc_slot_held(floor, i)) {
+            return i;
+        }
+    }
+    return -1;
+}
 
+// Put a room's item in its slot
+static void place_room_item(Floor* floor, int slot, const RoomContents* contents) {
+    floor->items[slot] = contents->item;
+    save_mark_dirty(&floor->items[slot], sizeof(Item));
+}
 
-// Add store to a room
-void place_store(Floor* floor, Room* room) {
-    // Find an empty spot in the room
-    int x = random_range(room->x + 2, room->x + room->width - 4);
-    int y = random_range(room->y + 2, room->y + room->height - 4);
+// Put a room's store in its NPC slot; its stock waits until it is opened
+static void place_store(Floor* floor, int slot, const RoomContents* contents) {
+    Store* store = alloc_store(floor);
+    if (!store) {
+        return;
+    }
     
-    // Create a store
-    for (int i = 0; i < MAX_NPCS; i++) {
-        if (!floor->npcs[i].active) {
-            floor->npcs[i] = (NPC){
-                .x = x,
-                .y = y,
-                .symbol = 'S',  // Store symbol
-                .active = TRUE,
-                .type = NPC_STOREKEEPER,
-                .store = (Store*)malloc(sizeof(Store))
-            };
-            
-            if (floor->npcs[i].store) {
-                // Initialize store with random type
-                StoreType store_type = get_store_type_from_int(rand() % 4);  // 0-3 for different store types
-                init_store(floor->npcs[i].store, store_type);
-            }
-            break;
+    save_mark_dirty(&floor->npcs[slot], sizeof(NPC));
+    save_mark_dirty(&floor->timers, sizeof(TimerWheel));
+    floor->npcs[slot] = (NPC){
+        .x = contents->store_x,
+        .y = contents->store_y,
+        .symbol = 'S',  // Store symbol
+        .active = TRUE,
+        .type = NPC_STOREKEEPER,
+        .store = floor->num_stores
+    };
+    
+    init_store(store, contents->store_type, contents->store_seed);
+    timer_add(&floor->timers, store->restock_turn, TIMER_STORE_RESTOCK, floor->num_stores - 1);
+}
+
+// Hold an item slot and an NPC slot for every room that rolls an item or a
+// store, in room order, while the floor is generated. Rooms seen later then
+// find their slots waiting, so the floor's capacity is shared out the same
+// way whatever order the rooms are revealed in.
+void reserve_room_slots(Floor* floor) {
+    for (int i = 0; i < floor->num_rooms; i++) {
+        Room* room = &floor->rooms[i];
+        Rng rng;
+        Rng* previous = use_room_rng(floor, i, &rng);
+        RoomContents contents;
+        roll_room_contents(room, &contents);
+        use_rng(previous);
+
+        room->item_slot = 0;
+        room->npc_slot = 0;
+        if (contents.has_item) {
+            room->item_slot = free_item_slot(floor) + 1;
+        }
+        if (contents.has_store) {
+            room->npc_slot = free_npc_slot(floor) + 1;
         }
     }
 }
 
+// Fill a room with its items, store and enemies the first time it is seen.
+// Contents are drawn from a stream seeded by the floor seed and room index
+// and go into slots held for the room since the floor was generated, so a
+// room comes out the same no matter when it is revealed.
+void populate_room(Floor* floor, int room_index) {
+    Room* room = &floor->rooms[room_index];
+    if (room->populated) {
+        return;
+    }
+    room->populated = 1;
+    save_mark_dirty(room, sizeof(Room));
+    save_mark_dirty(&floor->target_population, sizeof(floor->target_population));
+    
+    Rng rng;
+    Rng* previous = use_room_rng(floor, room_index, &rng);
+    RoomContents contents;
+    roll_room_contents(room, &contents);
+    
+    if (contents.has_item && room->item_slot) {
+        place_room_item(floor, room->item_slot - 1, &contents);
+    }
+    if (contents.has_store && room->npc_slot) {
+        place_store(floor, room->npc_slot - 1, &contents);
+    }
+    
+    // Skip enemies in the player's starting room on floor 0
+    if (!(floor == &CTX(floors)[0] && room_index == 0)) {
+        floor->target_population += spawn_room_enemies(room);
+    }
+    
+    use_rng(previous);
+}
+
+// Populate every room on a floor that has not been seen yet
+void populate_all_rooms(Floor* floor) {
+    for (int i = 0; i < floor->num_rooms; i++) {
+        populate_room(floor, i);
+    }
+}
 
 void generate_floor(Floor* floor) {
     // Clear the floor
+    enemy_pool_free(&floor->enemies);
     memset(floor, 0, sizeof(Floor));
+    save_mark_floor(floor);
+    floor->floor_num = (int)(floor - CTX(floors));
+    floor->seed = mix_seed(CTX(game_seed), (uint64_t)(floor - CTX(floors)));
+    start_floor_timers(floor);
     
     // Fill with walls
     for (int y = 0; y < MAP_HEIGHT; y++) {
@@ -423,6 +617,7 @@ void generate_floor(Floor* floor) {
             // Create room in map
             for (int y = new_room.y; y < new_room.y + new_room.height; y++) {
                 for (int x = new_room.x; x < new_room.x + new_room.width; x++) {
+                    floor->room_id[y][x] = (unsigned char)floor->num_rooms;
                     if (y == new_room.y || y == new_room.y + new_room.height - 1 ||
                         x == new_room.x || x == new_room.x + new_room.width - 1) {
                         floor->map[y][x] = '#';
@@ -450,31 +645,26 @@ void generate_floor(Floor* floor) {
                      current->y + current->height / 2);
     }
     
-    // Place random items in rooms
-    for (int i = 0; i < floor->num_rooms; i++) {
-        // 70% chance to place an item in each room
-        if (rand() % 100 < 70) {
-            place_random_item(floor, &floor->rooms[i]);
-        }
-    }
-    
-    // After placing rooms and items, add stores
-    for (int i = 0; i < floor->num_rooms; i++) {
-        Room* room = &floor->rooms[i];
-        
-        // 20% chance for each room to have a store
-        if (rand() % 5 == 0) {
-            place_store(floor, room);
-        }
-    }
-    
     // Set player position in first room if this is floor 0
-    if (current_floor == 0) 
+    if (CTX(current_floor) == 0) 
     {
         Room* first_room = &floor->rooms[0];
-        player.x = first_room->x + first_room->width / 2;
-        player.y = first_room->y + first_room->height / 2;
+        CTX(player).x = first_room->x + first_room->width / 2;
+        CTX(player).y = first_room->y + first_room->height / 2;
+    }
+}
+
+// Find a tile showing c, scanning row by row; returns 0 if there is none
+int find_map_tile(const Floor* floor, char c, int* x, int* y) {
+    for (int ty = 0; ty < MAP_HEIGHT; ty++) {
+        const char* row = memchr(floor->map[ty], c, MAP_WIDTH);
+        if (row) {
+            *x = (int)(row - floor->map[ty]);
+            *y = ty;
+            return 1;
+        }
     }
+    return 0;
 }
 
 // Check for items at player's position
@@ -485,24 +675,25 @@ void check_items() {
     for (int i = 0; i < MAX_ITEMS; i++) {
         if (!floor->items[i].active) continue;
         
-        if (player.x == floor->items[i].x && player.y == floor->items[i].y) {
+        if (CTX(player).x == floor->items[i].x && CTX(player).y == floor->items[i].y) {
             Item* item = &floor->items[i];
+            save_mark_dirty(item, sizeof(Item));
             
-            if (item->type == ITEM_KEY && item->key_id == current_floor + 1) {
+            if (item_type(item) == ITEM_KEY && item->key_id == CTX(current_floor) + 1) {
                 // Found the floor key
                 if (add_to_inventory(*item)) {
-                    add_message("Found %s! This will unlock the way forward.", item->name);
+                    add_message("Found %s! This will unlock the way forward.", item_name(item));
                     floor->items[i].active = 0;
                 } else {
                     add_message("Inventory full! Cannot pick up the floor key.");
                 }
-            } else if (item->type == ITEM_GOLD) {
-                player.gold += item->value;
+            } else if (item_type(item) == ITEM_GOLD) {
+                CTX(player).gold += item->value;
                 add_message("Picked up %d gold!", item->value);
                 floor->items[i].active = 0;
             } else {
                 if (add_to_inventory(floor->items[i])) {
-                    add_message("Picked up %s", item->name);
+                    add_message("Picked up %s", item_name(item));
                     floor->items[i].active = 0;
                 } else {
                     add_message("Inventory full!");
@@ -0,0 +1,288 @@
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "../include/memory.h"
+#include "../include/globals.h"
+#include "../include/enemy.h"
+
+// Every block starts with its size and tag. Sixteen bytes keep the block
+// itself as aligned as malloc's.
+typedef struct {
+    uint64_t size;
+    uint32_t tag;
+    uint32_t unused;
+} MemHeader;
+
+_Static_assert(sizeof(MemHeader) % alignof(max_align_t) == 0, "MemHeader must keep malloc's alignment");
+
+// Headers of the blocks now allocated, in an open-addressed table kept
+// at most half full. A block is only read once it is found here, so a
+// second free or a foreign pointer never touches memory the allocator
+// does not own.
+static struct {
+    pthread_mutex_t lock;
+    MemHeader** slots;
+    size_t capacity;  // A power of two, or 0 before the first block
+    size_t count;
+} live_blocks = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Heap counters, updated from any thread
+static struct {
+    atomic_llong live;
+    atomic_llong peak;
+    atomic_llong blocks;
+    atomic_llong allocations;
+} heap[MAX_MEM_TAGS];
+
+static atomic_llong mismatched_frees = 0;
+static atomic_llong bad_frees = 0;
+
+// In-place counts of the main game, updated by mem_sample
+static long long in_place_live[MAX_MEM_TAGS];
+static long long in_place_peak[MAX_MEM_TAGS];
+static int floors_generated = 0;
+
+static const char* tag_names[MAX_MEM_TAGS] = {
+    "map", "entities", "stores", "inventory", "messages", "caches", "io", "other"
+};
+
+static void charge(MemTag tag, long long bytes, long long blocks) {
+    long long live = atomic_fetch_add(&heap[tag].live, bytes) + bytes;
+    atomic_fetch_add(&heap[tag].blocks, blocks);
+    long long peak = atomic_load(&heap[tag].peak);
+    while (live > peak && !atomic_compare_exchange_weak(&heap[tag].peak, &peak, live)) {
+    }
+}
+
+static size_t live_slot(const MemHeader* header, size_t capacity) {
+    return (size_t)(((uintptr_t)header >> 4) * UINT64_C(0x9e3779b97f4a7c15) >> 32) & (capacity - 1);
+}
+
+// Callers hold the lock
+static void live_place(MemHeader* header) {
+    size_t i = live_slot(header, live_blocks.capacity);
+    while (live_blocks.slots[i]) {
+        i = (i + 1) & (live_blocks.capacity - 1);
+    }
+    live_blocks.slots[i] = header;
+    live_blocks.count++;
+}
+
+// The table itself stays off the books, as it is the books
+static int live_add(MemHeader* header) {
+    pthread_mutex_lock(&live_blocks.lock);
+    if ((live_blocks.count + 1) * 2 > live_blocks.capacity) {
+        size_t capacity = live_blocks.capacity ? live_blocks.capacity * 2 : 1024;
+        MemHeader** old = live_blocks.slots;
+        size_t old_capacity = live_blocks.capacity;
+        live_blocks.slots = calloc(capacity, sizeof(MemHeader*));
+        if (!live_blocks.slots) {
+            live_blocks.slots = old;
+            pthread_mutex_unlock(&live_blocks.lock);
+            return 0;
+        }
+        live_blocks.capacity = capacity;
+        live_blocks.count = 0;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old[i]) {
+                live_place(old[i]);
+            }
+        }
+        free(old);
+    }
+    live_place(header);
+    pthread_mutex_unlock(&live_blocks.lock);
+    return 1;
+}
+
+// Take a header out of the table, shifting back the entries that probed
+// past it; returns 0 when it was not there
+static int live_remove(const MemHeader* header) {
+    pthread_mutex_lock(&live_blocks.lock);
+    if (!live_blocks.capacity) {
+        pthread_mutex_unlock(&live_blocks.lock);
+        return 0;
+    }
+    size_t mask = live_blocks.capacity - 1;
+    size_t i = live_slot(header, live_blocks.capacity);
+    while (live_blocks.slots[i] && live_blocks.slots[i] != header) {
+        i = (i + 1) & mask;
+    }
+    if (!live_blocks.slots[i]) {
+        pthread_mutex_unlock(&live_blocks.lock);
+        return 0;
+    }
+    live_blocks.slots[i] = NULL;
+    live_blocks.count--;
+    for (size_t j = (i + 1) & mask; live_blocks.slots[j]; j = (j + 1) & mask) {
+        size_t home = live_slot(live_blocks.slots[j], live_blocks.capacity);
+        // Move the entry into the hole unless its home lies between them
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            live_blocks.slots[i] = live_blocks.slots[j];
+            live_blocks.slots[j] = NULL;
+            i = j;
+        }
+    }
+    pthread_mutex_unlock(&live_blocks.lock);
+    return 1;
+}
+
+// The header of a block, taken out of the live table, or NULL with the
+// free counted as bad when the block did not come from mem_alloc or was
+// freed already
+static MemHeader* block_header(void* block) {
+    MemHeader* header = (MemHeader*)block - 1;
+    if (!live_remove(header)) {
+        atomic_fetch_add(&bad_frees, 1);
+        fprintf(stderr, "mem: free of unknown or freed block %p\n", block);
+        return NULL;
+    }
+    return header;
+}
+
+void* mem_alloc(MemTag tag, size_t size) {
+    MemHeader* header = calloc(1, sizeof(MemHeader) + size);
+    if (!header) {
+        return NULL;
+    }
+    if (!live_add(header)) {
+        free(header);
+        return NULL;
+    }
+    header->size = size;
+    header->tag = (uint32_t)tag;
+    atomic_fetch_add(&heap[tag].allocations, 1);
+    charge(tag, (long long)size, 1);
+    return header + 1;
+}
+
+void* mem_realloc(MemTag tag, void* block, size_t size) {
+    if (!block) {
+        return mem_alloc(tag, size);
+    }
+    MemHeader* header = block_header(block);
+    if (!header) {
+        return NULL;
+    }
+    MemTag owner = (MemTag)header->tag;
+    uint64_t old_size = header->size;
+    MemHeader* grown = realloc(header, sizeof(MemHeader) + size);
+    // A failed realloc leaves the block as it was, still live. Either way
+    // the table has room, having just given up this block's entry.
+    live_add(grown ? grown : header);
+    if (!grown) {
+        return NULL;
+    }
+    grown->size = size;
+    charge(owner, (long long)size - (long long)old_size, 0);
+    return grown + 1;
+}
+
+// A block freed under another tag is still charged back to the tag it was
+// allocated under, and counted, since it means ownership went astray
+void mem_free(MemTag tag, void* block) {
+    if (!block) {
+        return;
+    }
+    MemHeader* header = block_header(block);
+    if (!header) {
+        return;
+    }
+    if (header->tag != (uint32_t)tag) {
+        atomic_fetch_add(&mismatched_frees, 1);
+    }
+    charge((MemTag)header->tag, -(long long)header->size, -1);
+    free(header);
+}
+
+// Bytes of a generated floor held in the floor itself, by tag. A pool
+// restored from a save lives in the save's mapping rather than the heap.
+static void floor_in_place(const Floor* floor, long long bytes[MAX_MEM_TAGS]) {
+    bytes[MEM_MAP] += sizeof(floor->map) + sizeof(floor->visible) + sizeof(floor->discovered) +
+                      sizeof(floor->terrain) + sizeof(floor->room_id) + sizeof(floor->rooms) +
+                      sizeof(floor->doors);
+    bytes[MEM_ENTITIES] += sizeof(floor->items) + sizeof(floor->npcs) + sizeof(floor->timers) + sizeof(EnemyPool);
+    if (floor->enemies.borrowed) {
+        bytes[MEM_ENTITIES] += (long long)enemy_pool_block_size(floor->enemies.capacity);
+    }
+    bytes[MEM_STORES] += sizeof(floor->stores);
+}
+
+// Floors never generated are zero pages the system has not had to back,
+// so only generated ones count. Sessions on other contexts leave the
+// counts alone.
+void mem_sample() {
+    if (game_ctx != main_game_context()) {
+        return;
+    }
+    const GameContext* ctx = main_game_context();
+    long long bytes[MAX_MEM_TAGS] = {0};
+    int generated = 0;
+    for (int i = 0; i < MAX_FLOORS; i++) {
+        if (ctx->floors[i].has_visited) {
+            floor_in_place(&ctx->floors[i], bytes);
+            generated++;
+        }
+    }
+    bytes[MEM_INVENTORY] += sizeof(ctx->player.inventory) + sizeof(ctx->player.equipment);
+    bytes[MEM_MESSAGES] += sizeof(ctx->message_log);
+
+    for (int tag = 0; tag < MAX_MEM_TAGS; tag++) {
+        in_place_live[tag] = bytes[tag];
+        in_place_peak[tag] = max(in_place_peak[tag], bytes[tag]);
+    }
+    floors_generated = generated;
+}
+
+void mem_stats(MemTag tag, MemStats* stats) {
+    stats->heap_live = atomic_load(&heap[tag].live);
+    stats->heap_peak = atomic_load(&heap[tag].peak);
+    stats->heap_blocks = atomic_load(&heap[tag].blocks);
+    stats->allocations = atomic_load(&heap[tag].allocations);
+    stats->in_place_live = in_place_live[tag];
+    stats->in_place_peak = in_place_peak[tag];
+}
+
+long long mem_mismatched_frees() {
+    return atomic_load(&mismatched_frees);
+}
+
+int mem_floors_generated() {
+    return floors_generated;
+}
+
+const char* mem_tag_name(MemTag tag) {
+    return tag_names[tag];
+}
+
+// Live and peak bytes of every tag, in place and on the heap, with the
+// blocks still allocated; peaks are per column, so they need not add up
+void mem_report(FILE* out) {
+    mem_sample();
+    MemStats total = {0};
+    fprintf(out, "%-10s %12s %12s %12s %12s %8s %8s\n", "memory", "in place KB", "peak KB",
+            "heap KB", "peak KB", "blocks", "allocs");
+    for (int tag = 0; tag < MAX_MEM_TAGS; tag++) {
+        MemStats stats;
+        mem_stats((MemTag)tag, &stats);
+        fprintf(out, "%-10s %12.1f %12.1f %12.1f %12.1f %8lld %8lld\n", tag_names[tag],
+                stats.in_place_live / 1024.0, stats.in_place_peak / 1024.0, stats.heap_live / 1024.0,
+                stats.heap_peak / 1024.0, stats.heap_blocks, stats.allocations);
+        total.in_place_live += stats.in_place_live;
+        total.heap_live += stats.heap_live;
+        total.heap_blocks += stats.heap_blocks;
+        total.allocations += stats.allocations;
+    }
+    fprintf(out, "%-10s %12.1f %12s %12.1f %12s %8lld %8lld\n", "total", total.in_place_live / 1024.0, "",
+            total.heap_live / 1024.0, "", total.heap_blocks, total.allocations);
+    fprintf(out, "floors: %d of %d generated, %.1f KB of floor storage\n", floors_generated, MAX_FLOORS,
+            sizeof(Floor) * MAX_FLOORS / 1024.0);
+    long long mismatched = atomic_load(&mismatched_frees);
+    long long bad = atomic_load(&bad_frees);
+    if (mismatched || bad) {
+        fprintf(out, "frees: %lld under the wrong tag, %lld of unknown or freed blocks\n", mismatched, bad);
+    }
+}
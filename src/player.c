@@ -2,58 +2,168 @@
 #include "../include/map.h"
 #include "../include/enemy.h"
 #include "../include/store.h"
+#include "../include/item.h"
+#include "../include/timer.h"
+#include "../include/autosave.h"
 
 
 // Initialize player
 void init_player() {
-    strcpy(player.name, "Hero");
-    player.symbol = '@';
-    player.health = 100;
-    player.max_health = 100;
-    player.level = 1;
-    player.exp = 0;
-    player.exp_next = 100;
-    player.power = 10;
-    player.defense = 5;
-    player.gold = 0;
-    player.num_items = 0;
+    strcpy(CTX(player).name, "Hero");
+    CTX(player).symbol = '@';
+    CTX(player).health = 100;
+    CTX(player).max_health = 100;
+    CTX(player).level = 1;
+    CTX(player).exp = 0;
+    CTX(player).exp_next = 100;
+    CTX(player).power = 10;
+    CTX(player).defense = 5;
+    CTX(player).gold = 0;
     
     // Clear inventory and equipment
-    memset(player.inventory, 0, sizeof(player.inventory));
-    for (int i = 0; i < MAX_EQUIPMENT_SLOTS; i++) {
-        player.equipment[i] = NULL;
-    }
+    memset(&CTX(player).inventory, 0, sizeof(CTX(player).inventory));
+    memset(CTX(player).equipment, 0, sizeof(CTX(player).equipment));
     
     // Initialize new fields
-    player.mana = 100;
-    player.max_mana = 100;
-    player.mana_regen = 5;
+    CTX(player).mana = 100;
+    CTX(player).max_mana = 100;
+    CTX(player).mana_regen = 5;
     for (int i = 0; i < MAX_STATUS_EFFECTS; i++) {
-        player.status[i].type = STATUS_NONE;
-        player.status[i].duration = 0;
-        player.status[i].power = 0;
+        CTX(player).status[i].type = STATUS_NONE;
+        CTX(player).status[i].duration = 0;
+        CTX(player).status[i].power = 0;
+        CTX(player).status[i].until = 0;
+        CTX(player).status[i].timer = TIMER_HANDLE_NONE;
     }
     for (int i = 0; i < MAX_ABILITIES; i++) {
-        player.abilities[i].type = ABILITY_NONE;
-        player.abilities[i].cooldown = 0;
-        player.abilities[i].current_cooldown = 0;
-        player.abilities[i].power = 0;
-        player.abilities[i].key = '\0';
-        strcpy(player.abilities[i].name, "None");
-        strcpy(player.abilities[i].description, "No ability");
-    }
-    player.num_abilities = 0;
-    player.critical_chance = 5;
-    player.dodge_chance = 5;
-    player.fire_resist = 0;
-    player.ice_resist = 0;
-    player.poison_resist = 0;
+        CTX(player).abilities[i].type = ABILITY_NONE;
+        CTX(player).abilities[i].cooldown = 0;
+        CTX(player).abilities[i].ready_turn = 0;
+        CTX(player).abilities[i].power = 0;
+        CTX(player).abilities[i].key = '\0';
+        strcpy(CTX(player).abilities[i].name, "None");
+        strcpy(CTX(player).abilities[i].description, "No ability");
+    }
+    CTX(player).num_abilities = 0;
+    timer_wheel_init(&CTX(player).timers, CTX(game_turn));
+    CTX(player).critical_chance = 5;
+    CTX(player).dodge_chance = 5;
+    CTX(player).fire_resist = 0;
+    CTX(player).ice_resist = 0;
+    CTX(player).poison_resist = 0;
+    refresh_player_stats();
+}
+
+// Rebuild the cached derived stats. Call whenever equipment, level or
+// status effects change.
+void refresh_player_stats() {
+    PlayerStats* stats = &CTX(player).stats;
+    
+    stats->attack = CTX(player).power;
+    stats->defense = CTX(player).defense;
+    stats->crit_chance = CTX(player).critical_chance;
+    stats->dodge_chance = CTX(player).dodge_chance;
+    stats->fire_resist = CTX(player).fire_resist;
+    stats->ice_resist = CTX(player).ice_resist;
+    stats->poison_resist = CTX(player).poison_resist;
+    
+    // Gear
+    for (int i = 0; i < MAX_EQUIPMENT_SLOTS; i++) {
+        const Item* item = &CTX(player).equipment[i];
+        if (!item->active) continue;
+        if (item_type(item) == ITEM_WEAPON) {
+            stats->attack += item->power;
+        } else if (item_type(item) == ITEM_ARMOR) {
+            stats->defense += item->power;
+        }
+    }
+    
+    // Status effects
+    for (int i = 0; i < MAX_STATUS_EFFECTS; i++) {
+        const StatusEffect* status = &CTX(player).status[i];
+        switch (status->type) {
+            case STATUS_BURN:
+                stats->defense -= status->power;
+                break;
+            case STATUS_BERSERK:
+                stats->attack += status->power;
+                stats->defense -= status->power;
+                break;
+            case STATUS_FREEZE:
+                stats->dodge_chance = 0;
+                break;
+            case STATUS_BLIND:
+                stats->crit_chance = 0;
+                break;
+            default:
+                break;
+        }
+    }
+    
+    stats->defense = max(0, stats->defense);
+}
+
+// Apply a status effect to the player, replacing one of the same type
+void apply_status_effect(StatusType type, int duration, int power) {
+    int slot = -1;
+    for (int i = 0; i < MAX_STATUS_EFFECTS; i++) {
+        if (CTX(player).status[i].type == type) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && CTX(player).status[i].type == STATUS_NONE) {
+            slot = i;
+        }
+    }
+    if (slot < 0) return;
+    
+    // Reapplying an effect replaces its expiry
+    StatusEffect* status = &CTX(player).status[slot];
+    timer_cancel(&CTX(player).timers, status->timer);
+    status->type = type;
+    status->duration = duration;
+    status->power = power;
+    status->until = CTX(game_turn) + duration;
+    status->timer = timer_add(&CTX(player).timers, status->until, TIMER_STATUS_EXPIRY, slot);
+    refresh_player_stats();
+}
+
+// Put an ability on cooldown from the current turn
+void start_ability_cooldown(int index) {
+    Ability* ability = &CTX(player).abilities[index];
+    ability->ready_turn = CTX(game_turn) + ability->cooldown;
+    timer_add(&CTX(player).timers, ability->ready_turn, TIMER_ABILITY_COOLDOWN, index);
+}
+
+static void fire_player_timer(void* ctx, TimerKind kind, int arg, int deadline) {
+    (void)deadline;
+    switch (kind) {
+        case TIMER_STATUS_EXPIRY:
+            CTX(player).status[arg].type = STATUS_NONE;
+            CTX(player).status[arg].timer = TIMER_HANDLE_NONE;
+            *(int*)ctx = 1;
+            break;
+        case TIMER_ABILITY_COOLDOWN:
+            add_message("%s is ready.", CTX(player).abilities[arg].name);
+            break;
+        default:
+            break;
+    }
+}
+
+// Expire the status effects and cooldowns due by the current turn
+void update_player_timers() {
+    int status_expired = 0;
+    timer_advance(&CTX(player).timers, CTX(game_turn), fire_player_timer, &status_expired);
+    if (status_expired) {
+        refresh_player_stats();
+    }
 }
 
 // Handle player movement and actions
 void move_player(int dx, int dy) {
-    int new_x = player.x + dx;
-    int new_y = player.y + dy;
+    int new_x = CTX(player).x + dx;
+    int new_y = CTX(player).y + dy;
     Floor* floor = current_floor_ptr();
     
     // Check if new position is within bounds
@@ -62,36 +172,39 @@ void move_player(int dx, int dy) {
     }
     
     // Check for enemies at the new position
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        Enemy* enemy = &floor->enemies[i];
-        if (enemy->active && enemy->x == new_x && enemy->y == new_y) {
-            // Attack the enemy
-            int damage = max(0, player.power - enemy->defense);
-            enemy->health -= damage;
-            
-            if (damage > 0) {
-                add_message("You hit %s for %d damage!", enemy->name, damage);
-            } else {
-                add_message("You attack %s but do no damage!", enemy->name);
-            }
-            
-            // Check if enemy died
-            if (enemy->health <= 0) {
-                kill_enemy(enemy);
-            }
-            return;
+    EnemyPool* pool = &floor->enemies;
+    int enemy = enemy_at(pool, new_x, new_y);
+    if (enemy >= 0) {
+        // Attack the enemy
+        const EnemyArchetype* archetype = enemy_archetype(pool, enemy);
+        int damage = max(0, CTX(player).stats.attack - archetype->defense);
+        pool->health[enemy] -= damage;
+        save_mark_enemies(pool);
+        make_noise(new_x, new_y, NOISE_RADIUS);
+        
+        if (damage > 0) {
+            add_message("You hit %s for %d damage!", archetype->name, damage);
+        } else {
+            add_message("You attack %s but do no damage!", archetype->name);
+        }
+        
+        // Check if enemy died
+        if (pool->health[enemy] <= 0) {
+            kill_enemy(enemy);
         }
+        return;
     }
     // check for store interaction
     for (int i = 0; i < MAX_NPCS; i++) {
         if (floor->npcs[i].active && 
             floor->npcs[i].type == NPC_STOREKEEPER &&
-            player.x + dx == floor->npcs[i].x && 
-            player.y + dy == floor->npcs[i].y) {
+            CTX(player).x + dx == floor->npcs[i].x && 
+            CTX(player).y + dy == floor->npcs[i].y) {
             
             // Display store interface
-            if (floor->npcs[i].store) {
-                display_store(floor->npcs[i].store);
+            Store* store = floor_store(floor, floor->npcs[i].store);
+            if (store) {
+                display_store(store);
             }
             return;
         }
@@ -101,16 +214,16 @@ void move_player(int dx, int dy) {
     // Check for locked stairs
     if (floor->map[new_y][new_x] == TERRAIN_LOCKED_STAIRS) {
         // Check inventory for floor key
-        for (int i = 0; i < player.num_items; i++) {
-            if (player.inventory[i].type == ITEM_KEY &&
-                player.inventory[i].key_id == current_floor + 1) {
-                // Unlock the stairs
-                floor->map[new_y][new_x] = '>';
-                add_message("You unlock the stairs with %s!", player.inventory[i].name);
-                remove_from_inventory(i);
-                floor->has_floor_key = 1;
-                return;
-            }
+        ItemHandle key = find_floor_key();
+        if (key != ITEM_HANDLE_NONE) {
+            // Unlock the stairs
+            floor->map[new_y][new_x] = '>';
+            save_mark_dirty(&floor->map[new_y][new_x], 1);
+            save_mark_dirty(&floor->has_floor_key, sizeof(floor->has_floor_key));
+            add_message("You unlock the stairs with %s!", item_name(inventory_item(key)));
+            remove_from_inventory(key);
+            floor->has_floor_key = 1;
+            return;
         }
         add_message("The stairs are locked. You need to find the floor key.");
         return;
@@ -122,8 +235,8 @@ void move_player(int dx, int dy) {
     }
     
     // Move player
-    player.x = new_x;
-    player.y = new_y;
+    CTX(player).x = new_x;
+    CTX(player).y = new_y;
     
     // Update field of view after movement
     update_fov();
@@ -132,164 +245,290 @@ void move_player(int dx, int dy) {
     check_player_items();
     
     // Handle stairs movement
-    if (new_x == player.x && new_y == player.y) {
+    if (new_x == CTX(player).x && new_y == CTX(player).y) {
         char current_tile = current_floor_ptr()->map[new_y][new_x];
         
         if (current_tile == '<') {  // Up stairs
-            if (current_floor > 0) {
-                current_floor--;
-                init_floor(current_floor);
+            if (CTX(current_floor) > 0) {
+                leave_floor();
+                CTX(current_floor)--;
+                init_floor(CTX(current_floor));
                 // Find up stairs on new floor
-                for (int y = 0; y < MAP_HEIGHT; y++) {
-                    for (int x = 0; x < MAP_WIDTH; x++) {
-                        if (current_floor_ptr()->map[y][x] == '>') {
-                            player.x = x;
-                            player.y = y;
-                            break;
-                        }
-                    }
-                }
+                find_map_tile(current_floor_ptr(), '>', &CTX(player).x, &CTX(player).y);
                 add_message("You climb up the stairs.");
             }
         } else if (current_tile == '>') {  // Down stairs (unlocked)
-            if (current_floor < MAX_FLOORS - 1) {
-                current_floor++;
-                init_floor(current_floor);
+            if (CTX(current_floor) < MAX_FLOORS - 1) {
+                leave_floor();
+                CTX(current_floor)++;
+                init_floor(CTX(current_floor));
                 // Find down stairs on new floor
-                for (int y = 0; y < MAP_HEIGHT; y++) {
-                    for (int x = 0; x < MAP_WIDTH; x++) {
-                        if (current_floor_ptr()->map[y][x] == '<') {
-                            player.x = x;
-                            player.y = y;
-                            break;
-                        }
-                    }
-                }
+                find_map_tile(current_floor_ptr(), '<', &CTX(player).x, &CTX(player).y);
                 add_message("You climb down the stairs.");
             }
         } else if (current_tile == '%') {  // Locked stairs
             // Check inventory for floor key
-            for (int i = 0; i < player.num_items; i++) {
-                if (player.inventory[i].type == ITEM_KEY &&
-                    player.inventory[i].key_id == current_floor + 1) {
-                    // Unlock the stairs
-                    current_floor_ptr()->map[new_y][new_x] = '>';
-                    add_message("You unlock the stairs with %s!", player.inventory[i].name);
-                    remove_from_inventory(i);
-                    current_floor_ptr()->has_floor_key = 1;
-                    return;
-                }
+            ItemHandle key = find_floor_key();
+            if (key != ITEM_HANDLE_NONE) {
+                // Unlock the stairs
+                current_floor_ptr()->map[new_y][new_x] = '>';
+                save_mark_dirty(&current_floor_ptr()->map[new_y][new_x], 1);
+                save_mark_dirty(&current_floor_ptr()->has_floor_key, sizeof(int));
+                add_message("You unlock the stairs with %s!", item_name(inventory_item(key)));
+                remove_from_inventory(key);
+                current_floor_ptr()->has_floor_key = 1;
+                return;
             }
             add_message("The stairs are locked. You need to find the floor key.");
             return;
         }
     }
     
-    game_turn++;
 }
 
 // Level up the player
 void level_up() {
-    player.level++;
-    player.max_health += 10;
-    player.health = player.max_health;
-    player.power += 2;
-    player.defense += 1;
-    player.exp_next = player.level * 100;
+    CTX(player).level++;
+    CTX(player).max_health += 10;
+    CTX(player).health = CTX(player).max_health;
+    CTX(player).power += 2;
+    CTX(player).defense += 1;
+    CTX(player).exp_next = CTX(player).level * 100;
     
     // Increase secondary stats
-    player.max_mana += 10;
-    player.mana = player.max_mana;
-    player.mana_regen += 1;
-    player.critical_chance += 1;
-    player.dodge_chance += 1;
-    
-    add_message("Level Up! You are now level %d", player.level);
+    CTX(player).max_mana += 10;
+    CTX(player).mana = CTX(player).max_mana;
+    CTX(player).mana_regen += 1;
+    CTX(player).critical_chance += 1;
+    CTX(player).dodge_chance += 1;
+    refresh_player_stats();
+    
+    add_message("Level Up! You are now level %d", CTX(player).level);
     add_message("Health +10, Power +2, Defense +1");
     add_message("Mana +10, Mana Regen +1");
     add_message("Critical Chance +1%%, Dodge Chance +1%%");
     
     // Learn new ability at certain levels
-    if (player.level == 2) {
+    if (CTX(player).level == 2) {
         add_ability(ABILITY_HEAL);
-    } else if (player.level == 3) {
+    } else if (CTX(player).level == 3) {
         add_ability(ABILITY_FIREBALL);
-    } else if (player.level == 4) {
+    } else if (CTX(player).level == 4) {
         add_ability(ABILITY_BLINK);
-    } else if (player.level == 5) {
+    } else if (CTX(player).level == 5) {
         add_ability(ABILITY_SHIELD);
-    } else if (player.level == 6) {
+    } else if (CTX(player).level == 6) {
         add_ability(ABILITY_RAGE);
     }
 }
 
+// Get the handle of an occupied inventory slot
+static ItemHandle inventory_handle(int slot) {
+    uint32_t generation = CTX(player).inventory.generation[slot];
+    return ((generation + 1) << ITEM_SLOT_BITS) | (uint32_t)slot;
+}
+
+// Resolve a handle to its slot, or -1 if the slot has been emptied
+static int inventory_slot(ItemHandle handle) {
+    int slot = (int)(handle & ITEM_SLOT_MASK);
+    if (handle == ITEM_HANDLE_NONE || slot >= MAX_INVENTORY || !CTX(player).inventory.count[slot]) {
+        return -1;
+    }
+    return inventory_handle(slot) == handle ? slot : -1;
+}
+
+// Get the item a handle refers to, or NULL if it is gone
+Item* inventory_item(ItemHandle handle) {
+    int slot = inventory_slot(handle);
+    return slot >= 0 ? &CTX(player).inventory.items[slot] : NULL;
+}
+
+// Get how many items are stacked behind a handle
+int inventory_count(ItemHandle handle) {
+    int slot = inventory_slot(handle);
+    return slot >= 0 ? CTX(player).inventory.count[slot] : 0;
+}
+
+// Get the handle of the item shown at a position on the inventory screen
+ItemHandle inventory_handle_at(int index) {
+    Inventory* inv = &CTX(player).inventory;
+    int slot = inv->order_head - 1;
+    while (slot >= 0 && index-- > 0) {
+        slot = inv->order_next[slot] - 1;
+    }
+    return slot >= 0 ? inventory_handle(slot) : ITEM_HANDLE_NONE;
+}
+
+// Find the key that unlocks the current floor's stairs
+ItemHandle find_floor_key() {
+    Inventory* inv = &CTX(player).inventory;
+    for (int slot = inv->order_head - 1; slot >= 0; slot = inv->order_next[slot] - 1) {
+        Item* item = &inv->items[slot];
+        if (item_type(item) == ITEM_KEY && item->key_id == CTX(current_floor) + 1) {
+            return inventory_handle(slot);
+        }
+    }
+    return ITEM_HANDLE_NONE;
+}
+
+// Whether item can be added to the stack already held in a slot
+static int stacks_with(const Item* held, int held_count, const Item* item) {
+    ItemType type = item_type(item);
+    if (type == ITEM_GOLD) {
+        return item_type(held) == ITEM_GOLD && held->value < INT16_MAX;
+    }
+    if (type != ITEM_POTION && type != ITEM_SCROLL && type != ITEM_FOOD) {
+        return 0;
+    }
+    return held_count < MAX_ITEM_STACK && held->proto == item->proto &&
+           held->power == item->power && held->value == item->value;
+}
+
 // Add item to inventory
-int add_to_inventory(Item item) {
-    if (player.num_items >= INVENTORY_SIZE) {
-        return 0;  // Inventory full
+ItemHandle add_to_inventory(Item item) {
+    Inventory* inv = &CTX(player).inventory;
+    int has_free_slot = inv->free_head || inv->used < INVENTORY_SIZE;
+    
+    // Gold merges into the piles held, each of which holds at most what
+    // Item.value can; what is left over starts a new pile. Gold that would
+    // need a pile with no slot for it is refused whole.
+    if (item_type(&item) == ITEM_GOLD) {
+        int room = 0;
+        for (int slot = inv->order_head - 1; slot >= 0; slot = inv->order_next[slot] - 1) {
+            if (stacks_with(&inv->items[slot], inv->count[slot], &item)) {
+                room += INT16_MAX - inv->items[slot].value;
+            }
+        }
+        if (item.value > room && !has_free_slot) {
+            return ITEM_HANDLE_NONE;
+        }
+        ItemHandle merged = ITEM_HANDLE_NONE;
+        for (int slot = inv->order_head - 1; slot >= 0 && item.value > 0; slot = inv->order_next[slot] - 1) {
+            Item* held = &inv->items[slot];
+            if (stacks_with(held, inv->count[slot], &item)) {
+                int moved = min(item.value, INT16_MAX - held->value);
+                held->value = (int16_t)(held->value + moved);
+                held->power = held->value;
+                item.value = (int16_t)(item.value - moved);
+                merged = inventory_handle(slot);
+            }
+        }
+        if (item.value == 0) {
+            return merged;
+        }
+        item.power = item.value;
+        if (merged != ITEM_HANDLE_NONE) {
+            add_message("Your gold piles are full; %d gold starts a new pile.", item.value);
+        }
+    } else {
+        // Stack onto an identical consumable
+        for (int slot = inv->order_head - 1; slot >= 0; slot = inv->order_next[slot] - 1) {
+            if (stacks_with(&inv->items[slot], inv->count[slot], &item)) {
+                inv->count[slot]++;
+                return inventory_handle(slot);
+            }
+        }
     }
     
-    player.inventory[player.num_items++] = item;
-    return 1;
+    // Take a freed slot, or one that has never been used
+    int slot;
+    if (inv->free_head) {
+        slot = inv->free_head - 1;
+        inv->free_head = inv->next_free[slot];
+    } else if (inv->used < INVENTORY_SIZE) {
+        slot = inv->used++;
+    } else {
+        return ITEM_HANDLE_NONE;  // Inventory full
+    }
+    
+    inv->items[slot] = item;
+    inv->count[slot] = 1;
+    
+    // Show it after everything already carried
+    inv->order_prev[slot] = (uint8_t)inv->order_tail;
+    inv->order_next[slot] = 0;
+    if (inv->order_tail) {
+        inv->order_next[inv->order_tail - 1] = (uint8_t)(slot + 1);
+    } else {
+        inv->order_head = slot + 1;
+    }
+    inv->order_tail = slot + 1;
+    inv->num_items++;
+    
+    return inventory_handle(slot);
 }
 
-// Remove item from inventory
-void remove_from_inventory(int index) {
-    if (index < 0 || index >= player.num_items) return;
+// Remove one item from the stack a handle refers to
+void remove_from_inventory(ItemHandle handle) {
+    Inventory* inv = &CTX(player).inventory;
+    int slot = inventory_slot(handle);
+    if (slot < 0) return;
     
-    // Set the item to inactive and ITEM_NONE
-    player.inventory[index].active = 0;
-    player.inventory[index].type = ITEM_NONE;
-    
-    // Shift all items after this one forward
-    for (int i = index; i < player.num_items - 1; i++) {
-        player.inventory[i] = player.inventory[i + 1];
+    if (--inv->count[slot] > 0) {
+        return;
     }
     
-    // Clear the last slot
-    player.inventory[player.num_items - 1].type = ITEM_NONE;
-    player.inventory[player.num_items - 1].active = 0;
+    // Unlink from the display order
+    int prev = inv->order_prev[slot];
+    int next = inv->order_next[slot];
+    if (prev) {
+        inv->order_next[prev - 1] = (uint8_t)next;
+    } else {
+        inv->order_head = next;
+    }
+    if (next) {
+        inv->order_prev[next - 1] = (uint8_t)prev;
+    } else {
+        inv->order_tail = prev;
+    }
     
-    // Decrease inventory size
-    player.num_items--;
+    // Free the slot; bumping the generation invalidates old handles
+    inv->items[slot].active = 0;
+    inv->items[slot].proto = ITEM_PROTO_NONE;
+    inv->generation[slot]++;
+    inv->next_free[slot] = (uint8_t)inv->free_head;
+    inv->free_head = slot + 1;
+    inv->num_items--;
 }
 
 // Use an item from inventory
-void use_item(Item* item) {
-    if (!item->active) return;
+void use_item(ItemHandle handle) {
+    Item* item = inventory_item(handle);
+    if (!item || !item->active) return;
     
-    switch (item->type) {
+    switch (item_type(item)) {
         case ITEM_WEAPON:
-            equip_weapon(*item);
-            add_message("Equipped %s", item->name);
-            break;
-            
         case ITEM_ARMOR:
-            equip_armor(*item);
-            add_message("Equipped %s", item->name);
+            equip_item(handle);
             break;
             
         case ITEM_POTION:
-            player.health = min(player.health + item->power, player.max_health);
+            CTX(player).health = min(CTX(player).health + item->power, CTX(player).max_health);
             add_message("Used potion, restored %d health", item->power);
-            item->active = 0;
+            remove_from_inventory(handle);
             break;
             
-        case ITEM_SCROLL:
-            add_message("Used scroll, gained temporary power!");
-            item->active = 0;
+        case ITEM_SCROLL: {
+            int frozen = freeze_enemies_near(CTX(player).x, CTX(player).y, FROST_RADIUS, FROST_TURNS + item->power);
+            if (frozen > 0) {
+                add_message("Frost from the scroll slows %d %s!", frozen, frozen == 1 ? "enemy" : "enemies");
+            } else {
+                add_message("Frost from the scroll finds nothing to slow.");
+            }
+            remove_from_inventory(handle);
             break;
+        }
             
         case ITEM_FOOD:
-            player.health = min(player.health + item->power, player.max_health);
+            CTX(player).health = min(CTX(player).health + item->power, CTX(player).max_health);
             add_message("Ate food, restored %d health", item->power);
-            item->active = 0;
+            remove_from_inventory(handle);
             break;
             
         case ITEM_GOLD:
-            player.gold += item->value;
+            CTX(player).gold += item->value;
             add_message("Added %d gold to wallet", item->value);
-            item->active = 0;
+            remove_from_inventory(handle);
             break;
             
         case ITEM_KEY:
@@ -301,31 +540,32 @@ void use_item(Item* item) {
     }
 }
 
-// Drop an item from inventory
-void drop_item(int index) {
+// Drop one item from an inventory stack
+void drop_item(ItemHandle handle) {
     Floor* floor = current_floor_ptr();
-    Item* item = &player.inventory[index];
+    Item* item = inventory_item(handle);
+    if (!item) return;
     
     // Find empty adjacent spot
     int dx[] = {0, 1, 0, -1};
     int dy[] = {-1, 0, 1, 0};
     
     for (int i = 0; i < 4; i++) {
-        int new_x = player.x + dx[i];
-        int new_y = player.y + dy[i];
+        int new_x = CTX(player).x + dx[i];
+        int new_y = CTX(player).y + dy[i];
         
         if (floor->map[new_y][new_x] == '.') {
-            // Place item on map
-            for (int j = 0; j < MAX_ITEMS; j++) {
-                if (!floor->items[j].active) {
-                    floor->items[j] = *item;
-                    floor->items[j].x = new_x;
-                    floor->items[j].y = new_y;
-                    floor->items[j].active = 1;
-                    remove_from_inventory(index);
-                    add_message("Dropped %s", item->name);
-                    return;
-                }
+            // Place item on map, leaving the slots held for unseen rooms
+            int j = free_item_slot(floor);
+            if (j >= 0) {
+                floor->items[j] = *item;
+                floor->items[j].x = new_x;
+                floor->items[j].y = new_y;
+                floor->items[j].active = 1;
+                save_mark_dirty(&floor->items[j], sizeof(Item));
+                add_message("Dropped %s", item_name(item));
+                remove_from_inventory(handle);
+                return;
             }
         }
     }
@@ -334,17 +574,17 @@ void drop_item(int index) {
 }
 
 // Equip an item
-void equip_item(int index) {
-    if (index < 0 || index >= player.num_items) {
+void equip_item(ItemHandle handle) {
+    Item* item = inventory_item(handle);
+    if (!item) {
         add_message("Invalid item index!");
         return;
     }
 
-    Item* item = &player.inventory[index];
     EquipmentSlot slot;
     
     // Determine equipment slot
-    switch (item->type) {
+    switch (item_type(item)) {
         case ITEM_WEAPON:
             slot = SLOT_WEAPON;
             break;
@@ -356,107 +596,63 @@ void equip_item(int index) {
             return;
     }
     
-    // Handle current equipped item if any
-    if (player.equipment[slot] != NULL) {
-        // Try to add current equipment to inventory
-        Item old_equipment = *player.equipment[slot];
-        free(player.equipment[slot]);
-        player.equipment[slot] = NULL;
-        
-        if (!add_to_inventory(old_equipment)) {
-            add_message("Inventory full! Cannot unequip current item.");
-            return;
-        }
-    }
+    // Take the item out of the inventory first so the slot it frees can
+    // hold whatever was equipped before
+    Item new_equipment = *item;
+    remove_from_inventory(handle);
     
-    // Create new equipment item
-    Item* new_equipment = (Item*)malloc(sizeof(Item));
-    if (new_equipment == NULL) {
-        add_message("Failed to allocate memory for equipment!");
-        return;
+    if (CTX(player).equipment[slot].active) {
+        add_to_inventory(CTX(player).equipment[slot]);
     }
     
-    // Copy item to equipment slot and remove from inventory
-    memcpy(new_equipment, item, sizeof(Item));
-    player.equipment[slot] = new_equipment;
-    
-    // Remove the item from inventory
-    remove_from_inventory(index);
-    
-    add_message("Equipped %s", new_equipment->name);
+    CTX(player).equipment[slot] = new_equipment;
+    refresh_player_stats();
+    add_message("Equipped %s", item_name(&new_equipment));
+}
+
+// Put an item into an equipment slot, returning what was there to the
+// inventory. Returns 0 if the inventory has no room for it.
+static int equip_in_slot(EquipmentSlot slot, Item item) {
+    if (CTX(player).equipment[slot].active && !add_to_inventory(CTX(player).equipment[slot])) {
+        return 0;
+    }
+    CTX(player).equipment[slot] = item;
+    refresh_player_stats();
+    add_message("Equipped %s", item_name(&item));
+    return 1;
 }
 
 // Equip a weapon
 void equip_weapon(Item weapon) {
-    // Unequip current weapon if any
-    if (player.equipment[SLOT_WEAPON]) {
-        // Add current weapon to inventory if possible
-        if (player.num_items < INVENTORY_SIZE) {
-            player.inventory[player.num_items++] = *player.equipment[SLOT_WEAPON];
-            free(player.equipment[SLOT_WEAPON]);
-        } else {
-            add_message("Inventory full! Cannot unequip current weapon.");
-            return;
-        }
+    if (!equip_in_slot(SLOT_WEAPON, weapon)) {
+        add_message("Inventory full! Cannot unequip current weapon.");
     }
-    
-    // Create new weapon item
-    Item* new_weapon = (Item*)malloc(sizeof(Item));
-    if (!new_weapon) {
-        add_message("Failed to allocate memory for weapon!");
-        return;
-    }
-    *new_weapon = weapon;
-    
-    // Equip new weapon
-    player.equipment[SLOT_WEAPON] = new_weapon;
-    add_message("Equipped %s", weapon.name);
 }
 
 // Equip armor
 void equip_armor(Item armor) {
-    // Unequip current armor if any
-    if (player.equipment[SLOT_ARMOR]) {
-        // Add current armor to inventory if possible
-        if (player.num_items < INVENTORY_SIZE) {
-            player.inventory[player.num_items++] = *player.equipment[SLOT_ARMOR];
-            free(player.equipment[SLOT_ARMOR]);
-        } else {
-            add_message("Inventory full! Cannot unequip current armor.");
-            return;
-        }
+    if (!equip_in_slot(SLOT_ARMOR, armor)) {
+        add_message("Inventory full! Cannot unequip current armor.");
     }
-    
-    // Create new armor item
-    Item* new_armor = (Item*)malloc(sizeof(Item));
-    if (!new_armor) {
-        add_message("Failed to allocate memory for armor!");
-        return;
-    }
-    *new_armor = armor;
-    
-    // Equip new armor
-    player.equipment[SLOT_ARMOR] = new_armor;
-    add_message("Equipped %s", armor.name);
 }
 
 // Add ability to player
 void add_ability(AbilityType type) {
-    if (player.num_abilities >= MAX_ABILITIES) {
+    if (CTX(player).num_abilities >= MAX_ABILITIES) {
         add_message("Cannot learn more abilities!");
         return;
     }
     
     Ability ability;
     ability.type = type;
-    ability.current_cooldown = 0;
+    ability.ready_turn = 0;
     
     switch(type) {
         case ABILITY_HEAL:
             strcpy(ability.name, "Heal");
             strcpy(ability.description, "Restore health using mana");
             ability.cooldown = 5;
-            ability.power = 20 + player.level * 5;
+            ability.power = 20 + CTX(player).level * 5;
             ability.key = '1';
             break;
             
@@ -464,7 +660,7 @@ void add_ability(AbilityType type) {
             strcpy(ability.name, "Fireball");
             strcpy(ability.description, "Launch a ball of fire at enemies");
             ability.cooldown = 3;
-            ability.power = 15 + player.level * 3;
+            ability.power = 15 + CTX(player).level * 3;
             ability.key = '2';
             break;
             
@@ -480,7 +676,7 @@ void add_ability(AbilityType type) {
             strcpy(ability.name, "Shield");
             strcpy(ability.description, "Temporarily increase defense");
             ability.cooldown = 10;
-            ability.power = 10 + player.level * 2;
+            ability.power = 10 + CTX(player).level * 2;
             ability.key = '4';
             break;
             
@@ -488,7 +684,7 @@ void add_ability(AbilityType type) {
             strcpy(ability.name, "Rage");
             strcpy(ability.description, "Temporarily increase attack power");
             ability.cooldown = 15;
-            ability.power = 15 + player.level * 2;
+            ability.power = 15 + CTX(player).level * 2;
             ability.key = '5';
             break;
             
@@ -496,7 +692,7 @@ void add_ability(AbilityType type) {
             return;
     }
     
-    player.abilities[player.num_abilities++] = ability;
+    CTX(player).abilities[CTX(player).num_abilities++] = ability;
     add_message("Learned new ability: %s!", ability.name);
 }
 
@@ -507,24 +703,25 @@ void check_player_items() {
     for (int i = 0; i < MAX_ITEMS; i++) {
         if (!floor->items[i].active) continue;
         
-        if (player.x == floor->items[i].x && player.y == floor->items[i].y) {
+        if (CTX(player).x == floor->items[i].x && CTX(player).y == floor->items[i].y) {
             Item* item = &floor->items[i];
+            save_mark_dirty(item, sizeof(Item));
             
-            if (item->type == ITEM_KEY && item->key_id == current_floor + 1) {
+            if (item_type(item) == ITEM_KEY && item->key_id == CTX(current_floor) + 1) {
                 // Found the floor key
                 if (add_to_inventory(*item)) {
-                    add_message("Found %s! This will unlock the way forward.", item->name);
+                    add_message("Found %s! This will unlock the way forward.", item_name(item));
                     floor->items[i].active = 0;
                 } else {
                     add_message("Inventory full! Cannot pick up the floor key.");
                 }
-            } else if (item->type == ITEM_GOLD) {
-                player.gold += item->value;
+            } else if (item_type(item) == ITEM_GOLD) {
+                CTX(player).gold += item->value;
                 add_message("Picked up %d gold!", item->value);
                 floor->items[i].active = 0;
             } else {
                 if (add_to_inventory(floor->items[i])) {
-                    add_message("Picked up %s", item->name);
+                    add_message("Picked up %s", item_name(item));
                     floor->items[i].active = 0;
                 } else {
                     add_message("Inventory full!");
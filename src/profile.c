@@ -0,0 +1,123 @@
+#include "../include/profile.h"
+#include "../include/trace.h"
+
+// Log-linear histogram buckets: exact below 8 ns, then 8 buckets per
+// power of two, which keeps every bucket within 1/8 of its values and
+// reaches past an hour
+#define SUB_BITS 3
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define HISTOGRAM_BUCKETS 320
+
+typedef struct {
+    long long total_ns;
+    long long frame_ns;    // Charged so far in the frame being timed
+    int frame_spans;       // Spans so far in that frame
+    long long last_ns;
+    long long max_ns;
+    int frames;            // Frames that ran the phase
+    uint32_t histogram[HISTOGRAM_BUCKETS];
+} PhaseRecord;
+
+// Per thread, so sessions stepped on the pool do not race on the records
+static _Thread_local PhaseRecord records[MAX_PROFILE_PHASES];
+
+static const char* phase_names[MAX_PROFILE_PHASES] = {
+    [PROFILE_FOV] = "fov",
+    [PROFILE_PLAYER] = "player",
+    [PROFILE_AI] = "ai",
+    [PROFILE_STATUSES] = "statuses",
+    [PROFILE_REGEN] = "regen",
+    [PROFILE_BOOKKEEPING] = "bookkeeping",
+    [PROFILE_RENDER_MAP] = "render map",
+    [PROFILE_RENDER_MESSAGES] = "render msgs",
+    [PROFILE_RENDER_STATUS] = "render stat",
+    [PROFILE_REFRESH] = "refresh",
+};
+
+static int histogram_bucket(long long ns) {
+    uint64_t value = ns > 0 ? (uint64_t)ns : 0;
+    if (value < SUB_BUCKETS) {
+        return (int)value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return min((exponent - SUB_BITS + 1) * SUB_BUCKETS + sub, HISTOGRAM_BUCKETS - 1);
+}
+
+// Largest value that falls in a bucket
+static long long bucket_limit(int bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    int exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+    long long mantissa = SUB_BUCKETS | (bucket % SUB_BUCKETS);
+    return ((mantissa + 1) << (exponent - SUB_BITS)) - 1;
+}
+
+// Smallest bucket limit that at least fraction of the frames stay within
+static long long histogram_percentile(const PhaseRecord* record, double fraction) {
+    long long target = (long long)(fraction * record->frames + 0.999999);
+    long long seen = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        seen += record->histogram[bucket];
+        if (seen >= target && seen > 0) {
+            return min(bucket_limit(bucket), record->max_ns);
+        }
+    }
+    return record->max_ns;
+}
+
+long long profile_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void profile_end(ProfilePhase phase, long long start) {
+    long long ns = profile_now_ns() - start;
+    PhaseRecord* record = &records[phase];
+    record->total_ns += ns;
+    record->frame_ns += ns;
+    record->frame_spans++;
+    if (trace_active()) {
+        trace_span(phase_names[phase], start, NULL, 0);
+    }
+}
+
+// A phase may run more than once a frame (field of view is updated after
+// every step); its frame time is the sum
+void profile_frame_end() {
+    for (int phase = 0; phase < MAX_PROFILE_PHASES; phase++) {
+        PhaseRecord* record = &records[phase];
+        if (!record->frame_spans) {
+            continue;
+        }
+        record->last_ns = record->frame_ns;
+        record->max_ns = max(record->max_ns, record->frame_ns);
+        record->histogram[histogram_bucket(record->frame_ns)]++;
+        record->frames++;
+        record->frame_ns = 0;
+        record->frame_spans = 0;
+    }
+}
+
+void profile_reset() {
+    memset(records, 0, sizeof(records));
+}
+
+long long profile_phase_ns(ProfilePhase phase) {
+    return records[phase].total_ns;
+}
+
+void profile_phase_stats(ProfilePhase phase, ProfileStats* stats) {
+    const PhaseRecord* record = &records[phase];
+    stats->last_ns = record->last_ns;
+    stats->p50_ns = histogram_percentile(record, 0.50);
+    stats->p99_ns = histogram_percentile(record, 0.99);
+    stats->max_ns = record->max_ns;
+    stats->frames = record->frames;
+}
+
+const char* profile_phase_name(ProfilePhase phase) {
+    return phase_names[phase];
+}
@@ -0,0 +1,225 @@
+#include "../include/replay.h"
+#include "../include/globals.h"
+#include "../include/map.h"
+#include "../include/memory.h"
+
+static FILE* record_file = NULL;
+static int record_interval = 0;
+
+static unsigned char* replay_data = NULL;
+static size_t replay_size = 0;
+static size_t replay_pos = 0;
+static int replay_interval = 0;
+static int replay_diverged = 0;
+
+static void put_le(unsigned char* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const unsigned char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint32_t fnv1a(uint32_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// FNV-1a hash of the state a desync would show up in first: the turn,
+// the random stream, the player and every enemy on the current floor
+uint32_t game_state_checksum() {
+    uint32_t hash = 2166136261u;
+    int values[] = {
+        CTX(game_turn), CTX(current_floor), CTX(player).x, CTX(player).y, CTX(player).health, CTX(player).mana,
+        CTX(player).gold, CTX(player).level, CTX(player).exp, CTX(kill_count)
+    };
+    hash = fnv1a(hash, values, sizeof(values));
+    hash = fnv1a(hash, &CTX(game_rng).state, sizeof(CTX(game_rng).state));
+
+    const EnemyPool* pool = &current_floor_ptr()->enemies;
+    for (int slot = 0; slot < pool->capacity; slot++) {
+        if (pool->active[slot]) {
+            int enemy[] = {slot, pool->x[slot], pool->y[slot], pool->health[slot]};
+            hash = fnv1a(hash, enemy, sizeof(enemy));
+        }
+    }
+    return hash;
+}
+
+int start_recording(const char* path, uint64_t seed, int checksum_interval) {
+    record_file = fopen(path, "wb");
+    if (!record_file) {
+        return 0;
+    }
+    record_interval = max(0, min(checksum_interval, 0xFFFF));
+
+    unsigned char header[REPLAY_HEADER_SIZE];
+    memcpy(header, REPLAY_MAGIC, 4);
+    put_le(header + 4, REPLAY_VERSION, 2);
+    put_le(header + 6, (uint64_t)record_interval, 2);
+    put_le(header + 8, seed, 8);
+    fwrite(header, 1, sizeof(header), record_file);
+    return 1;
+}
+
+int recording() {
+    return record_file != NULL;
+}
+
+void record_input(int input) {
+    if (!record_file) {
+        return;
+    }
+    if (input >= 0 && input < 0x80) {
+        fputc(input, record_file);
+    } else {
+        unsigned char wide[5] = {REPLAY_WIDE_KEY};
+        put_le(wide + 1, (uint32_t)input, 4);
+        fwrite(wide, 1, sizeof(wide), record_file);
+    }
+}
+
+// Flushed every turn so a crash loses at most the turn it happened on
+void record_turn() {
+    if (!record_file) {
+        return;
+    }
+    if (record_interval > 0 && CTX(game_turn) % record_interval == 0) {
+        unsigned char checksum[9] = {REPLAY_CHECKSUM};
+        put_le(checksum + 1, (uint32_t)CTX(game_turn), 4);
+        put_le(checksum + 5, game_state_checksum(), 4);
+        fwrite(checksum, 1, sizeof(checksum), record_file);
+    }
+    fflush(record_file);
+}
+
+void stop_recording() {
+    if (record_file) {
+        fclose(record_file);
+        record_file = NULL;
+    }
+}
+
+// Load a whole log and check its header
+int open_replay(const char* path, uint64_t* seed) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    close_replay();
+    replay_data = size > 0 ? mem_alloc(MEM_IO, (size_t)size) : NULL;
+    if (!replay_data || fread(replay_data, 1, (size_t)size, file) != (size_t)size) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        fclose(file);
+        close_replay();
+        return 0;
+    }
+    fclose(file);
+    replay_size = (size_t)size;
+
+    if (replay_size < REPLAY_HEADER_SIZE || memcmp(replay_data, REPLAY_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s is not an input log\n", path);
+        close_replay();
+        return 0;
+    }
+    int version = (int)get_le(replay_data + 4, 2);
+    if (version != REPLAY_VERSION) {
+        fprintf(stderr, "%s is version %d, expected %d\n", path, version, REPLAY_VERSION);
+        close_replay();
+        return 0;
+    }
+    replay_interval = (int)get_le(replay_data + 6, 2);
+    *seed = get_le(replay_data + 8, 8);
+    replay_pos = REPLAY_HEADER_SIZE;
+    replay_diverged = 0;
+    return 1;
+}
+
+// Next recorded command. A whole checksum record here means the replay
+// has fallen out of step with the log, so playback ends as diverged; one
+// cut short at the end of the log is where a crash stopped the recording.
+int replay_next_input(int* input) {
+    if (replay_pos >= replay_size) {
+        return 0;
+    }
+    if (replay_data[replay_pos] == REPLAY_CHECKSUM) {
+        if (replay_pos + 9 > replay_size) {
+            return 0;
+        }
+        fprintf(stderr, "Replay diverged at turn %d: the log has a checksum record where a command was expected\n",
+                CTX(game_turn));
+        replay_diverged = 1;
+        return 0;
+    }
+    if (replay_data[replay_pos] == REPLAY_WIDE_KEY) {
+        if (replay_pos + 5 > replay_size) {
+            return 0;
+        }
+        *input = (int)(int32_t)get_le(replay_data + replay_pos + 1, 4);
+        replay_pos += 5;
+        return 1;
+    }
+    *input = replay_data[replay_pos++];
+    return 1;
+}
+
+// A checksum record is checked whenever it comes next, whatever the turn,
+// so turns that drift from the log's are caught at the first record out
+// of place. A checkpoint turn without its record is a divergence too,
+// unless the log ends there.
+int check_replay_turn() {
+    if (!replay_data || replay_interval <= 0) {
+        return 1;
+    }
+    if (replay_pos >= replay_size || replay_data[replay_pos] != REPLAY_CHECKSUM) {
+        if (CTX(game_turn) % replay_interval != 0 || replay_pos >= replay_size) {
+            return 1;
+        }
+        fprintf(stderr, "Replay diverged at turn %d: the log has a command where a checksum record was expected\n",
+                CTX(game_turn));
+        replay_diverged = 1;
+        return 0;
+    }
+    if (replay_pos + 9 > replay_size) {
+        // A log cut short by a crash simply ends here
+        return 1;
+    }
+
+    int turn = (int)get_le(replay_data + replay_pos + 1, 4);
+    uint32_t expected = (uint32_t)get_le(replay_data + replay_pos + 5, 4);
+    replay_pos += 9;
+
+    uint32_t actual = game_state_checksum();
+    if (turn != CTX(game_turn) || expected != actual) {
+        fprintf(stderr, "Replay diverged at turn %d: recorded turn %d checksum %08x, got %08x\n",
+                CTX(game_turn), turn, expected, actual);
+        replay_diverged = 1;
+        return 0;
+    }
+    return 1;
+}
+
+int replay_has_diverged() {
+    return replay_diverged;
+}
+
+void close_replay() {
+    mem_free(MEM_IO, replay_data);
+    replay_data = NULL;
+    replay_size = 0;
+    replay_pos = 0;
+}
@@ -0,0 +1,359 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../include/save.h"
+#include "../include/globals.h"
+#include "../include/enemy.h"
+#include "../include/autosave.h"
+#include "../include/memory.h"
+
+// Mapping of the save the floors currently live in, if any
+static void* save_mapping = NULL;
+static size_t save_mapping_size = 0;
+
+static inline uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// 64-bit checksum over four independent lanes of 8-byte words, fast enough
+// to cover a whole dungeon on every save and load
+uint64_t save_checksum(const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL, prime2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t lanes[4] = {prime1, prime2, 0, (uint64_t)size};
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, bytes + i + lane * 8, sizeof(word));
+            lanes[lane] = rotl64(lanes[lane] + word * prime2, 31) * prime1;
+        }
+    }
+    uint64_t hash = (uint64_t)size;
+    for (int lane = 0; lane < 4; lane++) {
+        hash = mix_seed(hash, lanes[lane]);
+    }
+    for (; i < size; i++) {
+        hash = mix_seed(hash, bytes[i]);
+    }
+    return hash;
+}
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static uint64_t pages_in(uint64_t size) {
+    return (size + SAVE_PAGE - 1) / SAVE_PAGE;
+}
+
+// Lay out a save of the game as it is now: the game state on the page after
+// the header, then the floors, then each enemy pool on pages of its own so
+// that a pool can be rewritten without touching its neighbours
+void save_layout(SaveHeader* header) {
+    memset(header, 0, sizeof(SaveHeader));
+    memcpy(header->magic, SAVE_MAGIC, sizeof(header->magic));
+    header->version = SAVE_VERSION;
+    header->header_size = sizeof(SaveHeader);
+    header->page_size = SAVE_PAGE;
+    header->num_floors = MAX_FLOORS;
+    header->floor_size = sizeof(Floor);
+    header->game_size = sizeof(SaveGameState);
+    header->enemy_pool_size = sizeof(EnemyPool);
+
+    uint64_t enemies_size = 0;
+    for (int i = 0; i < MAX_FLOORS; i++) {
+        header->enemy_offsets[i] = enemies_size;
+        enemies_size += align_up(enemy_pool_block_size(CTX(floors)[i].enemies.capacity), SAVE_PAGE);
+    }
+
+    uint64_t sizes[SAVE_SECTION_PAGE_SUMS] = {sizeof(SaveGameState), sizeof(Floor) * MAX_FLOORS, enemies_size};
+    uint64_t offset = SAVE_PAGE;
+    for (int i = 0; i < SAVE_SECTION_PAGE_SUMS; i++) {
+        header->sections[i].offset = offset;
+        header->sections[i].size = sizes[i];
+        offset += align_up(sizes[i], SAVE_PAGE);
+    }
+    SaveSection* sums = &header->sections[SAVE_SECTION_PAGE_SUMS];
+    sums->offset = offset;
+    sums->size = (offset / SAVE_PAGE - 1) * sizeof(uint64_t);
+    header->num_pages = (offset + align_up(sums->size, SAVE_PAGE)) / SAVE_PAGE;
+}
+
+void save_capture_state(SaveGameState* state) {
+    memset(state, 0, sizeof(SaveGameState));
+    state->game_turn = CTX(game_turn);
+    state->current_floor = CTX(current_floor);
+    state->kill_count = CTX(kill_count);
+    state->gold_collected = CTX(gold_collected);
+    state->game_seed = CTX(game_seed);
+    state->game_rng = CTX(game_rng);
+    state->player = CTX(player);
+    state->message_log = CTX(message_log);
+}
+
+// Pages from the one after the header up to the checksum table
+uint64_t save_data_pages(const SaveHeader* header) {
+    return header->sections[SAVE_SECTION_PAGE_SUMS].offset / SAVE_PAGE - 1;
+}
+
+// Copy page of a save laid out by header into out, zero padded
+void save_fill_page(const SaveHeader* header, const SaveGameState* state, uint64_t page, char* out) {
+    uint64_t offset = page * SAVE_PAGE;
+    const char* data = NULL;
+    uint64_t size = 0;
+
+    const SaveSection* game = &header->sections[SAVE_SECTION_GAME];
+    const SaveSection* saved_floors = &header->sections[SAVE_SECTION_FLOORS];
+    const SaveSection* enemies = &header->sections[SAVE_SECTION_ENEMIES];
+    if (offset >= game->offset && offset < game->offset + game->size) {
+        data = (const char*)state + (offset - game->offset);
+        size = game->offset + game->size - offset;
+    } else if (offset >= saved_floors->offset && offset < saved_floors->offset + saved_floors->size) {
+        data = (const char*)CTX(floors) + (offset - saved_floors->offset);
+        size = saved_floors->offset + saved_floors->size - offset;
+    } else if (offset >= enemies->offset && offset < enemies->offset + enemies->size) {
+        for (int i = 0; i < MAX_FLOORS; i++) {
+            const EnemyPool* pool = &CTX(floors)[i].enemies;
+            uint64_t start = enemies->offset + header->enemy_offsets[i];
+            uint64_t block_size = enemy_pool_block_size(pool->capacity);
+            if (pool->block && offset >= start && offset < start + block_size) {
+                data = (const char*)pool->block + (offset - start);
+                size = start + block_size - offset;
+                break;
+            }
+        }
+    }
+
+    size = min(size, (uint64_t)SAVE_PAGE);
+    if (size) {
+        memcpy(out, data, size);
+    }
+    memset(out + size, 0, SAVE_PAGE - size);
+}
+
+// Write all of size bytes at offset
+int save_write(int fd, const void* data, size_t size, uint64_t offset) {
+    const char* bytes = data;
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, (off_t)offset);
+        if (written <= 0) {
+            return 0;
+        }
+        bytes += written;
+        size -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return 1;
+}
+
+// Finish a save whose data pages are written: store the page checksums,
+// sync, then write the header that makes the file valid and sync again.
+// Until the header lands a reader sees the file as it was before.
+int save_commit(int fd, SaveHeader* header, const uint64_t* page_sums) {
+    SaveSection* sums = &header->sections[SAVE_SECTION_PAGE_SUMS];
+    for (int i = 0; i < SAVE_SECTION_PAGE_SUMS; i++) {
+        SaveSection* section = &header->sections[i];
+        uint64_t first = section->offset / SAVE_PAGE - 1;
+        section->checksum = save_checksum(page_sums + first, pages_in(section->size) * sizeof(uint64_t));
+    }
+    sums->checksum = save_checksum(page_sums, sums->size);
+    header->checksum = save_checksum(header, offsetof(SaveHeader, checksum));
+
+    char page[SAVE_PAGE] = {0};
+    memcpy(page, header, sizeof(SaveHeader));
+    return ftruncate(fd, (off_t)(header->num_pages * SAVE_PAGE)) == 0 &&
+           save_write(fd, page_sums, sums->size, sums->offset) &&
+           fdatasync(fd) == 0 &&
+           save_write(fd, page, SAVE_PAGE, 0) &&
+           fdatasync(fd) == 0;
+}
+
+// Write the game to path through a temporary file, so a failed save never
+// clobbers the old one and a mapped save is never rewritten underneath us
+int save_game(const char* path) {
+    SaveGameState state;
+    save_capture_state(&state);
+    SaveHeader header;
+    save_layout(&header);
+
+    uint64_t data_pages = save_data_pages(&header);
+    uint64_t* page_sums = mem_alloc(MEM_IO, data_pages * sizeof(uint64_t));
+    if (!page_sums) {
+        return 0;
+    }
+
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int ok = fd >= 0;
+    if (ok) {
+        // Write in runs of pages to keep the system calls down
+        static char run[SAVE_PAGE * 64];
+        for (uint64_t first = 0; ok && first < data_pages; first += 64) {
+            uint64_t count = min(data_pages - first, (uint64_t)64);
+            for (uint64_t i = 0; i < count; i++) {
+                char* page = run + i * SAVE_PAGE;
+                save_fill_page(&header, &state, first + i + 1, page);
+                page_sums[first + i] = save_checksum(page, SAVE_PAGE);
+            }
+            ok = save_write(fd, run, count * SAVE_PAGE, (first + 1) * SAVE_PAGE);
+        }
+        ok = ok && save_commit(fd, &header, page_sums);
+        ok = close(fd) == 0 && ok;
+        ok = ok && rename(temp_path, path) == 0;
+        if (!ok) {
+            remove(temp_path);
+        }
+    }
+    mem_free(MEM_IO, page_sums);
+    return ok;
+}
+
+static int section_in_file(const SaveSection* section, uint64_t num_pages) {
+    return section->offset % SAVE_PAGE == 0 && section->offset >= SAVE_PAGE &&
+           section->offset / SAVE_PAGE + pages_in(section->size) <= num_pages;
+}
+
+// Check everything about a mapped save before the game is pointed at it:
+// the header, the checksum table, and every page against the table
+static int validate_save(char* base, size_t size) {
+    if (size < SAVE_PAGE) {
+        return 0;
+    }
+    const SaveHeader* header = (const SaveHeader*)base;
+    if (memcmp(header->magic, SAVE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SAVE_VERSION ||
+        header->header_size != sizeof(SaveHeader) ||
+        header->checksum != save_checksum(header, offsetof(SaveHeader, checksum)) ||
+        header->page_size != SAVE_PAGE ||
+        header->num_floors != MAX_FLOORS ||
+        header->floor_size != sizeof(Floor) ||
+        header->game_size != sizeof(SaveGameState) ||
+        header->enemy_pool_size != sizeof(EnemyPool) ||
+        header->num_pages > size / SAVE_PAGE) {
+        return 0;
+    }
+    for (int i = 0; i < MAX_SAVE_SECTIONS; i++) {
+        if (!section_in_file(&header->sections[i], header->num_pages)) {
+            return 0;
+        }
+    }
+    const SaveSection* sums = &header->sections[SAVE_SECTION_PAGE_SUMS];
+    uint64_t data_pages = save_data_pages(header);
+    if (header->sections[SAVE_SECTION_GAME].offset != SAVE_PAGE ||
+        header->sections[SAVE_SECTION_GAME].size != sizeof(SaveGameState) ||
+        header->sections[SAVE_SECTION_FLOORS].size != sizeof(Floor) * MAX_FLOORS ||
+        sums->size != data_pages * sizeof(uint64_t)) {
+        return 0;
+    }
+
+    const uint64_t* page_sums = (const uint64_t*)(base + sums->offset);
+    if (sums->checksum != save_checksum(page_sums, sums->size)) {
+        return 0;
+    }
+    for (int i = 0; i < SAVE_SECTION_PAGE_SUMS; i++) {
+        const SaveSection* section = &header->sections[i];
+        uint64_t first = section->offset / SAVE_PAGE - 1;
+        if (first + pages_in(section->size) > data_pages ||
+            section->checksum != save_checksum(page_sums + first, pages_in(section->size) * sizeof(uint64_t))) {
+            return 0;
+        }
+    }
+    for (uint64_t page = 0; page < data_pages; page++) {
+        if (page_sums[page] != save_checksum(base + (page + 1) * SAVE_PAGE, SAVE_PAGE)) {
+            return 0;
+        }
+    }
+
+    const SaveGameState* state = (const SaveGameState*)(base + header->sections[SAVE_SECTION_GAME].offset);
+    if (state->current_floor < 0 || state->current_floor >= MAX_FLOORS) {
+        return 0;
+    }
+
+    // Every enemy pool's block has to fit in the enemies section
+    const Floor* saved = (const Floor*)(base + header->sections[SAVE_SECTION_FLOORS].offset);
+    uint64_t enemies_size = header->sections[SAVE_SECTION_ENEMIES].size;
+    for (int i = 0; i < MAX_FLOORS; i++) {
+        int capacity = saved[i].enemies.capacity;
+        if (capacity < 0 || capacity > (int)ENEMY_SLOT_MASK ||
+            header->enemy_offsets[i] % SAVE_PAGE != 0 ||
+            header->enemy_offsets[i] > enemies_size ||
+            enemy_pool_block_size(capacity) > enemies_size - header->enemy_offsets[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Map a save and point the game at it. Only the enemy pools need their
+// pointers fixed up; the floors are used where they lie in the mapping.
+int load_game(const char* path) {
+    autosave_flush();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+    char* base = mapping;
+    if (!validate_save(base, size)) {
+        munmap(mapping, size);
+        close(fd);
+        return 0;
+    }
+    const SaveHeader* header = (const SaveHeader*)base;
+
+    // Drop the old game, then adopt the new one
+    for (int i = 0; i < MAX_FLOORS; i++) {
+        enemy_pool_free(&CTX(floors)[i].enemies);
+    }
+    CTX(floors) = (Floor*)(base + header->sections[SAVE_SECTION_FLOORS].offset);
+    char* enemies = base + header->sections[SAVE_SECTION_ENEMIES].offset;
+    for (int i = 0; i < MAX_FLOORS; i++) {
+        enemy_pool_attach(&CTX(floors)[i].enemies, enemies + header->enemy_offsets[i]);
+    }
+    release_save();
+    save_mapping = mapping;
+    save_mapping_size = size;
+
+    const SaveGameState* state = (const SaveGameState*)(base + header->sections[SAVE_SECTION_GAME].offset);
+    CTX(game_turn) = state->game_turn;
+    CTX(current_floor) = state->current_floor;
+    CTX(kill_count) = state->kill_count;
+    CTX(gold_collected) = state->gold_collected;
+    CTX(game_seed) = state->game_seed;
+    CTX(game_rng) = state->game_rng;
+    CTX(player) = state->player;
+    CTX(message_log) = state->message_log;
+
+    // Autosaves start from this file. The pool pointers fixed up above are
+    // left stale in it; every load fixes them up again.
+    autosave_reset(fd);
+    close(fd);
+    mem_sample();
+    return 1;
+}
+
+// Unmap the last loaded save. The floors must not live in it any more.
+void release_save() {
+    if (save_mapping) {
+        munmap(save_mapping, save_mapping_size);
+        save_mapping = NULL;
+        save_mapping_size = 0;
+    }
+}
@@ -0,0 +1,86 @@
+#include "../include/scheduler.h"
+
+#define WHEEL_MASK (SCHEDULE_WHEEL_SIZE - 1)
+
+// Append slot to the end of a bucket
+static void link_slot(EnemyPool* pool, int bucket, int slot) {
+    int tail = pool->wheel_tail[bucket];
+
+    pool->wheel_prev[slot] = tail;
+    pool->wheel_next[slot] = 0;
+    if (tail) {
+        pool->wheel_next[tail - 1] = slot + 1;
+    } else {
+        pool->wheel_head[bucket] = slot + 1;
+    }
+    pool->wheel_tail[bucket] = slot + 1;
+}
+
+// Schedule (or reschedule) an enemy's next action
+void schedule_enemy(EnemyPool* pool, int slot, long long tick) {
+    unschedule_enemy(pool, slot);
+    pool->next_act[slot] = tick;
+    link_slot(pool, (int)(tick & WHEEL_MASK), slot);
+}
+
+// Remove an enemy from the schedule
+void unschedule_enemy(EnemyPool* pool, int slot) {
+    int bucket = (int)(pool->next_act[slot] & WHEEL_MASK);
+    int prev = pool->wheel_prev[slot];
+    int next = pool->wheel_next[slot];
+
+    // Unscheduled slots are linked to nothing and head no bucket
+    if (!prev && !next && pool->wheel_head[bucket] != slot + 1) return;
+
+    if (prev) {
+        pool->wheel_next[prev - 1] = next;
+    } else {
+        pool->wheel_head[bucket] = next;
+    }
+    if (next) {
+        pool->wheel_prev[next - 1] = prev;
+    } else {
+        pool->wheel_tail[bucket] = prev;
+    }
+    pool->wheel_prev[slot] = 0;
+    pool->wheel_next[slot] = 0;
+}
+
+// Take every enemy due by tick out of its bucket and list it in pool->ready.
+// Enemies scheduled a full wheel turn or more ahead stay where they are.
+int collect_due_enemies(EnemyPool* pool, long long tick) {
+    int bucket = (int)(tick & WHEEL_MASK);
+    int entry = pool->wheel_head[bucket];
+    int count = 0;
+
+    pool->wheel_head[bucket] = 0;
+    pool->wheel_tail[bucket] = 0;
+
+    while (entry) {
+        int slot = entry - 1;
+        entry = pool->wheel_next[slot];
+        pool->wheel_prev[slot] = 0;
+        pool->wheel_next[slot] = 0;
+
+        if (pool->next_act[slot] <= tick) {
+            pool->ready[count++] = slot;
+        } else {
+            link_slot(pool, bucket, slot);
+        }
+    }
+    return count;
+}
+
+// Spend the energy of one action and work out how many ticks the enemy has
+// to wait, at the given speed, to build up enough energy for the next one.
+// Energy left over from rounding up to whole ticks is carried forward.
+long long enemy_action_delay(EnemyPool* pool, int slot, int speed) {
+    long long threshold = (long long)ENERGY_PER_ACTION * TICKS_PER_TURN;
+    long long energy = pool->energy[slot];
+
+    speed = max(speed, 1);
+    long long ticks = (threshold - energy + speed - 1) / speed;
+    ticks = max(ticks, 1);
+    pool->energy[slot] = (int)(energy + ticks * speed - threshold);
+    return ticks;
+}
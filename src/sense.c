@@ -0,0 +1,162 @@
+#include "../include/sense.h"
+#include <stdatomic.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SENSE_X86 1
+#include <immintrin.h>
+#endif
+
+// Plain C version, also used for the tail the vector kernels leave over
+static void sense_scalar(const int* xs, const int* ys, const int* ranges, int count,
+                         int player_x, int player_y, int far_distance,
+                         int* dist, unsigned char* flags) {
+    for (int i = 0; i < count; i++) {
+        int d = abs(player_x - xs[i]) + abs(player_y - ys[i]);
+        dist[i] = d;
+        flags[i] = (unsigned char)((d == 1 ? SENSE_ADJACENT : 0) |
+                                   (d <= ranges[i] ? SENSE_IN_RANGE : 0) |
+                                   (d > far_distance ? SENSE_TOO_FAR : 0));
+    }
+}
+
+#ifdef SENSE_X86
+
+// |v| for 32-bit lanes; SSE2 has no abs instruction
+static inline __m128i abs_epi32_sse2(__m128i v) {
+    __m128i sign = _mm_srai_epi32(v, 31);
+    return _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+}
+
+// Distance and flag bits for four enemies
+static inline __m128i sense4_sse2(const int* xs, const int* ys, const int* ranges,
+                                  __m128i px, __m128i py, __m128i far,
+                                  int* dist) {
+    __m128i dx = _mm_sub_epi32(px, _mm_loadu_si128((const __m128i*)xs));
+    __m128i dy = _mm_sub_epi32(py, _mm_loadu_si128((const __m128i*)ys));
+    __m128i d = _mm_add_epi32(abs_epi32_sse2(dx), abs_epi32_sse2(dy));
+    _mm_storeu_si128((__m128i*)dist, d);
+
+    __m128i range = _mm_loadu_si128((const __m128i*)ranges);
+    __m128i adjacent = _mm_and_si128(_mm_cmpeq_epi32(d, _mm_set1_epi32(1)),
+                                     _mm_set1_epi32(SENSE_ADJACENT));
+    __m128i in_range = _mm_andnot_si128(_mm_cmpgt_epi32(d, range),
+                                        _mm_set1_epi32(SENSE_IN_RANGE));
+    __m128i too_far = _mm_and_si128(_mm_cmpgt_epi32(d, far),
+                                    _mm_set1_epi32(SENSE_TOO_FAR));
+    return _mm_or_si128(_mm_or_si128(adjacent, in_range), too_far);
+}
+
+static void sense_sse2(const int* xs, const int* ys, const int* ranges, int count,
+                       int player_x, int player_y, int far_distance,
+                       int* dist, unsigned char* flags) {
+    __m128i px = _mm_set1_epi32(player_x);
+    __m128i py = _mm_set1_epi32(player_y);
+    __m128i far = _mm_set1_epi32(far_distance);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i lo = sense4_sse2(xs + i, ys + i, ranges + i, px, py, far, dist + i);
+        __m128i hi = sense4_sse2(xs + i + 4, ys + i + 4, ranges + i + 4, px, py, far, dist + i + 4);
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128());
+        _mm_storel_epi64((__m128i*)(flags + i), bytes);
+    }
+    sense_scalar(xs + i, ys + i, ranges + i, count - i, player_x, player_y, far_distance,
+                 dist + i, flags + i);
+}
+
+__attribute__((target("avx2")))
+static void sense_avx2(const int* xs, const int* ys, const int* ranges, int count,
+                       int player_x, int player_y, int far_distance,
+                       int* dist, unsigned char* flags) {
+    __m256i px = _mm256_set1_epi32(player_x);
+    __m256i py = _mm256_set1_epi32(player_y);
+    __m256i far = _mm256_set1_epi32(far_distance);
+    __m256i one = _mm256_set1_epi32(1);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i dx = _mm256_sub_epi32(px, _mm256_loadu_si256((const __m256i*)(xs + i)));
+        __m256i dy = _mm256_sub_epi32(py, _mm256_loadu_si256((const __m256i*)(ys + i)));
+        __m256i d = _mm256_add_epi32(_mm256_abs_epi32(dx), _mm256_abs_epi32(dy));
+        _mm256_storeu_si256((__m256i*)(dist + i), d);
+
+        __m256i range = _mm256_loadu_si256((const __m256i*)(ranges + i));
+        __m256i adjacent = _mm256_and_si256(_mm256_cmpeq_epi32(d, one),
+                                            _mm256_set1_epi32(SENSE_ADJACENT));
+        __m256i in_range = _mm256_andnot_si256(_mm256_cmpgt_epi32(d, range),
+                                               _mm256_set1_epi32(SENSE_IN_RANGE));
+        __m256i too_far = _mm256_and_si256(_mm256_cmpgt_epi32(d, far),
+                                           _mm256_set1_epi32(SENSE_TOO_FAR));
+        __m256i bits = _mm256_or_si256(_mm256_or_si256(adjacent, in_range), too_far);
+
+        // Narrow the eight 32-bit lanes to eight bytes
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(bits),
+                                        _mm256_extracti128_si256(bits, 1));
+        _mm_storel_epi64((__m128i*)(flags + i), _mm_packus_epi16(words, _mm_setzero_si128()));
+    }
+    sense_scalar(xs + i, ys + i, ranges + i, count - i, player_x, player_y, far_distance,
+                 dist + i, flags + i);
+}
+
+#endif // SENSE_X86
+
+// Whether the CPU can run a kernel
+int sense_kernel_available(SenseKernel kernel) {
+    switch (kernel) {
+        case SENSE_SCALAR:
+            return 1;
+#ifdef SENSE_X86
+        case SENSE_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case SENSE_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return 0;
+    }
+}
+
+const char* sense_kernel_name(SenseKernel kernel) {
+    switch (kernel) {
+        case SENSE_SCALAR: return "scalar";
+        case SENSE_SSE2: return "sse2";
+        case SENSE_AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+void sense_batch_kernel(SenseKernel kernel, const int* xs, const int* ys, const int* ranges,
+                        int count, int player_x, int player_y, int far_distance,
+                        int* dist, unsigned char* flags) {
+    switch (kernel) {
+#ifdef SENSE_X86
+        case SENSE_SSE2:
+            sense_sse2(xs, ys, ranges, count, player_x, player_y, far_distance, dist, flags);
+            return;
+        case SENSE_AVX2:
+            sense_avx2(xs, ys, ranges, count, player_x, player_y, far_distance, dist, flags);
+            return;
+#endif
+        default:
+            sense_scalar(xs, ys, ranges, count, player_x, player_y, far_distance, dist, flags);
+            return;
+    }
+}
+
+// Run the widest kernel the CPU supports
+void sense_batch(const int* xs, const int* ys, const int* ranges, int count,
+                 int player_x, int player_y, int far_distance,
+                 int* dist, unsigned char* flags) {
+    static atomic_int best = -1;
+    int kernel = atomic_load(&best);
+
+    if (kernel < 0) {
+        kernel = SENSE_SCALAR;
+        for (int k = SENSE_SCALAR + 1; k < SENSE_KERNEL_COUNT; k++) {
+            if (sense_kernel_available((SenseKernel)k)) kernel = k;
+        }
+        atomic_store(&best, kernel);
+    }
+    sense_batch_kernel((SenseKernel)kernel, xs, ys, ranges, count, player_x, player_y,
+                       far_distance, dist, flags);
+}
@@ -4,107 +4,138 @@
 #include "../include/ui.h"
 #include "../include/item.h"
 #include "../include/globals.h"
+#include "../include/input.h"
+#include "../include/autosave.h"
 
-// Initialize a store with random items based on its type
-void init_store(Store* store, StoreType type) {
+// Take a store from a floor's pool
+Store* alloc_store(Floor* floor) {
+    if (floor->num_stores >= MAX_NPCS) {
+        return NULL;
+    }
+    Store* store = &floor->stores[floor->num_stores++];
+    memset(store, 0, sizeof(Store));
+    save_mark_dirty(&floor->num_stores, sizeof(floor->num_stores));
+    return store;
+}
+
+// Get the store an NPC's store index refers to
+Store* floor_store(Floor* floor, int store) {
+    if (store <= 0 || store > floor->num_stores) {
+        return NULL;
+    }
+    return &floor->stores[store - 1];
+}
+
+// Initialize a store. No stock is generated until the player opens it.
+void init_store(Store* store, StoreType type, uint64_t seed) {
     store->type = type;
+    store->seed = seed;
+    store->epoch = 0;
     store->num_items = 0;
-    store->restock_timer = 0;
     
-    // Set store name and description based on type
-    switch (type) {
+    // Restock every 20-30 turns, fixed for the store's lifetime so any
+    // number of periods can be skipped at once
+    Rng rng;
+    rng_seed(&rng, mix_seed(seed, 0));
+    Rng* previous = use_rng(&rng);
+    store->restock_period = 20 + random_range(0, 10);
+    use_rng(previous);
+    
+    // Start the first restock period
+    restock_store(store, CTX(game_turn));
+}
+
+// Get a store's name
+const char* store_name(const Store* store) {
+    switch (store->type) {
+        case STORE_WEAPONS:
+            return "Weapon Shop";
+        case STORE_ARMOR:
+            return "Armor Shop";
+        case STORE_POTIONS:
+            return "Potion Shop";
         case STORE_GENERAL:
-            strcpy(store->name, "General Store");
-            strcpy(store->description, "A shop selling various useful items");
-            break;
+        default:
+            return "General Store";
+    }
+}
+
+// Get a store's description
+const char* store_description(const Store* store) {
+    switch (store->type) {
         case STORE_WEAPONS:
-            strcpy(store->name, "Weapon Shop");
-            strcpy(store->description, "A shop specializing in deadly weapons");
-            break;
+            return "A shop specializing in deadly weapons";
         case STORE_ARMOR:
-            strcpy(store->name, "Armor Shop");
-            strcpy(store->description, "A shop selling protective gear");
-            break;
+            return "A shop selling protective gear";
         case STORE_POTIONS:
-            strcpy(store->name, "Potion Shop");
-            strcpy(store->description, "A shop selling magical items and potions");
-            break;
+            return "A shop selling magical items and potions";
+        case STORE_GENERAL:
+        default:
+            return "A shop selling various useful items";
+    }
+}
+
+// Get the item table a store stocks from
+static LootTableId store_loot_table(StoreType type) {
+    switch (type) {
+        case STORE_WEAPONS:
+            return LOOT_WEAPON_STORE;
+        case STORE_ARMOR:
+            return LOOT_ARMOR_STORE;
+        case STORE_POTIONS:
+            return LOOT_POTION_STORE;
+        case STORE_GENERAL:
+        default:
+            return LOOT_ITEMS;
     }
-    
-    // Generate initial inventory
-    restock_store(store);
 }
 
-// Restock store inventory with new items
-void restock_store(Store* store) {
+// Start a new restock period at turn. The old stock is dropped and the new
+// one is only generated when the player next opens the store.
+void restock_store(Store* store, int turn) {
+    save_mark_dirty(store, sizeof(Store));
+    store->epoch++;
+    store->stocked = 0;
+    store->num_items = 0;
+    store->restock_turn = turn + store->restock_period;
+}
+
+// Generate the stock for the current restock period, the same whenever
+// it happens
+void stock_store(Store* store) {
+    Rng rng;
+    rng_seed(&rng, mix_seed(store->seed, (uint64_t)store->epoch));
+    Rng* previous = use_rng(&rng);
+    
+    save_mark_dirty(store, sizeof(Store));
     store->num_items = 0;
     
     // Number of items to stock based on store type
     int num_items;
     switch (store->type) {
         case STORE_GENERAL:
-            num_items = 5 + rand() % 3;  // 5-7 items
+        default:
+            num_items = 5 + random_range(0, 2);  // 5-7 items
             break;
         case STORE_WEAPONS:
         case STORE_ARMOR:
-            num_items = 3 + rand() % 2;  // 3-4 items
+            num_items = 3 + random_range(0, 1);  // 3-4 items
             break;
         case STORE_POTIONS:
-            num_items = 4 + rand() % 2;  // 4-5 items
+            num_items = 4 + random_range(0, 1);  // 4-5 items
             break;
     }
     
-    // Generate items based on store type
+    // Draw every item type the store stocks in one pass, then build them
+    int types[MAX_ITEMS];
+    num_items = min(num_items, MAX_ITEMS);
+    loot_draw_many(store_loot_table(store->type), CTX(current_floor), types, num_items);
     for (int i = 0; i < num_items; i++) {
-        Item item;
-        
-        switch (store->type) {
-            case STORE_GENERAL:
-                // Random mix of items
-                item = create_random_item(current_floor);
-                break;
-                
-            case STORE_WEAPONS:
-                // Only weapons
-                item = create_random_item(current_floor);
-                while (item.type != ITEM_WEAPON) {
-                    item = create_random_item(current_floor);
-                }
-                break;
-                
-            case STORE_ARMOR:
-                // Only armor
-                item = create_random_item(current_floor);
-                while (item.type != ITEM_ARMOR) {
-                    item = create_random_item(current_floor);
-                }
-                break;
-                
-            case STORE_POTIONS:
-                // Potions and scrolls
-                item = create_random_item(current_floor);
-                while (item.type != ITEM_POTION && item.type != ITEM_SCROLL) {
-                    item = create_random_item(current_floor);
-                }
-                break;
-        }
-        
-        // Add item to store inventory
-        store->inventory[store->num_items++] = item;
+        store->inventory[store->num_items++] = create_item_of_type((ItemType)types[i], CTX(current_floor));
     }
+    store->stocked = 1;
     
-    // Set restock timer (20-30 turns)
-    store->restock_timer = 20 + rand() % 11;
-}
-
-// Update store state (called each turn)
-void update_store(Store* store) {
-    if (store->restock_timer > 0) {
-        store->restock_timer--;
-        if (store->restock_timer == 0) {
-            restock_store(store);
-        }
-    }
+    use_rng(previous);
 }
 
 // Buy an item from the store
@@ -117,17 +148,18 @@ int buy_item(Store* store, int index) {
     Item* item = &store->inventory[index];
     
     // Check if player has enough gold
-    if (player.gold < item->value) {
+    if (CTX(player).gold < item->value) {
         add_message("Not enough gold!");
         return 0;
     }
     
     // Try to add item to player inventory
     if (add_to_inventory(*item)) {
-        player.gold -= item->value;
-        add_message("Bought %s for %d gold", item->name, item->value);
+        CTX(player).gold -= item->value;
+        add_message("Bought %s for %d gold", item_name(item), item->value);
         
         // Remove item from store inventory
+        save_mark_dirty(store, sizeof(Store));
         for (int i = index; i < store->num_items - 1; i++) {
             store->inventory[i] = store->inventory[i + 1];
         }
@@ -142,98 +174,123 @@ int buy_item(Store* store, int index) {
 
 // Sell an item to the store
 int sell_item(int inventory_index) {
-    if (inventory_index < 0 || inventory_index >= player.num_items) {
+    ItemHandle handle = inventory_handle_at(inventory_index);
+    Item* item = inventory_item(handle);
+    if (inventory_index < 0 || !item) {
         add_message("Invalid item selection!");
         return 0;
     }
     
-    Item* item = &player.inventory[inventory_index];
-    
     // Calculate sell value (50% of buy value)
     int sell_value = item->value / 2;
     
     // Add gold to player
-    player.gold += sell_value;
-    add_message("Sold %s for %d gold", item->name, sell_value);
+    CTX(player).gold += sell_value;
+    add_message("Sold %s for %d gold", item_name(item), sell_value);
     
     // Remove item from inventory
-    remove_from_inventory(inventory_index);
+    remove_from_inventory(handle);
     
     return 1;
 }
 
-// Display store interface
+// Draw the store screen and return the row of its command prompt
+static int draw_store(const Store* store, int center_x, int center_y) {
+    clear();
+    
+    // Draw store header
+    attron(COLOR_PAIR(7));
+    mvprintw(center_y - 10, center_x - 20, "=== %s ===", store_name(store));
+    mvprintw(center_y - 9, center_x - 30, "%s", store_description(store));
+    mvhline(center_y - 8, center_x - 30, '-', 60);  // Draw separator line
+    attroff(COLOR_PAIR(7));
+    
+    // Draw store inventory
+    int y = center_y - 7;
+    attron(COLOR_PAIR(7));
+    mvprintw(y++, center_x - 28, "Available Items:");
+    attroff(COLOR_PAIR(7));
+    
+    for (int i = 0; i < store->num_items; i++) {
+        const Item* item = &store->inventory[i];
+        attron(COLOR_PAIR(3));  // Yellow for items
+        if (item_type(item) == ITEM_WEAPON || item_type(item) == ITEM_ARMOR) {
+            mvprintw(y++, center_x - 28, "%d. %s (Power: %d, Value: %d)", 
+                    i + 1, item_name(item), item->power, item->value);
+        } else if (item_type(item) == ITEM_POTION) {
+            mvprintw(y++, center_x - 28, "%d. %s (Heals: %d, Value: %d)", 
+                    i + 1, item_name(item), item->power, item->value);
+        } else {
+            mvprintw(y++, center_x - 28, "%d. %s (Value: %d)", 
+                    i + 1, item_name(item), item->value);
+        }
+        attroff(COLOR_PAIR(3));
+    }
+    
+    // Draw player gold
+    attron(COLOR_PAIR(6));  // Cyan for gold
+    mvprintw(y + 2, center_x - 28, "Your Gold: %d", CTX(player).gold);
+    attroff(COLOR_PAIR(6));
+    
+    // Draw controls
+    y += 4;
+    attron(COLOR_PAIR(7));
+    mvprintw(y, center_x - 28, "Commands: (b)uy item, (s)ell item, (q)uit store");
+    mvprintw(y + 1, center_x - 28, "Enter command: ");
+    attroff(COLOR_PAIR(7));
+    
+    refresh();
+    return y;
+}
+
+// Display store interface. Keys come through read_input so visits can be
+// recorded and replayed; without a terminal only the drawing is skipped.
 void display_store(Store* store) {
-    int term_width, term_height;
-    getmaxyx(stdscr, term_height, term_width);
+    // Stock is generated the first time the store is opened each period
+    if (!store->stocked) {
+        stock_store(store);
+    }
+    
+    int term_width = 0, term_height = 0;
+    if (!CTX(headless)) {
+        getmaxyx(stdscr, term_height, term_width);
+    }
+    int center_x = term_width / 2;
+    int center_y = term_height / 2;
     
     while (1) {
-        clear();
-        
-        // Calculate center position
-        int center_x = term_width / 2;
-        int center_y = term_height / 2;
-        
-        // Draw store header
-        attron(COLOR_PAIR(7));
-        mvprintw(center_y - 10, center_x - 20, "=== %s ===", store->name);
-        mvprintw(center_y - 9, center_x - 30, "%s", store->description);
-        mvhline(center_y - 8, center_x - 30, '-', 60);  // Draw separator line
-        attroff(COLOR_PAIR(7));
-        
-        // Draw store inventory
-        int y = center_y - 7;
-        attron(COLOR_PAIR(7));
-        mvprintw(y++, center_x - 28, "Available Items:");
-        attroff(COLOR_PAIR(7));
-        
-        for (int i = 0; i < store->num_items; i++) {
-            Item* item = &store->inventory[i];
-            attron(COLOR_PAIR(3));  // Yellow for items
-            if (item->type == ITEM_WEAPON || item->type == ITEM_ARMOR) {
-                mvprintw(y++, center_x - 28, "%d. %s (Power: %d, Value: %d)", 
-                        i + 1, item->name, item->power, item->value);
-            } else if (item->type == ITEM_POTION) {
-                mvprintw(y++, center_x - 28, "%d. %s (Heals: %d, Value: %d)", 
-                        i + 1, item->name, item->power, item->value);
-            } else {
-                mvprintw(y++, center_x - 28, "%d. %s (Value: %d)", 
-                        i + 1, item->name, item->value);
-            }
-            attroff(COLOR_PAIR(3));
+        int y = 0;
+        if (!CTX(headless)) {
+            y = draw_store(store, center_x, center_y);
         }
         
-        // Draw player gold
-        attron(COLOR_PAIR(6));  // Cyan for gold
-        mvprintw(y + 2, center_x - 28, "Your Gold: %d", player.gold);
-        attroff(COLOR_PAIR(6));
-        
-        // Draw controls
-        y += 4;
-        attron(COLOR_PAIR(7));
-        mvprintw(y, center_x - 28, "Commands: (b)uy item, (s)ell item, (q)uit store");
-        mvprintw(y + 1, center_x - 28, "Enter command: ");
-        attroff(COLOR_PAIR(7));
-        
-        refresh();
-        
         // Get input
-        char cmd = getch();
+        char cmd = read_input();
         
-        if (cmd == 'q') break;
+        if (cmd == 'q' || cmd == 27) break;
         
         if (cmd == 'b' || cmd == 's') {
-            mvprintw(y + 2, center_x - 28, "Enter item number: ");
-            refresh();
+            if (!CTX(headless)) {
+                mvprintw(y + 2, center_x - 28, "Enter item number: ");
+                refresh();
+            }
             
             char num_str[16];
             int i = 0;
+            int cancelled = 0;
             while (1) {
-                char c = getch();
+                char c = read_input();
                 if (c == '\n' || c == '\r') break;
+                if (c == 27) {  // ESC key
+                    cancelled = 1;
+                    break;
+                }
                 if (i < 15) num_str[i++] = c;
             }
             num_str[i] = '\0';
+            if (cancelled) {
+                continue;
+            }
             
             int index = atoi(num_str) - 1;  // Convert to 0-based index
             
@@ -244,8 +301,10 @@ void display_store(Store* store) {
             }
             
             // Brief pause to show the result message
-            refresh();
-            napms(500);  // 500ms delay to show the message
+            if (!CTX(headless)) {
+                refresh();
+                napms(500);  // 500ms delay to show the message
+            }
         }
     }
 } 
@@ -0,0 +1,330 @@
+#include "../include/sweep.h"
+#include "../include/globals.h"
+#include "../include/map.h"
+#include "../include/item.h"
+#include "../include/threadpool.h"
+#include "../include/profile.h"
+#include "../include/memory.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define SWEEP_BATCH 4096  // Seeds handed to the pool at a time
+#define MAX_REPORTED 100  // Violations printed before they are only counted
+
+// Invariants every generated floor has to hold
+typedef enum {
+    CHECK_SPAWN,   // The player starts or arrives on a walkable tile
+    CHECK_STAIRS,  // The stairs are there and can be walked to
+    CHECK_KEY,     // One key, reachable, in a room apart from the stairs rooms
+    CHECK_WALLS,   // No item, store or enemy stands in a wall
+    MAX_CHECKS
+} SweepCheck;
+
+static const char* check_names[MAX_CHECKS] = {
+    [CHECK_SPAWN] = "spawn",
+    [CHECK_STAIRS] = "stairs",
+    [CHECK_KEY] = "key",
+    [CHECK_WALLS] = "walls",
+};
+
+// Settings for one sweep
+typedef struct {
+    uint64_t from;
+    uint64_t to;
+    int threads;  // 0 for one per core
+    int timeout;  // Seconds a floor may take before the watchdog stops the sweep
+} SweepOptions;
+
+// What one pool thread is generating, for the watchdog
+typedef struct {
+    _Atomic uint64_t seed;
+    atomic_int floor;
+    _Atomic long long started_ns;  // When the floor was started, 0 while idle
+    char padding[40];              // Keep each thread's entry on its own cache line
+} SweepWatch;
+
+static struct {
+    SweepWatch* watches;
+    int num_watches;
+    atomic_int next_watch;
+    atomic_int stopping;
+    uint64_t batch_from;
+    atomic_int violations[MAX_CHECKS];
+    atomic_int reported;
+    pthread_mutex_t print_lock;
+} sweep = {
+    .print_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// Parse --seed-sweep FROM..TO (or a single seed), --threads N and --timeout S
+static int parse_sweep_options(int argc, char* argv[], SweepOptions* options) {
+    options->from = 1;
+    options->to = 0;
+    options->threads = 0;
+    options->timeout = 10;
+
+    for (int i = 0; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--seed-sweep") == 0 && value) {
+            char* end;
+            options->from = strtoull(value, &end, 10);
+            options->to = strncmp(end, "..", 2) == 0 ? strtoull(end + 2, &end, 10) : options->from;
+            if (*end) {
+                options->to = 0;
+                options->from = 1;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && value) {
+            options->threads = atoi(value);
+        } else if (strcmp(argv[i], "--timeout") == 0 && value) {
+            options->timeout = atoi(value);
+        } else {
+            fprintf(stderr, "Unknown or incomplete option: %s\n", argv[i]);
+            break;
+        }
+        i++;
+    }
+    if (options->from > options->to || options->timeout <= 0) {
+        fprintf(stderr, "Usage: game --seed-sweep FROM..TO [--threads N] [--timeout SECONDS]\n");
+        return 0;
+    }
+    return 1;
+}
+
+// Print a violation with what it takes to reproduce it
+static void report_violation(uint64_t seed, int floor_num, SweepCheck check, const char* format, ...) {
+    atomic_fetch_add(&sweep.violations[check], 1);
+    if (atomic_fetch_add(&sweep.reported, 1) >= MAX_REPORTED) {
+        return;
+    }
+    char detail[128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(detail, sizeof(detail), format, args);
+    va_end(args);
+
+    pthread_mutex_lock(&sweep.print_lock);
+    printf("seed %" PRIu64 " floor %d: %s: %s\n", seed, floor_num + 1, check_names[check], detail);
+    pthread_mutex_unlock(&sweep.print_lock);
+}
+
+static int walkable(const Floor* floor, int x, int y) {
+    return x >= 0 && x < MAP_WIDTH && y >= 0 && y < MAP_HEIGHT && floor->map[y][x] != '#';
+}
+
+// Mark every tile the player can walk to from (x, y), moving as the eight
+// movement keys do
+static void flood_reachable(const Floor* floor, int x, int y, unsigned char reach[MAP_HEIGHT][MAP_WIDTH]) {
+    static _Thread_local int queue[MAP_WIDTH * MAP_HEIGHT];
+    int head = 0;
+    int tail = 0;
+
+    memset(reach, 0, MAP_HEIGHT * MAP_WIDTH);
+    if (!walkable(floor, x, y)) {
+        return;
+    }
+    reach[y][x] = 1;
+    queue[tail++] = y * MAP_WIDTH + x;
+    while (head < tail) {
+        int cx = queue[head] % MAP_WIDTH;
+        int cy = queue[head] / MAP_WIDTH;
+        head++;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int nx = cx + dx;
+                int ny = cy + dy;
+                if (walkable(floor, nx, ny) && !reach[ny][nx]) {
+                    reach[ny][nx] = 1;
+                    queue[tail++] = ny * MAP_WIDTH + nx;
+                }
+            }
+        }
+    }
+}
+
+// Check a freshly generated and populated floor with the player on it
+static void check_floor(uint64_t seed, int floor_num) {
+    static _Thread_local unsigned char reach[MAP_HEIGHT][MAP_WIDTH];
+    const Floor* floor = &CTX(floors)[floor_num];
+
+    // The spawn, and everything the player can get to from it
+    if (!walkable(floor, CTX(player).x, CTX(player).y)) {
+        report_violation(seed, floor_num, CHECK_SPAWN, "player at (%d, %d) is in a wall", CTX(player).x, CTX(player).y);
+    }
+    flood_reachable(floor, CTX(player).x, CTX(player).y, reach);
+
+    // Stairs: down on every floor, up on every floor but the first
+    int down_x = floor->down_stairs_x;
+    int down_y = floor->down_stairs_y;
+    if (floor->map[down_y][down_x] != '%') {
+        report_violation(seed, floor_num, CHECK_STAIRS, "no down stairs");
+    } else if (!reach[down_y][down_x]) {
+        report_violation(seed, floor_num, CHECK_STAIRS, "down stairs at (%d, %d) unreachable", down_x, down_y);
+    }
+    int up_x = floor->up_stairs_x;
+    int up_y = floor->up_stairs_y;
+    int has_up = floor_num > 0 && floor->map[up_y][up_x] == '<';
+    if (floor_num > 0 && !has_up) {
+        report_violation(seed, floor_num, CHECK_STAIRS, "no up stairs");
+    }
+
+    // The key
+    int keys = 0;
+    for (int i = 0; i < MAX_ITEMS; i++) {
+        const Item* item = &floor->items[i];
+        if (!item->active || item_type(item) != ITEM_KEY || item->key_id != floor_num + 1) {
+            continue;
+        }
+        keys++;
+        int room = floor->room_id[item->y][item->x];
+        if (!room) {
+            report_violation(seed, floor_num, CHECK_KEY, "key at (%d, %d) outside every room", item->x, item->y);
+        } else if (room == floor->room_id[down_y][down_x] || (has_up && room == floor->room_id[up_y][up_x])) {
+            report_violation(seed, floor_num, CHECK_KEY, "key at (%d, %d) in a stairs room", item->x, item->y);
+        }
+        if (!reach[item->y][item->x]) {
+            report_violation(seed, floor_num, CHECK_KEY, "key at (%d, %d) unreachable", item->x, item->y);
+        }
+    }
+    if (keys != 1) {
+        report_violation(seed, floor_num, CHECK_KEY, "%d keys", keys);
+    }
+
+    // Nothing stands in a wall
+    for (int i = 0; i < MAX_ITEMS; i++) {
+        const Item* item = &floor->items[i];
+        if (item->active && !walkable(floor, item->x, item->y)) {
+            report_violation(seed, floor_num, CHECK_WALLS, "%s at (%d, %d)", item_name(item), item->x, item->y);
+        }
+    }
+    for (int i = 0; i < MAX_NPCS; i++) {
+        const NPC* npc = &floor->npcs[i];
+        if (npc->active && !walkable(floor, npc->x, npc->y)) {
+            report_violation(seed, floor_num, CHECK_WALLS, "store at (%d, %d)", npc->x, npc->y);
+        }
+    }
+    const EnemyPool* pool = &floor->enemies;
+    for (int i = 0; i < pool->num_live; i++) {
+        int slot = pool->live[i];
+        if (!walkable(floor, pool->x[slot], pool->y[slot])) {
+            report_violation(seed, floor_num, CHECK_WALLS, "enemy at (%d, %d)", pool->x[slot], pool->y[slot]);
+        }
+    }
+}
+
+// Generate every floor of a seed, one after another as if the player took
+// each down stairs at once, and check each with its rooms populated
+static void sweep_seed(uint64_t seed, SweepWatch* watch) {
+    atomic_store(&watch->seed, seed);
+    atomic_store(&watch->floor, 0);
+    atomic_store(&watch->started_ns, profile_now_ns());
+
+    GameContext* ctx = create_game_context(seed, NULL);
+    if (!ctx) {
+        fprintf(stderr, "Out of memory at seed %" PRIu64 "\n", seed);
+        exit(1);
+    }
+    GameContext* previous = use_game_context(ctx);
+    for (int f = 0; f < MAX_FLOORS; f++) {
+        if (f > 0) {
+            atomic_store(&watch->floor, f);
+            atomic_store(&watch->started_ns, profile_now_ns());
+            leave_floor();
+            init_floor(f);
+            find_map_tile(current_floor_ptr(), '<', &CTX(player).x, &CTX(player).y);
+        }
+        populate_all_rooms(current_floor_ptr());
+        check_floor(seed, f);
+    }
+    use_game_context(previous);
+    destroy_game_context(ctx);
+    atomic_store(&watch->started_ns, 0);
+}
+
+// Parallel body: sweep seeds batch_from + [begin, end)
+static void sweep_seeds(void* context, int begin, int end) {
+    static _Thread_local SweepWatch* watch = NULL;
+    (void)context;
+
+    if (!watch) {
+        watch = &sweep.watches[atomic_fetch_add(&sweep.next_watch, 1) % sweep.num_watches];
+    }
+    for (int i = begin; i < end; i++) {
+        sweep_seed(sweep.batch_from + (uint64_t)i, watch);
+    }
+}
+
+// A floor that never finishes generating cannot be stopped from outside its
+// thread, so the watchdog names it and ends the sweep
+static void* watchdog_main(void* arg) {
+    const SweepOptions* options = arg;
+    long long limit = (long long)options->timeout * 1000000000LL;
+
+    while (!atomic_load(&sweep.stopping)) {
+        usleep(100000);
+        long long now = profile_now_ns();
+        for (int i = 0; i < sweep.num_watches; i++) {
+            SweepWatch* watch = &sweep.watches[i];
+            long long started = atomic_load(&watch->started_ns);
+            if (started && now - started > limit) {
+                pthread_mutex_lock(&sweep.print_lock);
+                printf("seed %" PRIu64 " floor %d: watchdog: still generating after %d s\n",
+                       atomic_load(&watch->seed), atomic_load(&watch->floor) + 1, options->timeout);
+                fflush(stdout);
+                _exit(2);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Generate and check every floor of seeds FROM..TO. Violations are printed
+// as they are found with the seed and floor to reproduce them, followed by
+// the count of each kind and the sweep's speed.
+int run_seed_sweep(int argc, char* argv[]) {
+    SweepOptions options;
+    if (!parse_sweep_options(argc, argv, &options)) {
+        return 1;
+    }
+
+    int threads = thread_pool_init(options.threads);
+    sweep.num_watches = threads;
+    sweep.watches = mem_alloc(MEM_OTHER, (size_t)threads * sizeof(SweepWatch));
+    if (!sweep.watches) {
+        return 1;
+    }
+    pthread_t watchdog;
+    if (pthread_create(&watchdog, NULL, watchdog_main, &options) != 0) {
+        mem_free(MEM_OTHER, sweep.watches);
+        return 1;
+    }
+
+    uint64_t seeds = options.to - options.from + 1;
+    long long start = profile_now_ns();
+    for (uint64_t done = 0; done < seeds; done += SWEEP_BATCH) {
+        sweep.batch_from = options.from + done;
+        parallel_for((int)min(seeds - done, (uint64_t)SWEEP_BATCH), 1, sweep_seeds, NULL);
+    }
+    double seconds = (double)(profile_now_ns() - start) / 1e9;
+
+    atomic_store(&sweep.stopping, 1);
+    pthread_join(watchdog, NULL);
+    thread_pool_shutdown();
+    mem_free(MEM_OTHER, sweep.watches);
+
+    int total = 0;
+    for (int check = 0; check < MAX_CHECKS; check++) {
+        total += atomic_load(&sweep.violations[check]);
+    }
+    if (total > MAX_REPORTED) {
+        printf("(%d more violations not shown)\n", total - MAX_REPORTED);
+    }
+    printf("%" PRIu64 " seeds, %d floors each, %d threads, %.1f seeds/sec\n",
+           seeds, MAX_FLOORS, threads, seconds > 0 ? seeds / seconds : 0.0);
+    for (int check = 0; check < MAX_CHECKS; check++) {
+        printf("%-8s %d violations\n", check_names[check], atomic_load(&sweep.violations[check]));
+    }
+    return total ? 1 : 0;
+}
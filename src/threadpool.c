@@ -0,0 +1,213 @@
+#include "../include/threadpool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define MAX_POOL_THREADS 64
+
+// Each worker owns a range of chunks packed into one word: the owner takes
+// chunks from the front and idle workers steal them from the back. Packing
+// both ends together lets a single compare-and-swap settle any race.
+typedef struct {
+    _Atomic uint64_t range;  // (front << 32) | back
+    char padding[56];        // Keep each worker's range on its own cache line
+} WorkRange;
+
+typedef struct {
+    pthread_t threads[MAX_POOL_THREADS];
+    int num_threads;          // Including the thread that calls parallel_for
+    WorkRange ranges[MAX_POOL_THREADS];
+
+    // Current job
+    ParallelForFn fn;
+    void* context;
+    int count;
+    int grain;
+    atomic_int chunks_left;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    unsigned long job_id;
+    int workers_busy;
+    int shutting_down;
+} ThreadPool;
+
+static ThreadPool pool = {
+    .num_threads = 1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .job_ready = PTHREAD_COND_INITIALIZER,
+    .job_done = PTHREAD_COND_INITIALIZER
+};
+
+// Set while a thread runs chunks, so a parallel_for inside a job (a session
+// stepped on the pool planning its enemies) runs inline instead of
+// waiting on the job it is part of
+static _Thread_local int in_job = 0;
+
+static uint64_t pack_range(uint32_t front, uint32_t back) {
+    return ((uint64_t)front << 32) | back;
+}
+
+// Take a chunk from the front of our own range, or -1 if it is empty
+static int pop_chunk(WorkRange* range) {
+    uint64_t old = atomic_load(&range->range);
+    for (;;) {
+        uint32_t front = (uint32_t)(old >> 32);
+        uint32_t back = (uint32_t)old;
+        if (front >= back) return -1;
+        if (atomic_compare_exchange_weak(&range->range, &old, pack_range(front + 1, back))) {
+            return (int)front;
+        }
+    }
+}
+
+// Take a chunk from the back of another worker's range, or -1 if it is empty
+static int steal_chunk(WorkRange* range) {
+    uint64_t old = atomic_load(&range->range);
+    for (;;) {
+        uint32_t front = (uint32_t)(old >> 32);
+        uint32_t back = (uint32_t)old;
+        if (front >= back) return -1;
+        if (atomic_compare_exchange_weak(&range->range, &old, pack_range(front, back - 1))) {
+            return (int)(back - 1);
+        }
+    }
+}
+
+// Run chunks of the current job until none are left anywhere
+static void run_chunks(int worker) {
+    in_job = 1;
+    for (;;) {
+        int chunk = pop_chunk(&pool.ranges[worker]);
+
+        // Our range is empty: steal from the others, starting with our neighbour
+        for (int i = 1; chunk < 0 && i < pool.num_threads; i++) {
+            chunk = steal_chunk(&pool.ranges[(worker + i) % pool.num_threads]);
+        }
+        if (chunk < 0) break;
+
+        int begin = chunk * pool.grain;
+        int end = min(begin + pool.grain, pool.count);
+        pool.fn(pool.context, begin, end);
+        atomic_fetch_sub(&pool.chunks_left, 1);
+    }
+    in_job = 0;
+}
+
+// Worker thread: wait for a job, help run it, repeat. A worker starts
+// after whatever job came before it, which it is no part of.
+static void* worker_main(void* arg) {
+    int worker = (int)(intptr_t)arg;
+
+    pthread_mutex_lock(&pool.lock);
+    unsigned long seen_job = pool.job_id;
+    for (;;) {
+        while (!pool.shutting_down && pool.job_id == seen_job) {
+            pthread_cond_wait(&pool.job_ready, &pool.lock);
+        }
+        if (pool.shutting_down) break;
+        seen_job = pool.job_id;
+        pool.workers_busy++;
+        pthread_mutex_unlock(&pool.lock);
+
+        run_chunks(worker);
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.workers_busy == 0) {
+            pthread_cond_signal(&pool.job_done);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+// Start the pool's worker threads. No job runs meanwhile: jobs are only
+// started by the thread that sizes the pool, and workers read the size
+// only once a job published after it reaches them.
+int thread_pool_init(int threads) {
+    thread_pool_shutdown();
+
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    threads = max(1, min(threads, MAX_POOL_THREADS));
+
+    pthread_mutex_lock(&pool.lock);
+    pool.shutting_down = 0;
+    pthread_mutex_unlock(&pool.lock);
+
+    int started = 1;
+    while (started < threads &&
+           pthread_create(&pool.threads[started], NULL, worker_main, (void*)(intptr_t)started) == 0) {
+        started++;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.num_threads = started;
+    pthread_mutex_unlock(&pool.lock);
+    return started;
+}
+
+// Stop and join the worker threads
+void thread_pool_shutdown(void) {
+    if (pool.num_threads <= 1) return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.shutting_down = 1;
+    pthread_cond_broadcast(&pool.job_ready);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 1; i < pool.num_threads; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    pool.num_threads = 1;
+}
+
+// Number of threads that run parallel loops, including the caller
+int thread_pool_size(void) {
+    return pool.num_threads;
+}
+
+// Run fn over [0, count) in chunks of grain items, spread over the pool.
+// The calling thread works too and returns once every chunk is done. One
+// thread at a time may start a loop; loops started from inside one run
+// inline on the thread that reaches them.
+void parallel_for(int count, int grain, ParallelForFn fn, void* context) {
+    if (count <= 0) return;
+    grain = max(grain, 1);
+
+    int chunks = (count + grain - 1) / grain;
+    if (pool.num_threads <= 1 || chunks == 1 || in_job) {
+        fn(context, 0, count);
+        return;
+    }
+
+    // Set the job up before any chunk of it is visible: a worker still
+    // waking for an earlier job may take one as soon as the ranges fill
+    pthread_mutex_lock(&pool.lock);
+    pool.fn = fn;
+    pool.context = context;
+    pool.count = count;
+    pool.grain = grain;
+    atomic_store(&pool.chunks_left, chunks);
+
+    // Deal the chunks out evenly; stealing evens out the rest
+    for (int i = 0; i < pool.num_threads; i++) {
+        uint32_t front = (uint32_t)((long long)chunks * i / pool.num_threads);
+        uint32_t back = (uint32_t)((long long)chunks * (i + 1) / pool.num_threads);
+        atomic_store(&pool.ranges[i].range, pack_range(front, back));
+    }
+    pool.job_id++;
+    pthread_cond_broadcast(&pool.job_ready);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_chunks(0);
+
+    // Wait for the other workers to finish their last chunks
+    pthread_mutex_lock(&pool.lock);
+    while (pool.workers_busy > 0 || atomic_load(&pool.chunks_left) > 0) {
+        pthread_cond_wait(&pool.job_done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
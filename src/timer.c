@@ -0,0 +1,211 @@
+#include <limits.h>
+#include "../include/timer.h"
+
+#define OVERFLOW_LEVEL TIMER_LEVELS
+#define WHEEL_BITS (TIMER_LEVELS * TIMER_LEVEL_BITS)  // Turns covered below the overflow list
+
+// Turns one bucket spans at a level
+static inline int level_shift(int level) {
+    return level * TIMER_LEVEL_BITS;
+}
+
+static void link_timer(TimerWheel* wheel, int index, int level, int bucket) {
+    Timer* timer = &wheel->timers[index];
+    timer->level = (uint8_t)level;
+    timer->bucket = (uint8_t)bucket;
+    timer->next = 0;
+    timer->prev = wheel->tail[level][bucket];
+    if (timer->prev) {
+        wheel->timers[timer->prev - 1].next = (uint8_t)(index + 1);
+    } else {
+        wheel->head[level][bucket] = (uint8_t)(index + 1);
+    }
+    wheel->tail[level][bucket] = (uint8_t)(index + 1);
+    wheel->occupied[level] |= 1ULL << bucket;
+}
+
+static void unlink_timer(TimerWheel* wheel, int index) {
+    Timer* timer = &wheel->timers[index];
+    int level = timer->level, bucket = timer->bucket;
+    if (timer->prev) {
+        wheel->timers[timer->prev - 1].next = timer->next;
+    } else {
+        wheel->head[level][bucket] = timer->next;
+    }
+    if (timer->next) {
+        wheel->timers[timer->next - 1].prev = timer->prev;
+    } else {
+        wheel->tail[level][bucket] = timer->prev;
+    }
+    if (!wheel->head[level][bucket]) {
+        wheel->occupied[level] &= ~(1ULL << bucket);
+    }
+}
+
+// File a timer at the lowest level whose current span holds its deadline
+static void place_timer(TimerWheel* wheel, int index) {
+    Timer* timer = &wheel->timers[index];
+    int deadline = timer->deadline;
+    unsigned int distance = (unsigned int)(deadline ^ wheel->turn);
+
+    for (int level = 0; level < TIMER_LEVELS; level++) {
+        if (distance < 1u << level_shift(level + 1)) {
+            link_timer(wheel, index, level, (deadline >> level_shift(level)) & (TIMER_BUCKETS - 1));
+            return;
+        }
+    }
+    link_timer(wheel, index, OVERFLOW_LEVEL, 0);
+}
+
+static void free_timer(TimerWheel* wheel, int index) {
+    Timer* timer = &wheel->timers[index];
+    timer->pending = 0;
+    timer->generation++;
+    timer->next = (uint8_t)wheel->free_head;
+    wheel->free_head = index + 1;
+    wheel->count--;
+}
+
+// Earliest turn at or after wheel->turn that needs work: a level 0
+// deadline, or the start of a higher bucket that must be cascaded
+static int next_event(const TimerWheel* wheel) {
+    int best = INT_MAX;
+
+    for (int level = 0; level < TIMER_LEVELS; level++) {
+        int shift = level_shift(level);
+        int current = (wheel->turn >> shift) & (TIMER_BUCKETS - 1);
+        uint64_t ahead = wheel->occupied[level] & (~0ULL << current);
+        if (!ahead) {
+            continue;
+        }
+        int span = wheel->turn & ~((1 << level_shift(level + 1)) - 1);
+        int start = span | (__builtin_ctzll(ahead) << shift);
+        best = min(best, max(start, wheel->turn));
+    }
+
+    if (wheel->occupied[OVERFLOW_LEVEL]) {
+        int start = wheel->turn & ~((1 << WHEEL_BITS) - 1);
+        if (start < wheel->turn) {
+            start += 1 << WHEEL_BITS;
+        }
+        best = min(best, start);
+    }
+    return best;
+}
+
+// Move every timer out of a bucket whose span starts now and file it again
+static void cascade_bucket(TimerWheel* wheel, int level, int bucket) {
+    // Detach the whole list first: overflow timers may be filed right back
+    int index = wheel->head[level][bucket] - 1;
+    wheel->head[level][bucket] = 0;
+    wheel->tail[level][bucket] = 0;
+    wheel->occupied[level] &= ~(1ULL << bucket);
+    while (index >= 0) {
+        int next = wheel->timers[index].next - 1;
+        place_timer(wheel, index);
+        index = next;
+    }
+}
+
+void timer_wheel_init(TimerWheel* wheel, int turn) {
+    memset(wheel, 0, sizeof(TimerWheel));
+    wheel->turn = turn;
+}
+
+TimerHandle timer_add(TimerWheel* wheel, int deadline, TimerKind kind, int arg) {
+    int index;
+    if (wheel->free_head) {
+        index = wheel->free_head - 1;
+        wheel->free_head = wheel->timers[index].next;
+    } else if (wheel->used < TIMER_CAPACITY) {
+        index = wheel->used++;
+    } else {
+        return TIMER_HANDLE_NONE;
+    }
+
+    // Deadlines already past fire on the next turn processed
+    Timer* timer = &wheel->timers[index];
+    timer->deadline = max(deadline, wheel->turn);
+    timer->kind = (uint8_t)kind;
+    timer->arg = arg;
+    timer->pending = 1;
+    wheel->count++;
+    place_timer(wheel, index);
+
+    return ((TimerHandle)(timer->generation + 1) << TIMER_SLOT_BITS) | (TimerHandle)index;
+}
+
+// Index of the timer a handle refers to, or -1 once it has fired or been cancelled
+static int timer_index(const TimerWheel* wheel, TimerHandle handle) {
+    int index = (int)(handle & TIMER_SLOT_MASK);
+    if (handle == TIMER_HANDLE_NONE || index >= wheel->used) {
+        return -1;
+    }
+    const Timer* timer = &wheel->timers[index];
+    if (!timer->pending || (TimerHandle)(timer->generation + 1) != handle >> TIMER_SLOT_BITS) {
+        return -1;
+    }
+    return index;
+}
+
+void timer_cancel(TimerWheel* wheel, TimerHandle handle) {
+    int index = timer_index(wheel, handle);
+    if (index < 0) {
+        return;
+    }
+    unlink_timer(wheel, index);
+    free_timer(wheel, index);
+}
+
+int timer_pending(const TimerWheel* wheel, TimerHandle handle) {
+    return timer_index(wheel, handle) >= 0;
+}
+
+int timer_advance(TimerWheel* wheel, int turn, TimerFn fn, void* ctx) {
+    int fired = 0;
+
+    while (wheel->turn <= turn) {
+        int event = wheel->count ? next_event(wheel) : INT_MAX;
+        if (event > turn) {
+            wheel->turn = turn + 1;
+            break;
+        }
+        wheel->turn = event;
+
+        // Pull down every bucket whose span starts now, top level first so
+        // timers can fall through more than one level
+        if (wheel->occupied[OVERFLOW_LEVEL] && (event & ((1 << WHEEL_BITS) - 1)) == 0) {
+            cascade_bucket(wheel, OVERFLOW_LEVEL, 0);
+        }
+        for (int level = TIMER_LEVELS - 1; level > 0; level--) {
+            int shift = level_shift(level);
+            if ((event & ((1 << shift) - 1)) == 0) {
+                int bucket = (event >> shift) & (TIMER_BUCKETS - 1);
+                if (wheel->occupied[level] & (1ULL << bucket)) {
+                    cascade_bucket(wheel, level, bucket);
+                }
+            }
+        }
+
+        // Fire in the order the timers were added. Timers added by the
+        // callbacks land on later turns, behind the ones due now.
+        wheel->turn = event + 1;
+        int bucket = event & (TIMER_BUCKETS - 1);
+        while (wheel->head[0][bucket]) {
+            int index = wheel->head[0][bucket] - 1;
+            Timer* timer = &wheel->timers[index];
+            if (timer->deadline != event) {
+                break;
+            }
+            TimerKind kind = (TimerKind)timer->kind;
+            int arg = timer->arg;
+            unlink_timer(wheel, index);
+            free_timer(wheel, index);
+            fired++;
+            if (fn) {
+                fn(ctx, kind, arg, event);
+            }
+        }
+    }
+    return fired;
+}
@@ -0,0 +1,226 @@
+#define _GNU_SOURCE  // gettid
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "../include/trace.h"
+#include "../include/memory.h"
+
+typedef struct {
+    const char* name;
+    const char* arg_name;
+    long long start_ns;
+    long long duration_ns;
+    int arg;
+} TraceEvent;
+
+typedef struct TraceChunk {
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+    atomic_int count;                 // Events the owner has published
+    struct TraceChunk* _Atomic next;  // Set once the owner has moved on
+} TraceChunk;
+
+// One thread's events. The owner only appends and the writer only reads
+// and frees chunks the owner has left, so neither ever waits on the other.
+typedef struct {
+    TraceChunk* write_chunk;  // Owner's
+    TraceChunk* read_chunk;   // Writer's
+    int read_index;           // Writer's
+    atomic_int chunks;        // Allocated and not yet freed
+    atomic_llong dropped;
+    int tid;
+    int is_main;
+    int named;                // The writer has put out the thread's name
+} TraceBuffer;
+
+atomic_int trace_enabled = 0;
+
+static TraceBuffer* buffers[MAX_TRACE_THREADS];
+static atomic_int num_buffers = 0;
+static _Thread_local TraceBuffer* thread_buffer = NULL;
+static _Thread_local int thread_registered = 0;
+
+static struct {
+    FILE* file;
+    pthread_t thread;
+    pthread_t main_thread;
+    atomic_int stopping;
+    long long origin_ns;  // Trace timestamps count from here
+    int events;           // Written so far, for the separators
+} writer;
+
+// The calling thread's buffer, made and registered on its first event;
+// NULL once MAX_TRACE_THREADS threads have one
+static TraceBuffer* get_thread_buffer(void) {
+    if (thread_registered) {
+        return thread_buffer;
+    }
+    thread_registered = 1;
+    int index = atomic_fetch_add(&num_buffers, 1);
+    if (index >= MAX_TRACE_THREADS) {
+        return NULL;
+    }
+    TraceBuffer* buffer = mem_alloc(MEM_IO, sizeof(TraceBuffer));
+    TraceChunk* chunk = buffer ? mem_alloc(MEM_IO, sizeof(TraceChunk)) : NULL;
+    if (!chunk) {
+        mem_free(MEM_IO, buffer);
+        buffer = NULL;
+    } else {
+        buffer->write_chunk = chunk;
+        buffer->read_chunk = chunk;
+        buffer->chunks = 1;
+        buffer->tid = index + 1;
+        buffer->is_main = pthread_equal(pthread_self(), writer.main_thread);
+    }
+    // Published last; the writer skips slots that are still NULL
+    __atomic_store_n(&buffers[index], buffer, __ATOMIC_RELEASE);
+    thread_buffer = buffer;
+    return buffer;
+}
+
+void trace_span(const char* name, long long start_ns, const char* arg_name, int arg) {
+    long long end_ns = profile_now_ns();
+    TraceBuffer* buffer = get_thread_buffer();
+    if (!buffer) {
+        return;
+    }
+    TraceChunk* chunk = buffer->write_chunk;
+    int count = atomic_load_explicit(&chunk->count, memory_order_relaxed);
+    if (count == TRACE_CHUNK_EVENTS) {
+        TraceChunk* next = NULL;
+        if (atomic_load_explicit(&buffer->chunks, memory_order_relaxed) < TRACE_MAX_CHUNKS) {
+            next = mem_alloc(MEM_IO, sizeof(TraceChunk));
+        }
+        if (!next) {
+            atomic_fetch_add_explicit(&buffer->dropped, 1, memory_order_relaxed);
+            return;
+        }
+        atomic_fetch_add_explicit(&buffer->chunks, 1, memory_order_relaxed);
+        atomic_store_explicit(&chunk->next, next, memory_order_release);
+        buffer->write_chunk = chunk = next;
+        count = 0;
+    }
+    TraceEvent* event = &chunk->events[count];
+    event->name = name;
+    event->arg_name = arg_name;
+    event->start_ns = start_ns;
+    event->duration_ns = end_ns - start_ns;
+    event->arg = arg;
+    atomic_store_explicit(&chunk->count, count + 1, memory_order_release);
+}
+
+static void write_separator(void) {
+    fputs(writer.events++ ? ",\n" : "\n", writer.file);
+}
+
+// Write out everything the threads have added since the last drain
+static void drain_buffers(void) {
+    int count = min(atomic_load(&num_buffers), MAX_TRACE_THREADS);
+    for (int i = 0; i < count; i++) {
+        TraceBuffer* buffer = __atomic_load_n(&buffers[i], __ATOMIC_ACQUIRE);
+        if (!buffer) {
+            continue;
+        }
+        if (!buffer->named) {
+            buffer->named = 1;
+            write_separator();
+            fprintf(writer.file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s %d\"}}", buffer->tid, buffer->is_main ? "game" : "worker", buffer->tid);
+        }
+        for (;;) {
+            TraceChunk* chunk = buffer->read_chunk;
+            int count = atomic_load_explicit(&chunk->count, memory_order_acquire);
+            for (; buffer->read_index < count; buffer->read_index++) {
+                const TraceEvent* event = &chunk->events[buffer->read_index];
+                write_separator();
+                fprintf(writer.file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                        event->name, buffer->tid, (event->start_ns - writer.origin_ns) / 1e3,
+                        event->duration_ns / 1e3);
+                if (event->arg_name) {
+                    fprintf(writer.file, ",\"args\":{\"%s\":%d}", event->arg_name, event->arg);
+                }
+                fputc('}', writer.file);
+            }
+            // A full chunk with a successor is the owner's no longer
+            TraceChunk* next = atomic_load_explicit(&chunk->next, memory_order_acquire);
+            if (count < TRACE_CHUNK_EVENTS || !next) {
+                break;
+            }
+            mem_free(MEM_IO, chunk);
+            atomic_fetch_sub_explicit(&buffer->chunks, 1, memory_order_relaxed);
+            buffer->read_chunk = next;
+            buffer->read_index = 0;
+        }
+    }
+}
+
+#ifdef PROFILE
+// Drain the buffers a few hundred times a second at the lowest priority,
+// so the writer takes its time from idle cores rather than the game
+static void* writer_main(void* arg) {
+    (void)arg;
+    setpriority(PRIO_PROCESS, (id_t)gettid(), 19);
+    struct timespec pause = {0, 5000000};
+    while (!atomic_load(&writer.stopping)) {
+        nanosleep(&pause, NULL);
+        drain_buffers();
+    }
+    return NULL;
+}
+#endif
+
+int trace_start(const char* path) {
+#ifndef PROFILE
+    (void)path;
+    fprintf(stderr, "Tracing needs a build with PROFILE=1\n");
+    return 0;
+#else
+    if (writer.file) {
+        return 0;
+    }
+    writer.file = fopen(path, "w");
+    if (!writer.file) {
+        return 0;
+    }
+    setvbuf(writer.file, NULL, _IOFBF, 1 << 20);
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", writer.file);
+    writer.events = 0;
+    writer.main_thread = pthread_self();
+    writer.origin_ns = profile_now_ns();
+    atomic_store(&writer.stopping, 0);
+    if (pthread_create(&writer.thread, NULL, writer_main, NULL) != 0) {
+        fclose(writer.file);
+        writer.file = NULL;
+        return 0;
+    }
+    atomic_store(&trace_enabled, 1);
+    return 1;
+#endif
+}
+
+// Spans still open when tracing stops are left out
+void trace_stop(void) {
+    if (!writer.file) {
+        return;
+    }
+    atomic_store(&trace_enabled, 0);
+    atomic_store(&writer.stopping, 1);
+    pthread_join(writer.thread, NULL);
+    drain_buffers();
+    fputs("\n]}\n", writer.file);
+    fclose(writer.file);
+    writer.file = NULL;
+
+    long long dropped = 0;
+    int count = min(atomic_load(&num_buffers), MAX_TRACE_THREADS);
+    for (int i = 0; i < count; i++) {
+        if (buffers[i]) {
+            dropped += atomic_load(&buffers[i]->dropped);
+        }
+    }
+    if (dropped) {
+        fprintf(stderr, "Trace writer fell too far behind: %lld events dropped\n", dropped);
+    }
+}
@@ -2,7 +2,11 @@
 #include "../include/game.h"
 #include "../include/player.h"
 #include "../include/enemy.h"
+#include "../include/item.h"
 #include "../include/message.h"
+#include "../include/input.h"
+#include "../include/profile.h"
+#include "../include/memory.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <ncurses.h>
@@ -48,9 +52,28 @@ void init_ui()
     refresh();
 }
 
+#ifdef PROFILE
+static WINDOW *profile_hud = NULL;
+static int profile_hud_visible = 0;
+#endif
+static WINDOW *memory_hud = NULL;
+static int memory_hud_visible = 0;
+
 // Cleanup ncurses
 void cleanup_ui()
 {
+#ifdef PROFILE
+    if (profile_hud)
+    {
+        delwin(profile_hud);
+        profile_hud = NULL;
+    }
+#endif
+    if (memory_hud)
+    {
+        delwin(memory_hud);
+        memory_hud = NULL;
+    }
     endwin();
 }
 
@@ -64,137 +87,164 @@ void get_terminal_size(int *width, int *height)
 void update_camera()
 {
     // Center camera on player
-    camera_x = player.x - SCREEN_WIDTH / 2;
-    camera_y = player.y - SCREEN_HEIGHT / 2;
+    CTX(camera_x) = CTX(player).x - SCREEN_WIDTH / 2;
+    CTX(camera_y) = CTX(player).y - SCREEN_HEIGHT / 2;
 }
 
-// View inventory
-void view_inventory()
+// Draw the inventory screen and return the row of its command prompt
+static int draw_inventory(int center_x, int center_y)
 {
-    int term_width, term_height;
-    get_terminal_size(&term_width, &term_height);
+    // Clear screen
+    clear();
 
-    while (1)
+    // Draw inventory header
+    attron(COLOR_PAIR(7));
+    mvprintw(center_y - 10, center_x - 15, "=== Inventory (%d/%d) ===", CTX(player).inventory.num_items, MAX_INVENTORY);
+    mvhline(center_y - 9, center_x - 20, '-', 40); // Draw separator line
+    attroff(COLOR_PAIR(7));
+
+    // Draw equipment section first
+    int y = center_y - 8;
+    attron(COLOR_PAIR(7));
+    mvprintw(y++, center_x - 18, "Equipped:");
+    attroff(COLOR_PAIR(7));
+
+    attron(COLOR_PAIR(4)); // Blue for equipment
+    for (int i = 0; i < MAX_EQUIPMENT_SLOTS; i++)
     {
-        // Clear screen
-        clear();
-
-        // Calculate center position
-        int center_x = term_width / 2;
-        int center_y = term_height / 2;
-
-        // Draw inventory header
-        attron(COLOR_PAIR(7));
-        mvprintw(center_y - 10, center_x - 15, "=== Inventory (%d/%d) ===", player.num_items, MAX_INVENTORY);
-        mvhline(center_y - 9, center_x - 20, '-', 40); // Draw separator line
-        attroff(COLOR_PAIR(7));
-
-        // Draw equipment section first
-        int y = center_y - 8;
-        attron(COLOR_PAIR(7));
-        mvprintw(y++, center_x - 18, "Equipped:");
-        attroff(COLOR_PAIR(7));
-
-        attron(COLOR_PAIR(4)); // Blue for equipment
-        for (int i = 0; i < MAX_EQUIPMENT_SLOTS; i++)
+        Item *item = &CTX(player).equipment[i];
+        const char *slot_name;
+        switch (i)
         {
-            Item *item = player.equipment[i];
-            const char *slot_name;
-            switch (i)
-            {
-            case SLOT_WEAPON:
-                slot_name = "Weapon";
-                break;
-            case SLOT_ARMOR:
-                slot_name = "Armor";
-                break;
-            case SLOT_RING:
-                slot_name = "Ring";
-                break;
-            case SLOT_AMULET:
-                slot_name = "Amulet";
-                break;
-            default:
-                slot_name = "Unknown";
-                break;
-            }
-            if (item)
+        case SLOT_WEAPON:
+            slot_name = "Weapon";
+            break;
+        case SLOT_ARMOR:
+            slot_name = "Armor";
+            break;
+        case SLOT_RING:
+            slot_name = "Ring";
+            break;
+        case SLOT_AMULET:
+            slot_name = "Amulet";
+            break;
+        default:
+            slot_name = "Unknown";
+            break;
+        }
+        if (item->active)
+        {
+            if (item_type(item) == ITEM_WEAPON || item_type(item) == ITEM_ARMOR)
             {
-                if (item->type == ITEM_WEAPON || item->type == ITEM_ARMOR)
-                {
-                    mvprintw(y++, center_x - 16, "%s: %s (Power: %d, Value: %d)",
-                             slot_name, item->name, item->power, item->value);
-                }
-                else
-                {
-                    mvprintw(y++, center_x - 16, "%s: %s", slot_name, item->name);
-                }
+                mvprintw(y++, center_x - 16, "%s: %s (Power: %d, Value: %d)",
+                         slot_name, item_name(item), item->power, item->value);
             }
             else
             {
-                mvprintw(y++, center_x - 16, "%s: None", slot_name);
+                mvprintw(y++, center_x - 16, "%s: %s", slot_name, item_name(item));
             }
         }
-        attroff(COLOR_PAIR(4));
+        else
+        {
+            mvprintw(y++, center_x - 16, "%s: None", slot_name);
+        }
+    }
+    attroff(COLOR_PAIR(4));
 
-        // Draw inventory items
-        y += 2; // Add spacing between sections
-        attron(COLOR_PAIR(7));
-        mvprintw(y++, center_x - 18, "Items:");
-        attroff(COLOR_PAIR(7));
+    // Draw inventory items
+    y += 2; // Add spacing between sections
+    attron(COLOR_PAIR(7));
+    mvprintw(y++, center_x - 18, "Items:");
+    attroff(COLOR_PAIR(7));
 
-        int item_count = 0;
-        for (int i = 0; i < MAX_INVENTORY; i++)
+    int item_count = 0;
+    for (ItemHandle handle = inventory_handle_at(0); handle != ITEM_HANDLE_NONE;
+         handle = inventory_handle_at(item_count))
+    {
+        Item *item = inventory_item(handle);
+        int count = inventory_count(handle);
+        char name[MAX_NAME_LEN + 8];
+        if (count > 1)
+            snprintf(name, sizeof(name), "%s x%d", item_name(item), count);
+        else
+            snprintf(name, sizeof(name), "%s", item_name(item));
+
+        attron(COLOR_PAIR(3)); // Yellow for items
+        if (item_type(item) == ITEM_WEAPON || item_type(item) == ITEM_ARMOR)
         {
-            Item *item = &player.inventory[i];
-            if (item->type != ITEM_NONE && item->active)
-            {                          // Only show active items
-                attron(COLOR_PAIR(3)); // Yellow for items
-                if (item->type == ITEM_WEAPON || item->type == ITEM_ARMOR)
-                {
-                    mvprintw(y++, center_x - 16, "%d. %s (Power: %d, Value: %d)",
-                             ++item_count, item->name, item->power, item->value);
-                }
-                else if (item->type == ITEM_POTION)
-                {
-                    mvprintw(y++, center_x - 16, "%d. %s (Heals: %d, Value: %d)",
-                             ++item_count, item->name, item->power, item->value);
-                }
-                else
-                {
-                    mvprintw(y++, center_x - 16, "%d. %s (Value: %d)",
-                             ++item_count, item->name, item->value);
-                }
-                attroff(COLOR_PAIR(3));
-            }
+            mvprintw(y++, center_x - 16, "%d. %s (Power: %d, Value: %d)",
+                     ++item_count, name, item->power, item->value);
         }
+        else if (item_type(item) == ITEM_POTION)
+        {
+            mvprintw(y++, center_x - 16, "%d. %s (Heals: %d, Value: %d)",
+                     ++item_count, name, item->power, item->value);
+        }
+        else
+        {
+            mvprintw(y++, center_x - 16, "%d. %s (Value: %d)",
+                     ++item_count, name, item->value);
+        }
+        attroff(COLOR_PAIR(3));
+    }
+
+    // Draw controls at the bottom
+    y = center_y + 8;
+    attron(COLOR_PAIR(7));
+    mvprintw(y, center_x - 20, "Commands: (u)se item, (d)rop item, (e)quip item, (q)uit inventory");
+    mvprintw(y + 1, center_x - 20, "Enter command: ");
+    attroff(COLOR_PAIR(7));
+
+    refresh();
+    return y;
+}
 
-        // Draw controls at the bottom
-        y = center_y + 8;
-        attron(COLOR_PAIR(7));
-        mvprintw(y, center_x - 20, "Commands: (u)se item, (d)rop item, (e)quip item, (q)uit inventory");
-        mvprintw(y + 1, center_x - 20, "Enter command: ");
-        attroff(COLOR_PAIR(7));
+// View inventory. Keys come through read_input so the screen can be
+// recorded and replayed; without a terminal only the drawing is skipped.
+void view_inventory()
+{
+    int term_width = 0, term_height = 0;
+    if (!CTX(headless))
+    {
+        get_terminal_size(&term_width, &term_height);
+    }
+    int center_x = term_width / 2;
+    int center_y = term_height / 2;
+
+    while (1)
+    {
+        int y = 0;
+        if (!CTX(headless))
+        {
+            y = draw_inventory(center_x, center_y);
+        }
 
-        refresh();
+        int item_count = 0;
+        while (inventory_handle_at(item_count) != ITEM_HANDLE_NONE)
+        {
+            item_count++;
+        }
 
         // Get input
-        char cmd = getch();
+        char cmd = read_input();
 
-        if (cmd == 'q')
+        if (cmd == 'q' || cmd == 27)
             break;
 
         if (cmd == 'u' || cmd == 'd' || cmd == 'e')
         {
             // Get item number
-            mvprintw(y + 1, center_x - 20, "Enter item number (1-%d): ", item_count);
-            refresh();
+            if (!CTX(headless))
+            {
+                mvprintw(y + 1, center_x - 20, "Enter item number (1-%d): ", item_count);
+                refresh();
+            }
 
             char num_str[16] = {0};
             int num_pos = 0;
             while (1)
             {
-                char c = getch();
+                char c = read_input();
                 if (c == '\n')
                     break;
                 if (c == 27)
@@ -205,8 +255,11 @@ void view_inventory()
                 if (num_pos < 15 && c >= '0' && c <= '9')
                 {
                     num_str[num_pos++] = c;
-                    mvprintw(y + 1, center_x - 20 + 20 + num_pos - 1, "%c", c);
-                    refresh();
+                    if (!CTX(headless))
+                    {
+                        mvprintw(y + 1, center_x - 20 + 20 + num_pos - 1, "%c", c);
+                        refresh();
+                    }
                 }
             }
 
@@ -215,42 +268,31 @@ void view_inventory()
                 int index = atoi(num_str) - 1;
                 if (index >= 0 && index < item_count)
                 {
-                    // Find the actual item index
-                    int actual_index = -1;
-                    int current_count = -1;
-                    for (int i = 0; i < MAX_INVENTORY; i++)
-                    {
-                        if (player.inventory[i].type != ITEM_NONE && player.inventory[i].active)
-                        {
-                            current_count++;
-                            if (current_count == index)
-                            {
-                                actual_index = i;
-                                break;
-                            }
-                        }
-                    }
+                    ItemHandle handle = inventory_handle_at(index);
 
-                    if (actual_index >= 0)
+                    if (handle != ITEM_HANDLE_NONE)
                     {
                         switch (cmd)
                         {
                         case 'u':
-                            use_item(&player.inventory[actual_index]);
-                            // Item will be deactivated by use_item if consumed
+                            use_item(handle);
+                            // Consumed items are removed by use_item
                             break;
                         case 'd':
-                            drop_item(actual_index);
+                            drop_item(handle);
                             // Item will be removed by drop_item
                             break;
                         case 'e':
-                            equip_item(actual_index);
+                            equip_item(handle);
                             // Item will be removed by equip_item
                             break;
                         }
                         // Brief pause to show the result message
-                        refresh();
-                        napms(500); // 500ms delay to show the message
+                        if (!CTX(headless))
+                        {
+                            refresh();
+                            napms(500); // 500ms delay to show the message
+                        }
                     }
                 }
             }
@@ -275,8 +317,8 @@ void render_map()
     {
         for (int x = 0; x < SCREEN_WIDTH; x++)
         {
-            map_x = x + player.x - SCREEN_WIDTH / 2;
-            map_y = y + player.y - SCREEN_HEIGHT / 2;
+            map_x = x + CTX(player).x - SCREEN_WIDTH / 2;
+            map_y = y + CTX(player).y - SCREEN_HEIGHT / 2;
             if (map_x >= MAP_WIDTH)
             {
                 map_x = MAP_WIDTH;
@@ -303,7 +345,7 @@ void render_map()
                 {
                     attron(COLOR_PAIR(3)); // Yellow
                 }
-                else if (tile == player.symbol)
+                else if (tile == CTX(player).symbol)
                 {
                     attron(COLOR_PAIR(2)); // Green for player
                 }
@@ -342,21 +384,15 @@ void render_map()
             // render Player
             if (x == SCREEN_WIDTH / 2 && y == SCREEN_HEIGHT / 2)
             {
-                mvaddch(y, x, player.symbol);
+                mvaddch(y, x, CTX(player).symbol);
             }
             // render Enemy
-            for (int i = 0; i < MAX_ENEMIES; i++)
+            int enemy = enemy_at(&floor->enemies, map_x, map_y);
+            if (enemy >= 0 && floor->visible[map_y][map_x])
             {
-                Enemy *enemy = &floor->enemies[i];
-                if (enemy->active && floor->visible[enemy->y][enemy->x])
-                {
-                    attron(COLOR_PAIR(1)); // Red for enemies
-                    if (map_x == enemy->x && map_y == enemy->y)
-                    {
-                        mvaddch(y, x, enemy->symbol);
-                    }
-                    attroff(COLOR_PAIR(1));
-                }
+                attron(COLOR_PAIR(1)); // Red for enemies
+                mvaddch(y, x, enemy_archetype(&floor->enemies, enemy)->symbol);
+                attroff(COLOR_PAIR(1));
             }
             // render NPCS
             for (int i = 0; i < MAX_NPCS; i++)
@@ -380,7 +416,7 @@ void render_map()
                     attron(COLOR_PAIR(3)); // Yellow for items
                     if (map_x == item->x && map_y == item->y)
                     {
-                        mvaddch(y, x, item->symbol);
+                        mvaddch(y, x, item_prototype(item)->symbol);
                     }
                     attroff(COLOR_PAIR(3));
                 }
@@ -401,9 +437,9 @@ void render_messages()
 
     // Draw messages
     attron(COLOR_PAIR(7));
-    for (int i = 0; i < message_log.num_messages && i < 5; i++)
+    for (int i = 0; i < CTX(message_log).num_messages && i < 5; i++)
     {
-        mvprintw(start_y + i, 1, "%s", message_log.messages[i]);
+        mvprintw(start_y + i, 1, "%s", CTX(message_log).messages[i]);
     }
     attroff(COLOR_PAIR(7));
 }
@@ -421,47 +457,47 @@ void render_status()
 
     // Draw player stats
     attron(COLOR_PAIR(7));
-    mvprintw(start_y++, start_x, "Level: %d", player.level);
-    mvprintw(start_y++, start_x, "HP: %d/%d", player.health, player.max_health);
-    mvprintw(start_y++, start_x, "MP: %d/%d", player.mana, player.max_mana);
-    mvprintw(start_y++, start_x, "XP: %d/%d", player.exp, player.exp_next);
-    mvprintw(start_y++, start_x, "Power: %d", player.power);
-    mvprintw(start_y++, start_x, "Defense: %d", player.defense);
-    mvprintw(start_y++, start_x, "Gold: %d", player.gold);
+    mvprintw(start_y++, start_x, "Level: %d", CTX(player).level);
+    mvprintw(start_y++, start_x, "HP: %d/%d", CTX(player).health, CTX(player).max_health);
+    mvprintw(start_y++, start_x, "MP: %d/%d", CTX(player).mana, CTX(player).max_mana);
+    mvprintw(start_y++, start_x, "XP: %d/%d", CTX(player).exp, CTX(player).exp_next);
+    mvprintw(start_y++, start_x, "Power: %d", CTX(player).stats.attack);
+    mvprintw(start_y++, start_x, "Defense: %d", CTX(player).stats.defense);
+    mvprintw(start_y++, start_x, "Gold: %d", CTX(player).gold);
 
     // Draw floor info
     start_y++;
-    mvprintw(start_y++, start_x, "Floor: %d", current_floor + 1);
+    mvprintw(start_y++, start_x, "Floor: %d", CTX(current_floor) + 1);
 
     // Draw status effects
     start_y++;
     mvprintw(start_y++, start_x, "Status:");
     for (int i = 0; i < MAX_STATUS_EFFECTS; i++)
     {
-        if (player.status[i].type != STATUS_NONE)
+        if (CTX(player).status[i].type != STATUS_NONE)
         {
             mvprintw(start_y++, start_x, "%d: %d turns",
-                     player.status[i].type, player.status[i].duration);
+                     CTX(player).status[i].type, CTX(player).status[i].until - CTX(game_turn));
         }
     }
 
     // Draw abilities
     start_y++;
     mvprintw(start_y++, start_x, "Abilities:");
-    for (int i = 0; i < player.num_abilities; i++)
+    for (int i = 0; i < CTX(player).num_abilities; i++)
     {
-        if (player.abilities[i].current_cooldown > 0)
+        if (CTX(player).abilities[i].ready_turn > CTX(game_turn))
         {
             mvprintw(start_y++, start_x, "%c) %s (%d)",
-                     player.abilities[i].key,
-                     player.abilities[i].name,
-                     player.abilities[i].current_cooldown);
+                     CTX(player).abilities[i].key,
+                     CTX(player).abilities[i].name,
+                     CTX(player).abilities[i].ready_turn - CTX(game_turn));
         }
         else
         {
             mvprintw(start_y++, start_x, "%c) %s",
-                     player.abilities[i].key,
-                     player.abilities[i].name);
+                     CTX(player).abilities[i].key,
+                     CTX(player).abilities[i].name);
         }
     }
     attroff(COLOR_PAIR(7));
@@ -472,3 +508,140 @@ void refresh_screen()
 {
     refresh();
 }
+
+#ifdef PROFILE
+// Draw the profiler overlay in its own window over the map: every phase's
+// time in the last frame and its p50, p99 and max so far, in microseconds
+void render_profile_hud()
+{
+    if (!profile_hud_visible)
+    {
+        return;
+    }
+    if (!profile_hud)
+    {
+        profile_hud = newwin(MAX_PROFILE_PHASES + 3, 52, 1, 1);
+        if (!profile_hud)
+        {
+            return;
+        }
+    }
+
+    ProfileStats stats;
+    profile_phase_stats(PROFILE_FOV, &stats);
+    werase(profile_hud);
+    wattron(profile_hud, COLOR_PAIR(6));
+    box(profile_hud, 0, 0);
+    mvwprintw(profile_hud, 0, 2, " profile, us over %d frames ", stats.frames);
+    wattroff(profile_hud, COLOR_PAIR(6));
+    mvwprintw(profile_hud, 1, 2, "%-12s %8s %8s %8s %8s", "phase", "last", "p50", "p99", "max");
+    for (int phase = 0; phase < MAX_PROFILE_PHASES; phase++)
+    {
+        profile_phase_stats((ProfilePhase)phase, &stats);
+        mvwprintw(profile_hud, 2 + phase, 2, "%-12s %8.1f %8.1f %8.1f %8.1f",
+                  profile_phase_name((ProfilePhase)phase), stats.last_ns / 1e3,
+                  stats.p50_ns / 1e3, stats.p99_ns / 1e3, stats.max_ns / 1e3);
+    }
+    wrefresh(profile_hud);
+}
+
+// Show or hide the profiler overlay straight away, even while a menu
+// waits for a key. Hiding repaints what the overlay covered.
+void toggle_profile_hud()
+{
+    if (CTX(headless))
+    {
+        return;
+    }
+    profile_hud_visible = !profile_hud_visible;
+    memory_hud_visible = 0;
+    touchwin(stdscr);
+    refresh();
+    if (profile_hud_visible)
+    {
+        render_profile_hud();
+    }
+}
+#endif
+
+// Draw the memory overlay: every subsystem's bytes held in place and on
+// the heap, live and peak, in KB
+void render_memory_hud()
+{
+    if (!memory_hud_visible)
+    {
+        return;
+    }
+    if (!memory_hud)
+    {
+        memory_hud = newwin(MAX_MEM_TAGS + 5, 62, 1, 1);
+        if (!memory_hud)
+        {
+            return;
+        }
+    }
+
+    mem_sample();
+    werase(memory_hud);
+    wattron(memory_hud, COLOR_PAIR(6));
+    box(memory_hud, 0, 0);
+    mvwprintw(memory_hud, 0, 2, " memory, KB ");
+    wattroff(memory_hud, COLOR_PAIR(6));
+    mvwprintw(memory_hud, 1, 2, "%-10s %9s %9s %9s %9s %7s", "subsystem", "in place", "peak", "heap", "peak",
+              "blocks");
+    long long in_place = 0;
+    long long heap = 0;
+    for (int tag = 0; tag < MAX_MEM_TAGS; tag++)
+    {
+        MemStats stats;
+        mem_stats((MemTag)tag, &stats);
+        mvwprintw(memory_hud, 2 + tag, 2, "%-10s %9.1f %9.1f %9.1f %9.1f %7lld", mem_tag_name((MemTag)tag),
+                  stats.in_place_live / 1024.0, stats.in_place_peak / 1024.0, stats.heap_live / 1024.0,
+                  stats.heap_peak / 1024.0, stats.heap_blocks);
+        in_place += stats.in_place_live;
+        heap += stats.heap_live;
+    }
+    mvwprintw(memory_hud, 2 + MAX_MEM_TAGS, 2, "%-10s %9.1f %9s %9.1f", "total", in_place / 1024.0, "",
+              heap / 1024.0);
+    mvwprintw(memory_hud, 3 + MAX_MEM_TAGS, 2, "floors %d of %d generated, %lld wrong-tag frees",
+              mem_floors_generated(), MAX_FLOORS, mem_mismatched_frees());
+    wrefresh(memory_hud);
+}
+
+// Show or hide the memory overlay, which takes the profiler's place
+void toggle_memory_hud()
+{
+    if (CTX(headless))
+    {
+        return;
+    }
+    memory_hud_visible = !memory_hud_visible;
+#ifdef PROFILE
+    profile_hud_visible = 0;
+#endif
+    touchwin(stdscr);
+    refresh();
+    if (memory_hud_visible)
+    {
+        render_memory_hud();
+    }
+}
+
+// Overlay keys act on the display straight away, even while a menu waits
+// for a key. Returns 1 when key was one of them.
+int handle_overlay_key(int key)
+{
+#ifdef PROFILE
+    if (key == PROFILE_HUD_KEY)
+    {
+        toggle_profile_hud();
+        return 1;
+    }
+#endif
+    if (key == MEMORY_HUD_KEY)
+    {
+        toggle_memory_hud();
+        return 1;
+    }
+    return 0;
+}
@@ -7,9 +7,51 @@
 #include <string.h>
 #include <time.h>
 
+// Mix two values into a well-spread 64-bit seed (splitmix64 finalizer)
+uint64_t mix_seed(uint64_t a, uint64_t b) {
+    uint64_t z = a + 0x9e3779b97f4a7c15ULL * (b + 1);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Seed a random stream
+void rng_seed(Rng* rng, uint64_t seed) {
+    rng->state = mix_seed(seed, 0);
+    if (rng->state == 0) {
+        rng->state = 0x9e3779b97f4a7c15ULL;  // xorshift must never hold zero
+    }
+}
+
+// Next 64 random bits from a stream (xorshift64*)
+uint64_t rng_next(Rng* rng) {
+    uint64_t x = rng->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+// Make random_range draw from rng in the current game; returns the stream
+// it used before
+Rng* use_rng(Rng* rng) {
+    Rng* previous = game_ctx->current_rng;
+    game_ctx->current_rng = rng;
+    return previous;
+}
+
+// Next 64 random bits from the active stream
+uint64_t random_bits(void) {
+    return rng_next(game_ctx->current_rng);
+}
+
 // Random number generator between min and max (inclusive)
 int random_range(int min, int max) {
-    return min + rand() % (max - min + 1);
+    if (max <= min) {
+        return min;
+    }
+    return min + (int)(rng_next(game_ctx->current_rng) % (uint64_t)(max - min + 1));
 }
 
 // Get status effect name